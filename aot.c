@@ -0,0 +1,1267 @@
+/*
+ * Ahead-of-time compiler
+ *
+ * Every node of lambda body becomes C statements putting its
+ * value into temporary. Calls of built-ins listed in aot.h
+ * are resolved at compile time, arithmetic on literals and
+ * parameters is done on unboxed longs. Where parameter turns
+ * out not to be integer, operation is evaluated by interpreter
+ * instead, like in template JIT. Lists that only literals make
+ * up need no guards at all.
+ *
+ * Compiled code refers to constants as nodes of program tree,
+ * numbered in preorder. Module parses its text on loading and
+ * gets the same tree, so numbers match.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <signal.h>
+
+#include "aot.h"
+#include "builtins.h"
+#include "interp.h"
+#include "jit.h"
+#include "lenv.h"
+#include "lval.h"
+#include "parser.h"
+#include "stats.h"
+#include "strbuf.h"
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+/* Where headers and liblisp.a are, LISP_HOME variable overrides it */
+#ifndef LISP_HOME
+#define LISP_HOME "."
+#endif
+
+/* Built-ins in order of laot_builtin, global ones can't be redefined */
+static const struct
+{
+  const char* name;
+  const char* tag; // Name of constant in generated code
+  lbuiltin f;
+} aot_builtins[] = {
+  { "+", "AOT_ADD", builtin_add },
+  { "-", "AOT_SUB", builtin_sub },
+  { "*", "AOT_MUL", builtin_mul },
+  { "/", "AOT_DIV", builtin_div },
+  { "<", "AOT_LT", builtin_lt },
+  { ">", "AOT_GT", builtin_gt },
+  { "<=", "AOT_LE", builtin_le },
+  { ">=", "AOT_GE", builtin_ge },
+  { "==", "AOT_EQ", builtin_eq },
+  { "!=", "AOT_NE", builtin_ne },
+  { "if", "AOT_IF", builtin_if },
+  { "do", "AOT_DO", builtin_do },
+  { "head", "AOT_HEAD", builtin_head },
+  { "tail", "AOT_TAIL", builtin_tail },
+  { "list", "AOT_LIST", builtin_list },
+  { "join", "AOT_JOIN", builtin_join },
+  { "eval", "AOT_EVAL", builtin_eval },
+  { "len", "AOT_LEN", builtin_len },
+  { "cons", "AOT_CONS", builtin_cons },
+  { "init", "AOT_INIT", builtin_init },
+  { "not", "AOT_NOT", builtin_not },
+};
+
+/* C operators of comparisons */
+static const char* aot_cmp[] = {
+  [AOT_LT] = "<", [AOT_GT] = ">", [AOT_LE] = "<=",
+  [AOT_GE] = ">=", [AOT_EQ] = "==", [AOT_NE] = "!="
+};
+
+/*
+ * Runtime called by compiled code
+ */
+
+static lval* aot_eval_list(lenv* e, lval* v)
+{
+  lval* x = lval_copy(v);
+  x->type = LVAL_SEXPR;
+  return lval_eval(e, x);
+}
+
+/* Parameters are usually where they were bound */
+static int aot_index(lenv* e, int k, lval* sym)
+{
+  if (k < e->count && !strcmp(e->syms[k], sym->sym))
+    return k;
+
+  for (int i = 0; i < e->count; i++)
+    if (!strcmp(e->syms[i], sym->sym))
+      return i;
+  return -1;
+}
+
+static lval* aot_test(lval* c)
+{
+  if (c->type == LVAL_ERROR)
+    return c;
+
+  lval* err = lval_err("Function 'if' passed incorrect type for argument 0. "
+    "Got %s, Expected %s.", ltype_name(c->type), ltype_name(LVAL_NUMBER));
+  lval_del(c);
+  return err;
+}
+
+static lval* aot_args(lval** cells, int count)
+{
+  lval* x = lval_sexpr();
+  x->count = count;
+  x->cell = (lval**)malloc(sizeof(lval*) * count);
+  memcpy(x->cell, cells, sizeof(lval*) * count);
+  return x;
+}
+
+static lval* aot_builtin(lenv* e, laot_builtin b, lval** args, int count)
+{
+  lval* a = aot_args(args, count);
+
+  for (int i = 0; i < count; i++)
+    if (args[i]->type == LVAL_ERROR)
+      return lval_take(a, i);
+
+  STAT_INC(builtin_calls);
+  return aot_builtins[b].f(e, a);
+}
+
+static lval* aot_special(lenv* e, lval* f, lval* v)
+{
+  lval* a = lval_sexpr();
+  for (int i = 1; i < v->count; i++)
+    lval_add(a, lval_copy(v->cell[i]));
+
+  lval* x = f->special(e, a);
+  lval_del(f);
+  return x;
+}
+
+static lval* aot_call(lenv* e, lval** cells, int count)
+{
+  return lval_eval_call(e, aot_args(cells, count));
+}
+
+static const laot_rt aot_rt = {
+  .shadows = &jit_shadows,
+  .num = lval_num,
+  .qexpr = lval_qexpr,
+  .copy = lval_copy,
+  .del = lval_del,
+  .get = lenv_get,
+  .eval = lval_eval,
+  .eval_list = aot_eval_list,
+  .index = aot_index,
+  .test = aot_test,
+  .builtin = aot_builtin,
+  .special = aot_special,
+  .call = aot_call,
+};
+
+/*
+ * Program tree
+ */
+
+static void aot_number(laot_tree* t, lval* v)
+{
+  if (t->node_count % 256 == 0)
+    t->nodes = (lval**)realloc(t->nodes, sizeof(lval*) * (t->node_count + 256));
+  t->nodes[t->node_count++] = v;
+
+  if (v->type == LVAL_SEXPR || v->type == LVAL_QEXPR)
+    for (int i = 0; i < v->count; i++)
+      aot_number(t, v->cell[i]);
+}
+
+static void aot_tree_free(laot_tree* t)
+{
+  for (int i = 0; i < t->form_count; i++)
+    lval_del(t->forms[i]);
+  free(t->forms);
+  free(t->nodes);
+  memset(t, 0, sizeof(*t));
+}
+
+/* Read top-level forms of file into tree */
+static lval* aot_parse(laot_tree* t, const laot_source* s)
+{
+  lparser p;
+  parser_init(&p, s->text, s->len);
+
+  lval* x;
+  lval* result = lval_sexpr();
+
+  while ((x = parser_next(&p)))
+  {
+    if (x->type == LVAL_ERROR)
+    {
+      lval_del(result);
+      result = lval_err("%s: %s", s->name, x->err);
+      lval_del(x);
+      break;
+    }
+
+    if (t->form_count % 64 == 0)
+      t->forms = (lval**)realloc(t->forms, sizeof(lval*) * (t->form_count + 64));
+    t->forms[t->form_count++] = x;
+    aot_number(t, x);
+  }
+
+  parser_free(&p);
+  return result;
+}
+
+static int aot_symbols(lval* v, int from)
+{
+  if (v->type != LVAL_QEXPR || v->count <= from)
+    return 0;
+
+  for (int i = from; i < v->count; i++)
+    if (v->cell[i]->type != LVAL_SYM)
+      return 0;
+  return 1;
+}
+
+static int aot_is(lval* v, const char* sym)
+{
+  return v->type == LVAL_SYM && !strcmp(v->sym, sym);
+}
+
+/* Form defines lambda, either with (def {f} (\ {x} {...}))
+   or (fun {f x} {...}). Formals start at given index. */
+static int aot_def(lval* v, lval** name, lval** formals, int* from, lval** body)
+{
+  if (v->type != LVAL_SEXPR || v->count != 3)
+    return 0;
+
+  lval* a = v->cell[1];
+  lval* b = v->cell[2];
+
+  if (aot_is(v->cell[0], "def") && aot_symbols(a, 0) && a->count == 1
+    && b->type == LVAL_SEXPR && b->count == 3 && aot_is(b->cell[0], "\\")
+    && (aot_symbols(b->cell[1], 0) || (b->cell[1]->type == LVAL_QEXPR && b->cell[1]->count == 0))
+    && b->cell[2]->type == LVAL_QEXPR)
+  {
+    *name = a->cell[0];
+    *formals = b->cell[1];
+    *from = 0;
+    *body = b->cell[2];
+    return 1;
+  }
+
+  if (aot_is(v->cell[0], "fun") && aot_symbols(a, 0) && b->type == LVAL_QEXPR)
+  {
+    *name = a->cell[0];
+    *formals = a;
+    *from = 1;
+    *body = b;
+    return 1;
+  }
+
+  return 0;
+}
+
+/*
+ * Loading
+ */
+
+static pthread_mutex_t aot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Give compiled body to lambda form has bound, if it's still that one */
+static void aot_attach(lenv* e, lval* form, lcompiled code)
+{
+  lval* name;
+  lval* formals;
+  lval* body;
+  int from;
+  aot_def(form, &name, &formals, &from, &body);
+
+  while (e->parent)
+    e = e->parent;
+
+  for (int i = 0; i < e->count; i++)
+  {
+    if (strcmp(e->syms[i], name->sym))
+      continue;
+
+    lval* f = e->vals[i];
+    if (f->type != LVAL_FUN || f->is_builtin
+      || f->formals->count != formals->count - from || !lval_eq(f->body, body))
+      return;
+
+    for (int k = from; k < formals->count; k++)
+      if (!lval_eq(f->formals->cell[k - from], formals->cell[k]))
+        return;
+
+    f->code = code;
+    return;
+  }
+}
+
+/* Evaluate program of module, returns empty list or error */
+lval* aot_run(lenv* e, const laot_module* m)
+{
+  if (m->version != AOT_VERSION || m->lval_size != sizeof(lval)
+    || m->lenv_size != sizeof(lenv))
+    return lval_err("Module was built for another version of interpreter");
+
+  pthread_mutex_lock(&aot_lock);
+  *m->rt = &aot_rt;
+
+  laot_tree* t = m->tree;
+  if (t->forms == NULL)
+    for (int i = 0; i < m->source_count; i++)
+    {
+      lval* x = aot_parse(t, &m->sources[i]);
+      if (x->type == LVAL_ERROR)
+      {
+        aot_tree_free(t);
+        pthread_mutex_unlock(&aot_lock);
+        return x;
+      }
+      lval_del(x);
+    }
+
+  pthread_mutex_unlock(&aot_lock);
+
+  /* Same as 'load', but definitions get compiled bodies */
+  int next = 0;
+  for (int i = 0; i < t->form_count; i++)
+  {
+    lval* x = lval_eval(e, lval_copy(t->forms[i]));
+    if (x->type == LVAL_ERROR)
+      lval_println(x);
+    lval_del(x);
+
+    for (; next < m->fn_count && m->fns[next].form == i; next++)
+      aot_attach(e, t->forms[i], m->fns[next].code);
+  }
+
+  return lval_sexpr();
+}
+
+/* Load shared object made by compiler and run it */
+lval* aot_load(lenv* e, const char* name)
+{
+#ifndef _WIN32
+  /* Name without slash would be searched in library paths */
+  char* path = (char*)malloc(strlen(name) + 3);
+  strcpy(path, strchr(name, '/') ? "" : "./");
+  strcat(path, name);
+
+  /* Lambdas keep pointers into module, so it's never closed */
+  void* h = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  free(path);
+  if (h == NULL)
+    return lval_err("Could not load module %s: %s", name, dlerror());
+
+  const laot_module* m = (const laot_module*)dlsym(h, AOT_SYMBOL);
+  if (m == NULL)
+    return lval_err("%s is not a compiled module", name);
+
+  return aot_run(e, m);
+#else
+  (void)e;
+  return lval_err("Could not load module %s: not supported on this platform", name);
+#endif
+}
+
+/* Entry point of compiled executable */
+int aot_main(const laot_module* m)
+{
+  /* Same as in interpreter, writes to closed pipes fail */
+  signal(SIGPIPE, SIG_IGN);
+
+  linterp* i = interp_new();
+
+  lval* x = aot_run(i->env, m);
+  int status = x->type == LVAL_ERROR;
+  if (status)
+    lval_println(x);
+  lval_del(x);
+
+  interp_del(i);
+  return status;
+}
+
+/*
+ * Code generation
+ */
+
+typedef struct
+{
+  const lval* v;
+  int id;
+} laot_node;
+
+typedef struct
+{
+  lstrbuf out; // Whole module
+  lstrbuf code; // Statements of function being generated
+  laot_tree tree;
+  laot_node* index; // Node numbers sorted by address
+  lval** locals;
+  int local_count;
+  int temps;
+  int ints;
+  int* uses; // Jumps to each label
+  int label_count;
+  int depth;
+} laot_gen;
+
+static int aot_node_cmp(const void* a, const void* b)
+{
+  uintptr_t x = (uintptr_t)((const laot_node*)a)->v;
+  uintptr_t y = (uintptr_t)((const laot_node*)b)->v;
+  return (x > y) - (x < y);
+}
+
+static int aot_id(laot_gen* g, lval* v)
+{
+  laot_node key = { v, 0 };
+  laot_node* n = (laot_node*)bsearch(&key, g->index, g->tree.node_count,
+    sizeof(laot_node), aot_node_cmp);
+  return n->id;
+}
+
+static int aot_local(laot_gen* g, const char* name)
+{
+  for (int i = 0; i < g->local_count; i++)
+    if (!strcmp(g->locals[i]->sym, name))
+      return i;
+  return -1;
+}
+
+/* Built-in list calls, unless parameter hides it */
+static laot_builtin aot_direct(laot_gen* g, lval* v)
+{
+  if (v->count < 2 || v->cell[0]->type != LVAL_SYM)
+    return AOT_NONE;
+
+  const char* name = v->cell[0]->sym;
+  if (aot_local(g, name) >= 0)
+    return AOT_NONE;
+
+  laot_builtin b = AOT_ADD;
+  while (b < AOT_NONE && strcmp(aot_builtins[b].name, name))
+    b++;
+
+  if (b == AOT_IF && v->count != 4)
+    return AOT_NONE;
+  return b;
+}
+
+/* Operation is done unboxed, comparisons take two operands */
+static int aot_arith(laot_builtin b, lval* v)
+{
+  return b < AOT_LT || (b <= AOT_NE && v->count == 3);
+}
+
+static int aot_pure_op(laot_gen* g, lval* v);
+
+/* Value can be computed unboxed without side effects */
+static int aot_pure(laot_gen* g, lval* v)
+{
+  switch (v->type)
+  {
+    case LVAL_NUMBER:
+      return 1;
+    case LVAL_SYM:
+      return aot_local(g, v->sym) >= 0;
+    case LVAL_SEXPR:
+      return aot_pure_op(g, v);
+    default:
+      return 0;
+  }
+}
+
+/* List evaluated as code is such operation */
+static int aot_pure_op(laot_gen* g, lval* v)
+{
+  if (!aot_arith(aot_direct(g, v), v))
+    return 0;
+
+  for (int i = 1; i < v->count; i++)
+    if (!aot_pure(g, v->cell[i]))
+      return 0;
+  return 1;
+}
+
+static void emit(laot_gen* g, const char* fmt, ...)
+{
+  va_list va;
+
+  for (int i = 0; i < g->depth; i++)
+    strbuf_puts(&g->code, "  ");
+
+  va_start(va, fmt);
+  strbuf_vprintf(&g->code, fmt, va);
+  va_end(va);
+
+  strbuf_putc(&g->code, '\n');
+}
+
+static int label_new(laot_gen* g)
+{
+  g->uses = (int*)realloc(g->uses, sizeof(int) * (g->label_count + 1));
+  g->uses[g->label_count] = 0;
+  return g->label_count++;
+}
+
+static void emit_label(laot_gen* g, int l)
+{
+  if (g->uses[l])
+    strbuf_printf(&g->code, "L%d:;\n", l);
+}
+
+static void emit_goto(laot_gen* g, int l)
+{
+  g->uses[l]++;
+  emit(g, "goto L%d;", l);
+}
+
+/* Integer literal, LONG_MIN has no literal of its own */
+static const char* aot_literal(char* buf, long x)
+{
+  if (x == LONG_MIN)
+    snprintf(buf, 32, "(%ldL - 1)", x + 1);
+  else
+    snprintf(buf, 32, "%ldL", x);
+  return buf;
+}
+
+/* Operand is evaluated into box in order, not read unboxed
+   after impure operands that follow it */
+static int aot_boxed(laot_gen* g, lval* v, int i)
+{
+  for (int k = i; k < v->count; k++)
+    if (!aot_pure(g, v->cell[k]))
+      return 1;
+  return 0;
+}
+
+static void emit_box(laot_gen* g, lval* v, int dst);
+static void emit_list(laot_gen* g, lval* v, int dst);
+static int emit_arith(laot_gen* g, lval* v, int fail, int** boxes);
+
+/* Unbox number in temporary, jump to fail if it's something else */
+static int emit_guard(laot_gen* g, const char* box, int fail)
+{
+  int n = g->ints++;
+  emit(g, "if (%s->type != LVAL_NUMBER)", box);
+  g->depth++;
+  emit_goto(g, fail);
+  g->depth--;
+  emit(g, "n%d = %s->num;", n, box);
+  return n;
+}
+
+/* Pure value unboxed */
+static int emit_int(laot_gen* g, lval* v, int fail)
+{
+  char buf[32];
+
+  if (v->type == LVAL_NUMBER)
+  {
+    int n = g->ints++;
+    emit(g, "n%d = %s;", n, aot_literal(buf, v->num));
+    return n;
+  }
+
+  if (v->type == LVAL_SYM)
+  {
+    snprintf(buf, sizeof(buf), "e->vals[l%d]", aot_local(g, v->sym));
+    return emit_guard(g, buf, fail);
+  }
+
+  return emit_arith(g, v, fail, NULL);
+}
+
+/* Operand of unboxed operation, boxed ones are taken in order */
+static int emit_operand(laot_gen* g, lval* v, int i, int fail, int** boxes)
+{
+  if (!aot_boxed(g, v, i))
+    return emit_int(g, v->cell[i], fail);
+
+  char buf[32];
+  snprintf(buf, sizeof(buf), "t%d", *(*boxes)++);
+  return emit_guard(g, buf, fail);
+}
+
+/* Unboxed operation, operands wrap around like in interpreter */
+static int emit_arith(laot_gen* g, lval* v, int fail, int** boxes)
+{
+  laot_builtin b = aot_direct(g, v);
+  int r = emit_operand(g, v, 1, fail, boxes);
+
+  /* Unary minus negates, other operations of one operand keep it */
+  if (v->count == 2 && b == AOT_SUB)
+    emit(g, "n%d = (long)(0UL - (unsigned long)n%d);", r, r);
+
+  for (int i = 2; i < v->count; i++)
+  {
+    lval* y = v->cell[i];
+    int n = emit_operand(g, v, i, fail, boxes);
+
+    switch (b)
+    {
+      case AOT_ADD:
+        emit(g, "n%d = (long)((unsigned long)n%d + (unsigned long)n%d);", r, r, n);
+        break;
+      case AOT_SUB:
+        emit(g, "n%d = (long)((unsigned long)n%d - (unsigned long)n%d);", r, r, n);
+        break;
+      case AOT_MUL:
+        emit(g, "n%d = (long)((unsigned long)n%d * (unsigned long)n%d);", r, r, n);
+        break;
+      case AOT_DIV:
+        /* Division by zero is error, by -1 may trap */
+        if (y->type != LVAL_NUMBER || y->num == 0 || y->num == -1)
+        {
+          emit(g, "if (n%d == 0 || n%d == -1)", n, n);
+          g->depth++;
+          emit_goto(g, fail);
+          g->depth--;
+        }
+        emit(g, "n%d /= n%d;", r, n);
+        break;
+      default:
+        emit(g, "n%d = n%d %s n%d;", r, r, aot_cmp[b], n);
+        break;
+    }
+  }
+
+  return r;
+}
+
+/* Operation on pure operands */
+static void emit_pure(laot_gen* g, lval* v, int dst)
+{
+  int fail = label_new(g);
+  int done = label_new(g);
+
+  int r = emit_arith(g, v, fail, NULL);
+  emit(g, "t%d = rt->num(n%d);", dst, r);
+
+  if (g->uses[fail])
+  {
+    emit_goto(g, done);
+    emit_label(g, fail);
+    emit(g, "t%d = rt->eval_list(e, tree.nodes[%d]);", dst, aot_id(g, v));
+    emit_label(g, done);
+  }
+}
+
+/* Operation with operands that have to be boxed, pure ones left of
+   them are boxed too. When guard fails built-in gets boxes and pure
+   operands that follow them evaluated again. */
+static void emit_mixed(laot_gen* g, lval* v, int dst)
+{
+  int count = v->count - 1;
+  int* boxes = (int*)malloc(sizeof(int) * count);
+  int n = 0;
+
+  for (int i = 1; i < v->count; i++)
+    if (aot_boxed(g, v, i))
+    {
+      boxes[n] = g->temps++;
+      emit_box(g, v->cell[i], boxes[n++]);
+    }
+
+  int fail = label_new(g);
+  int done = label_new(g);
+
+  int* next = boxes;
+  int r = emit_arith(g, v, fail, &next);
+
+  /* First box takes result, others are released */
+  emit(g, "t%d = t%d;", dst, boxes[0]);
+  emit(g, "t%d->num = n%d;", dst, r);
+  for (int k = 1; k < n; k++)
+    emit(g, "rt->del(t%d);", boxes[k]);
+
+  if (g->uses[fail])
+  {
+    emit_goto(g, done);
+    emit_label(g, fail);
+    emit(g, "{");
+    g->depth++;
+
+    lstrbuf a;
+    strbuf_init(&a);
+    for (int i = 1, k = 0; i < v->count; i++)
+    {
+      int t = boxes[k];
+      if (!aot_boxed(g, v, i))
+      {
+        t = g->temps++;
+        emit(g, "t%d = rt->eval(e, rt->copy(tree.nodes[%d]));", t, aot_id(g, v->cell[i]));
+      }
+      else
+        k++;
+      strbuf_printf(&a, "%st%d", i > 1 ? ", " : "", t);
+    }
+
+    emit(g, "lval* a[] = { %s };", a.data);
+    emit(g, "t%d = rt->builtin(e, %s, a, %d);", dst,
+      aot_builtins[aot_direct(g, v)].tag, count);
+    strbuf_free(&a);
+
+    g->depth--;
+    emit(g, "}");
+    emit_label(g, done);
+  }
+
+  free(boxes);
+}
+
+/* Branch of 'if', Q-expression is treated as body */
+static void emit_branch(laot_gen* g, lval* v, int dst)
+{
+  if (v->type == LVAL_QEXPR)
+    emit_list(g, v, dst);
+  else
+    emit_box(g, v, dst);
+}
+
+static void emit_if(laot_gen* g, lval* v, int dst)
+{
+  lval* c = v->cell[1];
+  int then = label_new(g);
+  int other = label_new(g);
+  int done = label_new(g);
+  int box = g->temps++;
+
+  /* Pure condition is tested unboxed */
+  int boxed = 1;
+  if (aot_pure(g, c))
+  {
+    int slow = label_new(g);
+    int n = emit_int(g, c, slow);
+    emit(g, "if (!n%d)", n);
+    g->depth++;
+    emit_goto(g, other);
+    g->depth--;
+    emit_goto(g, then);
+
+    boxed = g->uses[slow] > 0;
+    emit_label(g, slow);
+    if (boxed)
+      emit(g, "t%d = rt->eval(e, rt->copy(tree.nodes[%d]));", box, aot_id(g, c));
+  }
+  else
+    emit_box(g, c, box);
+
+  if (boxed)
+  {
+    int n = g->ints++;
+    emit(g, "if (t%d->type != LVAL_NUMBER)", box);
+    emit(g, "{");
+    g->depth++;
+    emit(g, "t%d = rt->test(t%d);", dst, box);
+    emit_goto(g, done);
+    g->depth--;
+    emit(g, "}");
+    emit(g, "n%d = t%d->num;", n, box);
+    emit(g, "rt->del(t%d);", box);
+    emit(g, "if (!n%d)", n);
+    g->depth++;
+    emit_goto(g, other);
+    g->depth--;
+  }
+
+  emit_label(g, then);
+  emit_branch(g, v->cell[2], dst);
+  emit_goto(g, done);
+
+  emit_label(g, other);
+  emit_branch(g, v->cell[3], dst);
+
+  emit_label(g, done);
+}
+
+/* Sequence stops at first error */
+static void emit_do(laot_gen* g, lval* v, int dst)
+{
+  int done = label_new(g);
+
+  for (int i = 1; i < v->count; i++)
+  {
+    emit_box(g, v->cell[i], dst);
+    if (i == v->count - 1)
+      break;
+
+    emit(g, "if (t%d->type == LVAL_ERROR)", dst);
+    g->depth++;
+    emit_goto(g, done);
+    g->depth--;
+    emit(g, "rt->del(t%d);", dst);
+  }
+
+  emit_label(g, done);
+}
+
+/* Evaluate arguments into array, after head if it's given */
+static void emit_cells(laot_gen* g, lval* v, int head)
+{
+  lstrbuf a;
+  strbuf_init(&a);
+  if (head >= 0)
+    strbuf_printf(&a, "t%d", head);
+
+  for (int i = 1; i < v->count; i++)
+  {
+    int t = g->temps++;
+    emit_box(g, v->cell[i], t);
+    strbuf_printf(&a, "%st%d", a.len ? ", " : "", t);
+  }
+
+  emit(g, "lval* a[] = { %s };", a.data);
+  strbuf_free(&a);
+}
+
+/* Direct call of built-in */
+static void emit_builtin(laot_gen* g, lval* v, laot_builtin b, int dst)
+{
+  emit(g, "{");
+  g->depth++;
+  emit_cells(g, v, -1);
+  emit(g, "t%d = rt->builtin(e, %s, a, %d);", dst, aot_builtins[b].tag, v->count - 1);
+  g->depth--;
+  emit(g, "}");
+}
+
+/* Call of anything else, head is looked up as interpreter does */
+static void emit_apply(laot_gen* g, lval* v, int dst)
+{
+  int h = g->temps++;
+  emit_box(g, v->cell[0], h);
+
+  emit(g, "if (t%d->type == LVAL_FUN && t%d->is_builtin && t%d->special)", h, h, h);
+  g->depth++;
+  emit(g, "t%d = rt->special(e, t%d, tree.nodes[%d]);", dst, h, aot_id(g, v));
+  g->depth--;
+  emit(g, "else");
+  emit(g, "{");
+  g->depth++;
+  emit_cells(g, v, h);
+  emit(g, "t%d = rt->call(e, a, %d);", dst, v->count);
+  g->depth--;
+  emit(g, "}");
+}
+
+/* Evaluation of list as S-expression */
+static void emit_list(laot_gen* g, lval* v, int dst)
+{
+  if (v->count == 0)
+  {
+    emit(g, "t%d = rt->eval_list(e, tree.nodes[%d]);", dst, aot_id(g, v));
+    return;
+  }
+
+  if (v->count == 1)
+  {
+    emit_box(g, v->cell[0], dst);
+    return;
+  }
+
+  laot_builtin b = aot_direct(g, v);
+  if (b == AOT_NONE)
+  {
+    emit_apply(g, v, dst);
+    return;
+  }
+
+  /* Local environment hides built-in, leave it to interpreter */
+  emit(g, "if (atomic_load_explicit(rt->shadows, memory_order_relaxed))");
+  g->depth++;
+  emit(g, "t%d = rt->eval_list(e, tree.nodes[%d]);", dst, aot_id(g, v));
+  g->depth--;
+  emit(g, "else");
+  emit(g, "{");
+  g->depth++;
+
+  if (b == AOT_IF)
+    emit_if(g, v, dst);
+  else if (b == AOT_DO)
+    emit_do(g, v, dst);
+  else if (aot_pure_op(g, v))
+    emit_pure(g, v, dst);
+  else if (aot_arith(b, v))
+    emit_mixed(g, v, dst);
+  else
+    emit_builtin(g, v, b, dst);
+
+  g->depth--;
+  emit(g, "}");
+}
+
+/* Evaluation of any value, result is boxed */
+static void emit_box(laot_gen* g, lval* v, int dst)
+{
+  char buf[32];
+  int k;
+
+  switch (v->type)
+  {
+    case LVAL_NUMBER:
+      emit(g, "t%d = rt->num(%s);", dst, aot_literal(buf, v->num));
+      break;
+
+    case LVAL_SYM:
+      if ((k = aot_local(g, v->sym)) >= 0)
+        emit(g, "t%d = rt->copy(e->vals[l%d]);", dst, k);
+      else
+        emit(g, "t%d = rt->get(e, tree.nodes[%d]);", dst, aot_id(g, v));
+      break;
+
+    case LVAL_SEXPR:
+      emit_list(g, v, dst);
+      break;
+
+    default:
+      emit(g, "t%d = rt->copy(tree.nodes[%d]);", dst, aot_id(g, v));
+      break;
+  }
+}
+
+/* Comment can't hold what closes it */
+static void aot_comment(lstrbuf* b, const char* s)
+{
+  for (; *s; s++)
+  {
+    strbuf_putc(b, *s);
+    if (s[0] == '*' && s[1] == '/')
+      strbuf_putc(b, ' ');
+  }
+}
+
+/* Declare numbered variables, several on a line */
+static void aot_decls(lstrbuf* b, const char* type, const char* prefix, int count)
+{
+  for (int i = 0; i < count; i++)
+    if (i % 8 == 0)
+      strbuf_printf(b, "%s  %s %s%d", i ? ";\n" : "", type, prefix, i);
+    else
+      strbuf_printf(b, ", %s%d", prefix, i);
+
+  if (count)
+    strbuf_puts(b, ";\n");
+}
+
+/* Body of lambda made by form as C function */
+static void aot_function(laot_gen* g, int form, int fn, const char* file)
+{
+  lval* name;
+  lval* formals;
+  lval* body;
+  int from;
+  aot_def(g->tree.forms[form], &name, &formals, &from, &body);
+
+  g->local_count = 0;
+  g->locals = (lval**)realloc(g->locals, sizeof(lval*) * (formals->count + 1));
+  for (int i = from; i < formals->count; i++)
+    if (strcmp(formals->cell[i]->sym, "&"))
+      g->locals[g->local_count++] = formals->cell[i];
+
+  g->code.len = 0;
+  g->code.data[0] = '\0';
+  g->temps = 1;
+  g->ints = 0;
+  g->label_count = 0;
+  g->depth = 1;
+  emit_list(g, body, 0);
+
+  lstrbuf* out = &g->out;
+  strbuf_puts(out, "/* ");
+  aot_comment(out, name->sym);
+  strbuf_puts(out, ", ");
+  aot_comment(out, file);
+  strbuf_printf(out, ":%d */\n", body->line);
+  strbuf_printf(out, "static lval* lisp_f%d(lenv* e)\n{\n", fn);
+
+  aot_decls(out, "int", "l", g->local_count);
+  aot_decls(out, "lval", "*t", g->temps);
+  aot_decls(out, "long", "n", g->ints);
+  strbuf_putc(out, '\n');
+
+  for (int i = 0; i < g->local_count; i++)
+    strbuf_printf(out, "  if ((l%d = rt->index(e, %d, tree.nodes[%d])) < 0)\n"
+      "    return NULL;\n", i, i, aot_id(g, g->locals[i]));
+  if (g->local_count)
+    strbuf_putc(out, '\n');
+
+  strbuf_put(out, g->code.data, g->code.len);
+  strbuf_puts(out, "  return t0;\n}\n\n");
+}
+
+/* Bytes as C string literal, line by line */
+static void aot_string(lstrbuf* b, const char* s, size_t len)
+{
+  strbuf_puts(b, "  \"");
+  for (size_t i = 0; i < len; i++)
+  {
+    unsigned char c = s[i];
+    if (c == '\n')
+      strbuf_puts(b, i + 1 < len ? "\\n\"\n  \"" : "\\n");
+    else if (c == '"' || c == '\\' || c == '?')
+    {
+      strbuf_putc(b, '\\');
+      strbuf_putc(b, c);
+    }
+    else if (c < ' ' || c >= 127)
+      strbuf_printf(b, "\\%03o", c);
+    else
+      strbuf_putc(b, c);
+  }
+  strbuf_puts(b, "\"");
+}
+
+static char* aot_read(const char* name, size_t* len)
+{
+  FILE* f = fopen(name, "rb");
+  if (f == NULL)
+    return NULL;
+
+  lstrbuf b;
+  strbuf_init(&b);
+
+  size_t n;
+  do
+  {
+    strbuf_reserve(&b, 4096);
+    n = fread(b.data + b.len, 1, 4096, f);
+    b.len += n;
+  } while (n > 0);
+
+  fclose(f);
+  *len = b.len;
+  return b.data;
+}
+
+/* Module source of program */
+static lval* aot_generate(laot_gen* g, const char* const* files, int count, int executable)
+{
+  laot_source* sources = (laot_source*)calloc(count, sizeof(laot_source));
+  int* first = (int*)malloc(sizeof(int) * (count + 1));
+  lval* result = lval_sexpr();
+
+  for (int i = 0; i < count && result->type != LVAL_ERROR; i++)
+  {
+    sources[i].name = files[i];
+    sources[i].text = aot_read(files[i], &sources[i].len);
+    first[i] = g->tree.form_count;
+
+    if (sources[i].text == NULL)
+    {
+      lval_del(result);
+      result = lval_err("Could not load Library %s", files[i]);
+      break;
+    }
+
+    lval_del(result);
+    result = aot_parse(&g->tree, &sources[i]);
+  }
+  first[count] = g->tree.form_count;
+
+  if (result->type != LVAL_ERROR)
+  {
+    g->index = (laot_node*)malloc(sizeof(laot_node) * g->tree.node_count);
+    for (int i = 0; i < g->tree.node_count; i++)
+    {
+      g->index[i].v = g->tree.nodes[i];
+      g->index[i].id = i;
+    }
+    qsort(g->index, g->tree.node_count, sizeof(laot_node), aot_node_cmp);
+
+    lstrbuf* out = &g->out;
+    strbuf_puts(out, "/* Generated by lisp --compile, do not edit */\n\n");
+    strbuf_puts(out, "#include \"aot.h\"\n\n");
+    strbuf_puts(out, "static const laot_rt* rt;\n");
+    strbuf_puts(out, "static laot_tree tree;\n\n");
+
+    lstrbuf fns;
+    strbuf_init(&fns);
+    int fn = 0;
+
+    for (int i = 0, file = 0; i < g->tree.form_count; i++)
+    {
+      lval* name;
+      lval* formals;
+      lval* body;
+      int from;
+
+      while (i >= first[file + 1])
+        file++;
+
+      if (!aot_def(g->tree.forms[i], &name, &formals, &from, &body))
+        continue;
+
+      aot_function(g, i, fn, files[file]);
+      strbuf_printf(&fns, "  { %d, lisp_f%d },\n", i, fn++);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+      strbuf_printf(out, "static const char lisp_source%d[] =\n", i);
+      aot_string(out, sources[i].text, sources[i].len);
+      strbuf_puts(out, ";\n\n");
+    }
+
+    strbuf_puts(out, "static const laot_source sources[] = {\n");
+    for (int i = 0; i < count; i++)
+    {
+      strbuf_puts(out, "  {");
+      aot_string(out, files[i], strlen(files[i]));
+      strbuf_printf(out, ", lisp_source%d, sizeof(lisp_source%d) - 1 },\n", i, i);
+    }
+    strbuf_puts(out, "};\n\n");
+
+    if (fn)
+      strbuf_printf(out, "static const laot_fn fns[] = {\n%s};\n\n", fns.data);
+    strbuf_free(&fns);
+
+    strbuf_printf(out,
+      "const laot_module lisp_module = {\n"
+      "  AOT_VERSION, sizeof(lval), sizeof(lenv),\n"
+      "  sources, %d, %s, %d, &rt, &tree\n"
+      "};\n", count, fn ? "fns" : "NULL", fn);
+
+    if (executable)
+      strbuf_puts(out, "\nint main(void)\n{\n  return aot_main(&lisp_module);\n}\n");
+  }
+
+  for (int i = 0; i < count; i++)
+    free((char*)sources[i].text);
+  free(sources);
+  free(first);
+  return result;
+}
+
+static int aot_suffix(const char* s, const char* suffix)
+{
+  size_t n = strlen(s);
+  size_t k = strlen(suffix);
+  return n > k && !strcmp(s + n - k, suffix);
+}
+
+static lval* aot_write(const char* name, lstrbuf* b)
+{
+  FILE* f = fopen(name, "w");
+  if (f == NULL)
+    return lval_err("Could not write %s", name);
+
+  size_t n = fwrite(b->data, 1, b->len, f);
+  if (fclose(f) != 0 || n != b->len)
+    return lval_err("Could not write %s", name);
+  return lval_sexpr();
+}
+
+/* Run C compiler on generated source */
+static lval* aot_build(const char* src, const char* out, int shared)
+{
+#ifndef _WIN32
+  const char* home = getenv("LISP_HOME");
+  if (home == NULL || *home == '\0')
+    home = LISP_HOME;
+
+  const char* cc = getenv("CC");
+  if (cc == NULL || *cc == '\0')
+    cc = "gcc";
+
+  char inc[4096];
+  char lib[4096];
+  snprintf(inc, sizeof(inc), "-I%s", home);
+  snprintf(lib, sizeof(lib), "%s/liblisp.a", home);
+
+  if (!shared && access(lib, R_OK) < 0)
+    return lval_err("Runtime library %s is missing, run 'make lib'", lib);
+
+  const char* argv[] = {
+    cc, "-std=c18", "-O2", inc, "-o", out, "-x", "c", src, "-x", "none",
+    shared ? "-fPIC" : lib, shared ? "-shared" : "-pthread", shared ? NULL : "-ldl", NULL
+  };
+
+  pid_t pid;
+  int status;
+  if (posix_spawnp(&pid, cc, NULL, NULL, (char* const*)argv, environ) != 0)
+    return lval_err("Could not run %s", cc);
+  if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    return lval_err("%s failed to build %s", cc, out);
+
+  return lval_sexpr();
+#else
+  (void)src;
+  (void)out;
+  (void)shared;
+  return lval_err("Compilation is not supported on this platform");
+#endif
+}
+
+/* Translate files to C and build it with system compiler */
+lval* aot_compile(const char* const* files, int count, const char* out)
+{
+  laot_gen g;
+  memset(&g, 0, sizeof(g));
+  strbuf_init(&g.out);
+  strbuf_init(&g.code);
+
+  int source = aot_suffix(out, ".c");
+  int shared = aot_suffix(out, ".so");
+
+  lval* x = aot_generate(&g, files, count, !source && !shared);
+
+  if (x->type != LVAL_ERROR && source)
+  {
+    lval_del(x);
+    x = aot_write(out, &g.out);
+  }
+  else if (x->type != LVAL_ERROR)
+  {
+#ifndef _WIN32
+    char tmp[] = "/tmp/lisp-aot-XXXXXX";
+    int fd = mkstemp(tmp);
+    lval_del(x);
+
+    if (fd < 0)
+      x = lval_err("Could not create temporary file");
+    else
+    {
+      close(fd);
+      x = aot_write(tmp, &g.out);
+      if (x->type != LVAL_ERROR)
+      {
+        lval_del(x);
+        x = aot_build(tmp, out, shared);
+      }
+      unlink(tmp);
+    }
+#else
+    lval_del(x);
+    x = aot_build(NULL, out, shared);
+#endif
+  }
+
+  aot_tree_free(&g.tree);
+  free(g.index);
+  free(g.locals);
+  free(g.uses);
+  strbuf_free(&g.out);
+  strbuf_free(&g.code);
+  return x;
+}
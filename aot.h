@@ -0,0 +1,135 @@
+#ifndef __AOT_H__
+#define __AOT_H__
+/*
+ * Ahead-of-time compiler
+ *
+ * Program is translated to C module, bodies of lambdas defined
+ * at top level become C functions. Module keeps text of the
+ * program and evaluates it form by form, like 'load' does, then
+ * attaches compiled bodies to lambdas definitions have made.
+ * Everything compiled code can't do is left to interpreter, so
+ * results are the same either way.
+ *
+ * Module reaches runtime only through table of functions it
+ * gets on loading, so it can be built as shared object and
+ * loaded into any program that has interpreter inside.
+ *
+ * This header is included by generated code too.
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "common.h"
+#include "lenv.h"
+#include "lval.h"
+
+/* Bumped when table or module layout changes */
+#define AOT_VERSION 1
+
+/* Built-ins compiled code calls directly, in table order */
+typedef enum
+{
+  AOT_ADD,
+  AOT_SUB,
+  AOT_MUL,
+  AOT_DIV,
+  AOT_LT,
+  AOT_GT,
+  AOT_LE,
+  AOT_GE,
+  AOT_EQ,
+  AOT_NE,
+  AOT_IF,
+  AOT_DO,
+  AOT_HEAD,
+  AOT_TAIL,
+  AOT_LIST,
+  AOT_JOIN,
+  AOT_EVAL,
+  AOT_LEN,
+  AOT_CONS,
+  AOT_INIT,
+  AOT_NOT,
+  AOT_NONE
+} laot_builtin;
+
+/* Runtime as seen by compiled code */
+typedef struct _laot_rt
+{
+  atomic_int* shadows; // Non-zero while built-ins are hidden
+  lval* (*num)(long x);
+  lval* (*qexpr)(void);
+  lval* (*copy)(lval* v);
+  void (*del)(lval* v);
+  lval* (*get)(lenv* e, lval* k);
+  lval* (*eval)(lenv* e, lval* v);
+  /* Evaluate copy of list as code */
+  lval* (*eval_list)(lenv* e, lval* v);
+  /* Position of parameter in environment, -1 if it isn't there */
+  int (*index)(lenv* e, int k, lval* sym);
+  /* Error of 'if' whose condition isn't number, takes it */
+  lval* (*test)(lval* c);
+  /* Call built-in with evaluated arguments, takes them */
+  lval* (*builtin)(lenv* e, laot_builtin b, lval** args, int count);
+  /* Call special form with rest of list unevaluated, takes head */
+  lval* (*special)(lenv* e, lval* f, lval* v);
+  /* Call evaluated head with evaluated arguments, takes them */
+  lval* (*call)(lenv* e, lval** cells, int count);
+} laot_rt;
+
+/* Source file of program */
+typedef struct
+{
+  const char* name;
+  const char* text;
+  size_t len;
+} laot_source;
+
+/* Parsed program, compiled code refers to its nodes */
+typedef struct
+{
+  lval** forms; // Top-level expressions of all files
+  int form_count;
+  lval** nodes; // Every value in preorder
+  int node_count;
+} laot_tree;
+
+/* Body of lambda made by top-level form */
+typedef struct
+{
+  int form;
+  lcompiled code;
+} laot_fn;
+
+/* What generated code exports as 'lisp_module' */
+typedef struct
+{
+  int version;
+  size_t lval_size; // Layouts module was built with
+  size_t lenv_size;
+  const laot_source* sources;
+  int source_count;
+  const laot_fn* fns;
+  int fn_count;
+  const laot_rt** rt; // Set on loading
+  laot_tree* tree; // Parsed on first loading
+} laot_module;
+
+#define AOT_SYMBOL "lisp_module"
+
+/* Translate files to C and build it with system compiler.
+   Output named *.so is shared object, *.c is just source,
+   anything else is executable. */
+lval* aot_compile(const char* const* files, int count, const char* out);
+
+/* Evaluate program of module, returns empty list or error */
+lval* aot_run(lenv* e, const laot_module* m);
+
+/* Load shared object made by compiler and run it */
+lval* aot_load(lenv* e, const char* name);
+
+/* Entry point of compiled executable */
+int aot_main(const laot_module* m);
+
+#endif // __AOT_H__
@@ -0,0 +1,92 @@
+/*
+ * Embedding API benchmark
+ *
+ * Evaluates small expression calling native function
+ * through liblisp: from source each time, pre-parsed,
+ * and as one batch.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../lisp.h"
+
+#define ROUNDS 100000
+
+static const char* expr = "(add (* 3 4) 5)";
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static lisp_value* add(lisp* l, lisp_value* const* args, size_t count, void* data)
+{
+  (void)l;
+  (void)data;
+
+  long sum = 0;
+  for (size_t i = 0; i < count; i++)
+    sum += lisp_to_number(args[i]);
+
+  return lisp_number(sum);
+}
+
+static void check(lisp_value* v)
+{
+  if (lisp_typeof(v) != LISP_NUMBER || lisp_to_number(v) != 17)
+  {
+    fprintf(stderr, "embed: unexpected result %s\n",
+      lisp_to_string(v) ? lisp_to_string(v) : "");
+    exit(1);
+  }
+  lisp_release(v);
+}
+
+int main(void)
+{
+  lisp* l = lisp_new();
+  lisp_register(l, "add", add, NULL);
+
+  size_t len = strlen(expr);
+  double start = now();
+  for (int i = 0; i < ROUNDS; i++)
+    check(lisp_eval(l, expr, len));
+  double source = now() - start;
+
+  lisp_form* f = lisp_parse(l, expr, len);
+  start = now();
+  for (int i = 0; i < ROUNDS; i++)
+    check(lisp_eval_form(l, f));
+  double parsed = now() - start;
+  lisp_form_free(f);
+
+  const char** srcs = (const char**)malloc(sizeof(char*) * ROUNDS);
+  lisp_value** results = (lisp_value**)malloc(sizeof(lisp_value*) * ROUNDS);
+  for (int i = 0; i < ROUNDS; i++)
+    srcs[i] = expr;
+
+  start = now();
+  size_t errors = lisp_eval_batch(l, srcs, ROUNDS, results);
+  double batch = now() - start;
+
+  if (errors)
+    return 1;
+  for (int i = 0; i < ROUNDS; i++)
+    check(results[i]);
+
+  printf("embed: %d evals, source %.0f ns, parsed %.0f ns, batch %.0f ns per eval\n",
+    ROUNDS, source * 1e9 / ROUNDS, parsed * 1e9 / ROUNDS, batch * 1e9 / ROUNDS);
+
+  free(srcs);
+  free(results);
+  lisp_free(l);
+
+  return 0;
+}
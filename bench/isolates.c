@@ -0,0 +1,75 @@
+/*
+ * Isolates scaling benchmark
+ *
+ * Computes fib in N isolates at once, ideally the
+ * time stays flat while N is within the core count.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include "../interp.h"
+#include "../lval.h"
+
+#define FIB_N 17
+#define MAX_ISOLATES 16
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+  linterp* interp = interp_new();
+
+  lval* x = interp_load(interp, "library.lsp");
+  if (x->type == LVAL_ERROR)
+  {
+    lval_println(x);
+    return 1;
+  }
+  lval_del(x);
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  double base = 0;
+
+  for (int n = 1; n <= MAX_ISOLATES && n <= 2 * cores; n *= 2)
+  {
+    /* map wait (list (spawn fib N) ...) */
+    char input[64 * MAX_ISOLATES];
+    int len = sprintf(input, "map wait (list");
+    for (int k = 0; k < n; k++)
+      len += sprintf(input + len, " (spawn fib %d)", FIB_N);
+    len += sprintf(input + len, ")");
+
+    double start = now();
+    x = interp_eval(interp, input, len);
+    double t = now() - start;
+
+    if (x->type != LVAL_QEXPR || x->count != n)
+    {
+      lval_println(x);
+      return 1;
+    }
+    lval_del(x);
+
+    if (n == 1)
+      base = t;
+
+    printf("isolates: %2d x fib %d in %.3f s, speedup %.2f (%ld cores)\n",
+      n, FIB_N, t, n * base / t, cores);
+  }
+
+  interp_del(interp);
+
+  return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * JIT benchmark
+ *
+ * Runs numeric kernels in interpreter with JIT on and off,
+ * results of both must be the same.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../interp.h"
+#include "../jit.h"
+#include "../lval.h"
+
+static const char* prelude =
+  "(def {fib} (\\ {n} {if (< n 2) {n} {+ (fib (- n 1)) (fib (- n 2))}}))"
+  "(def {poly} (\\ {x} {+ (* 3 x x) (* -2 x) (/ x 7) 1}))"
+  "(def {sum} (\\ {i acc} {if (== i 0) {acc} {sum (- i 1) (+ acc (poly i))}}))"
+  /* Parameter is read before operand to its right assigns it */
+  "(def {side} (\\ {n} {+ n (* 2 n) (do (= {n} 10) 0) n}))"
+  "(def {sides} (\\ {i acc} {if (== i 0) {acc} {sides (- i 1) (+ acc (side i))}}))";
+
+static const char* kernels[] = {
+  "(fib 22)",
+  "(sum 2000 0)",
+  "(sides 2000 0)",
+};
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long run(const char* expr, int jit, double* t)
+{
+  jit_enable(jit);
+  linterp* interp = interp_new();
+  lval* x = interp_eval_all(interp, prelude, strlen(prelude));
+  lval_del(x);
+
+  double start = now();
+  x = interp_eval_all(interp, expr, strlen(expr));
+  *t = now() - start;
+
+  if (x->type != LVAL_NUMBER)
+  {
+    lval_println(x);
+    exit(1);
+  }
+
+  long r = x->num;
+  lval_del(x);
+  interp_del(interp);
+  return r;
+}
+
+int main(void)
+{
+  for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+  {
+    double on, off;
+    long a = run(kernels[i], 1, &on);
+    long b = run(kernels[i], 0, &off);
+
+    if (a != b)
+    {
+      fprintf(stderr, "jit: %s gives %ld, interpreter %ld\n", kernels[i], a, b);
+      return 1;
+    }
+
+    printf("jit: %s jit %.3f s, interpreter %.3f s, %.2fx\n",
+      kernels[i], on, off, off / on);
+  }
+
+  return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Lazy sequence benchmark
+ *
+ * Folds over range both lazily and after realizing it
+ * into list, peak memory is taken after each run.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "../interp.h"
+#include "../lval.h"
+
+#define COUNT "2000000"
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long peak_kb(void)
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_maxrss;
+}
+
+static double run(linterp* interp, const char* expr)
+{
+  double start = now();
+  lval* x = interp_eval_all(interp, expr, strlen(expr));
+  double t = now() - start;
+
+  if (x->type != LVAL_NUMBER)
+  {
+    lval_println(x);
+    exit(1);
+  }
+  lval_del(x);
+
+  return t;
+}
+
+int main(void)
+{
+  linterp* interp = interp_new();
+
+  /* Lazy run goes first, peak only grows */
+  double lazy = run(interp, "(foldl + 0 (range 0 " COUNT "))");
+  long lazy_kb = peak_kb();
+  double list = run(interp, "(foldl + 0 (realize (range 0 " COUNT ")))");
+  long list_kb = peak_kb();
+
+  /* Folding lambda calls fresh copy every step */
+  double lambda = run(interp, "(foldl (\\ {a x} {+ a x}) 0 (range 0 " COUNT "))");
+
+  printf("lazy: %s elements, range %.3f s %ld KB, list %.3f s %ld KB, lambda %.3f s\n",
+    COUNT, lazy, lazy_kb, list, list_kb, lambda);
+
+  interp_del(interp);
+
+  return 0;
+}
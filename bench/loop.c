@@ -0,0 +1,63 @@
+/*
+ * Loop benchmark
+ *
+ * Sums numbers with native loop forms and with recursive
+ * function doing the same.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../interp.h"
+#include "../lval.h"
+
+#define COUNT "1000000"
+#define RECURSION "3000"
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double run(linterp* interp, const char* expr)
+{
+  double start = now();
+  lval* x = interp_eval_all(interp, expr, strlen(expr));
+  double t = now() - start;
+
+  if (x->type == LVAL_ERROR)
+  {
+    lval_println(x);
+    exit(1);
+  }
+  lval_del(x);
+
+  return t;
+}
+
+int main(void)
+{
+  linterp* interp = interp_new();
+
+  double loop = run(interp,
+    "(loop {i 0 acc 0} {< i " COUNT "} {i (+ i 1) acc (+ acc i)} {acc})");
+  double times = run(interp,
+    "(def {acc} 0) (dotimes {i " COUNT "} {def {acc} (+ acc i)})");
+
+  run(interp, "(def {count} (\\ {i acc} "
+    "{if (== i 0) {acc} {count (- i 1) (+ acc i)}}))");
+  double rec = run(interp, "(count " RECURSION " 0)");
+
+  printf("loop: %s iterations, loop %.3f s, dotimes %.3f s, "
+    "recursion %.3f s for %s\n", COUNT, loop, times, rec, RECURSION);
+
+  interp_del(interp);
+
+  return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * Parse throughput benchmark
+ *
+ * Generates several megabytes of Lisp source
+ * and measures how fast the reader consumes it.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../lval.h"
+#include "../parser.h"
+
+#define SOURCE_SIZE (16 << 20)
+#define ROUNDS 5
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Generate a mix of definitions, lists, numbers and strings */
+static size_t generate(char* buffer, size_t size)
+{
+  size_t len = 0;
+  int i = 0;
+
+  while (len + 256 < size)
+  {
+    len += sprintf(buffer + len,
+      "; definition %d\n"
+      "(fun {func-%d x y} {\n"
+      "  if (> x %d) {+ x y 3.25} {list \"string %d\" {1 2 %d} (* x -%d)}\n"
+      "})\n",
+      i, i, i, i, i, i);
+    i++;
+  }
+
+  return len;
+}
+
+int main(void)
+{
+  char* source = malloc(SOURCE_SIZE);
+  size_t len = generate(source, SOURCE_SIZE);
+
+  double best = 0;
+  int forms = 0;
+
+  for (int i = 0; i < ROUNDS; i++)
+  {
+    double start = now();
+    lval* x = parse(source, len);
+    double t = now() - start;
+
+    if (x->type == LVAL_ERROR)
+    {
+      lval_println(x);
+      return 1;
+    }
+
+    forms = x->count;
+    lval_del(x);
+
+    if (i == 0 || t < best)
+      best = t;
+  }
+
+  printf("parse: %.1f MB, %d forms, %.3f s, %.1f MB/s\n",
+    len / 1048576.0, forms, best, len / 1048576.0 / best);
+
+  free(source);
+
+  return 0;
+}
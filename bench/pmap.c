@@ -0,0 +1,72 @@
+/*
+ * Parallel map benchmark
+ *
+ * Maps CPU-heavy function over list with map
+ * from library and with pmap, compares time.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../interp.h"
+#include "../lval.h"
+#include "../pool.h"
+
+#define ITEMS 32
+#define FIB_N 13
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double run(linterp* interp, const char* func)
+{
+  char input[256];
+  int len = sprintf(input, "%s fib (take %d (cons %d (list", func, ITEMS, FIB_N);
+  for (int i = 0; i < ITEMS; i++)
+    len += sprintf(input + len, " %d", FIB_N);
+  len += sprintf(input + len, ")))");
+
+  double start = now();
+  lval* x = interp_eval(interp, input, len);
+  double t = now() - start;
+
+  if (x->type != LVAL_QEXPR || x->count != ITEMS)
+  {
+    lval_println(x);
+    exit(1);
+  }
+  lval_del(x);
+
+  return t;
+}
+
+int main(void)
+{
+  linterp* interp = interp_new();
+
+  lval* x = interp_load(interp, "library.lsp");
+  if (x->type == LVAL_ERROR)
+  {
+    lval_println(x);
+    return 1;
+  }
+  lval_del(x);
+
+  double seq = run(interp, "map");
+  double par = run(interp, "pmap");
+
+  printf("pmap: %d x fib %d, map %.3f s, pmap %.3f s, speedup %.2f (%d workers)\n",
+    ITEMS, FIB_N, seq, par, seq / par, pool_size());
+
+  interp_del(interp);
+
+  return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * Printing benchmark
+ *
+ * Prints list of million numbers and strings
+ * to /dev/null and renders it into string.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../lval.h"
+#include "../strbuf.h"
+
+#define ITEMS 1000000
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+  lval* x = lval_qexpr();
+  for (int i = 0; i < ITEMS; i++)
+    lval_add(x, i % 2 ? lval_num(i) : lval_str("item"));
+
+  FILE* out = fopen("/dev/null", "w");
+  if (out == NULL)
+    return 1;
+
+  double start = now();
+  lval_fprint(out, x);
+  double print = now() - start;
+  fclose(out);
+
+  lstrbuf b;
+  strbuf_init(&b);
+  start = now();
+  lval_write(&b, x);
+  double render = now() - start;
+
+  printf("print: %d items, %zu bytes, print %.3f s, render %.3f s\n",
+    ITEMS, b.len, print, render);
+
+  strbuf_free(&b);
+  lval_del(x);
+
+  return 0;
+}
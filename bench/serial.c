@@ -0,0 +1,133 @@
+/*
+ * Serialization benchmark
+ *
+ * Round-trips a large list through binary encoding
+ * and compares it with printing and parsing text.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include "../lenv.h"
+#include "../lval.h"
+#include "../parser.h"
+#include "../serial.h"
+
+#define ELEMENTS 200000
+#define ROUNDS 5
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Mix of numbers, floats, strings and nested lists */
+static lval* generate(void)
+{
+  lval* x = lval_qexpr();
+
+  for (int i = 0; i < ELEMENTS; i++)
+  {
+    lval* y = lval_qexpr();
+    lval_add(y, lval_num(i * 7919L - 1000000));
+    lval_add(y, lval_fnum(i / 3.0));
+    lval_add(y, lval_str("some text"));
+    lval_add(y, lval_sym("symbol"));
+    lval_add(x, y);
+  }
+
+  return x;
+}
+
+/* Binary round trip, stores encoded size */
+static lval* binary(lval* x, lenv* e, size_t* len)
+{
+  serial_buf b;
+  serial_buf_init(&b);
+  serial_put(&b, x);
+
+  serial_reader r = { b.data, b.data + b.len, e };
+  lval* y = serial_get(&r);
+
+  *len = b.len;
+  serial_buf_free(&b);
+
+  return y;
+}
+
+/* Text round trip through stdout redirected into temporary file */
+static lval* text(lval* x, size_t* size)
+{
+  FILE* tmp = tmpfile();
+  int saved = dup(STDOUT_FILENO);
+
+  fflush(stdout);
+  dup2(fileno(tmp), STDOUT_FILENO);
+  lval_print(x);
+  fflush(stdout);
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+
+  long len = ftell(tmp);
+  char* data = malloc(len);
+  rewind(tmp);
+  len = fread(data, 1, len, tmp);
+  fclose(tmp);
+
+  lval* y = parse(data, len);
+  free(data);
+
+  *size = len;
+  return y;
+}
+
+int main(void)
+{
+  lenv* e = lenv_new();
+  lenv_add_builtins(e);
+
+  lval* x = generate();
+
+  double best_binary = 0, best_text = 0;
+  size_t binary_len = 0, text_len = 0;
+
+  for (int i = 0; i < ROUNDS; i++)
+  {
+    double start = now();
+    lval* y = binary(x, e, &binary_len);
+    double t = now() - start;
+    if (i == 0 || t < best_binary)
+      best_binary = t;
+
+    if (y == NULL || !lval_eq(x, y))
+    {
+      fputs("Binary round trip failed\n", stderr);
+      return 1;
+    }
+    lval_del(y);
+
+    start = now();
+    y = text(x, &text_len);
+    t = now() - start;
+    if (i == 0 || t < best_text)
+      best_text = t;
+    lval_del(y);
+  }
+
+  printf("serial: binary %.1f MB in %.3f s, text %.1f MB in %.3f s, %.1fx faster\n",
+    binary_len / 1048576.0, best_binary, text_len / 1048576.0, best_text,
+    best_text / best_binary);
+
+  lval_del(x);
+  lenv_del(e);
+
+  return 0;
+}
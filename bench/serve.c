@@ -0,0 +1,229 @@
+/*
+ * Evaluation server benchmark
+ *
+ * Starts lisp --serve with library as prelude, then
+ * clients on separate threads send requests over their
+ * own connections. Reports latency percentiles and
+ * compares with starting fresh interpreter per script.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SOCKET_PATH "/tmp/lisp-bench.sock"
+#define SCRIPT_PATH "/tmp/lisp-bench.lsp"
+#define WORKERS "4"
+#define MAX_REQUESTS "1000"
+#define CLIENTS 4
+#define REQUESTS 2000
+#define COLD_RUNS 20
+
+static const char* expr = "(sum (map (\\ {x} {* x x}) {1 2 3 4 5 6 7 8}))";
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int connect_server(void)
+{
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, SOCKET_PATH);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+    return fd;
+
+  if (fd >= 0)
+    close(fd);
+  return -1;
+}
+
+static int io_all(int fd, char* data, size_t len, int out)
+{
+  while (len)
+  {
+    ssize_t n = out ? write(fd, data, len) : read(fd, data, len);
+    if (n <= 0)
+      return 0;
+    data += n;
+    len -= n;
+  }
+  return 1;
+}
+
+/* One request and response, 0 if connection was closed */
+static int roundtrip(int fd, const char* req, size_t len)
+{
+  if (!io_all(fd, (char*)req, len, 1))
+    return 0;
+
+  uint64_t size = 0;
+  unsigned char c;
+  for (int shift = 0; ; shift += 7)
+  {
+    if (!io_all(fd, (char*)&c, 1, 0))
+      return 0;
+    size |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      break;
+  }
+
+  char buf[256];
+  if (size > sizeof(buf) || !io_all(fd, buf, size, 0))
+    return 0;
+
+  if (buf[0] != 0 || size != 4 || memcmp(buf + 1, "204", 3))
+  {
+    fprintf(stderr, "serve: unexpected response %.*s\n", (int)size - 1, buf + 1);
+    exit(1);
+  }
+
+  return 1;
+}
+
+typedef struct
+{
+  char* req;
+  size_t len;
+  double* latencies;
+} client_arg;
+
+static void* client(void* p)
+{
+  client_arg* a = (client_arg*)p;
+  int fd = connect_server();
+
+  for (int i = 0; i < REQUESTS; )
+  {
+    double start = now();
+    if (fd >= 0 && roundtrip(fd, a->req, a->len))
+    {
+      a->latencies[i++] = now() - start;
+      continue;
+    }
+
+    /* Worker was recycled, reconnect */
+    if (fd >= 0)
+      close(fd);
+    fd = connect_server();
+  }
+
+  close(fd);
+  return NULL;
+}
+
+static int compare(const void* a, const void* b)
+{
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static pid_t spawn(char* const argv[])
+{
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    int null = open("/dev/null", O_RDWR);
+    dup2(null, 0);
+    dup2(null, 1);
+    execv(argv[0], argv);
+    _exit(127);
+  }
+  return pid;
+}
+
+int main(void)
+{
+  char* server_argv[] = { "./lisp", "--serve", SOCKET_PATH, "--workers", WORKERS,
+    "--max-requests", MAX_REQUESTS, "library.lsp", NULL };
+  pid_t server = spawn(server_argv);
+
+  /* Recycled worker may close connection under us */
+  signal(SIGPIPE, SIG_IGN);
+
+  /* Wait until prelude is loaded and socket is there */
+  int fd = -1;
+  for (int i = 0; i < 500 && fd < 0; i++)
+  {
+    fd = connect_server();
+    if (fd < 0)
+      nanosleep(&(struct timespec){ 0, 10000000 }, NULL);
+  }
+  if (fd < 0)
+  {
+    fprintf(stderr, "serve: server didn't start\n");
+    kill(server, SIGTERM);
+    return 1;
+  }
+  close(fd);
+
+  /* Request frame, payload is short enough for one-byte length */
+  size_t elen = strlen(expr);
+  char* req = (char*)malloc(elen + 2);
+  req[0] = (char)(elen + 1);
+  req[1] = 'p';
+  memcpy(req + 2, expr, elen);
+
+  double* latencies = (double*)malloc(sizeof(double) * CLIENTS * REQUESTS);
+  client_arg args[CLIENTS];
+  pthread_t threads[CLIENTS];
+
+  double start = now();
+  for (int i = 0; i < CLIENTS; i++)
+  {
+    args[i] = (client_arg){ req, elen + 2, latencies + i * REQUESTS };
+    pthread_create(&threads[i], NULL, client, &args[i]);
+  }
+  for (int i = 0; i < CLIENTS; i++)
+    pthread_join(threads[i], NULL);
+  double total = now() - start;
+
+  kill(server, SIGTERM);
+  waitpid(server, NULL, 0);
+
+  int count = CLIENTS * REQUESTS;
+  qsort(latencies, count, sizeof(double), compare);
+
+  /* Same work by fresh interpreter each time */
+  FILE* f = fopen(SCRIPT_PATH, "w");
+  fprintf(f, "%s\n", expr);
+  fclose(f);
+
+  char* cold_argv[] = { "./lisp", "library.lsp", SCRIPT_PATH, NULL };
+  start = now();
+  for (int i = 0; i < COLD_RUNS; i++)
+    waitpid(spawn(cold_argv), NULL, 0);
+  double cold = (now() - start) / COLD_RUNS;
+  unlink(SCRIPT_PATH);
+
+  printf("serve: %s workers, %d clients, %d requests, p50 %.1f us, p99 %.1f us, "
+    "%.0f req/s; fresh process %.2f ms per script\n",
+    WORKERS, CLIENTS, count,
+    latencies[count / 2] * 1e6, latencies[count * 99 / 100] * 1e6,
+    count / total, cold * 1e3);
+
+  free(latencies);
+  free(req);
+
+  return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * String benchmark
+ *
+ * Splits long comma-separated string into fields,
+ * measures their lengths and joins them back.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../interp.h"
+#include "../lenv.h"
+#include "../lval.h"
+
+#define FIELDS 200000
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double run(linterp* interp, const char* expr, lval_type_t type)
+{
+  double start = now();
+  lval* x = interp_eval_all(interp, expr, strlen(expr));
+  double t = now() - start;
+
+  if (x->type != type)
+  {
+    lval_println(x);
+    exit(1);
+  }
+  lval_del(x);
+
+  return t;
+}
+
+int main(void)
+{
+  linterp* interp = interp_new();
+
+  /* "field0,field1,..." */
+  size_t size = (size_t)FIELDS * 16;
+  char* s = (char*)malloc(size);
+  size_t len = 0;
+  for (int i = 0; i < FIELDS; i++)
+    len += sprintf(s + len, "%sfield%d", i ? "," : "", i);
+
+  lval* k = lval_sym("text");
+  lval* v = lval_str_n(s, len);
+  lenv_put(interp->env, k, v);
+  lval_del(k);
+  lval_del(v);
+  free(s);
+
+  double split = run(interp, "(def {fields} (split-str text \",\"))", LVAL_SEXPR);
+  double find = run(interp, "(str-find text \"field199999\")", LVAL_NUMBER);
+  double join = run(interp, "(str-len (join-str \",\" fields))", LVAL_NUMBER);
+
+  printf("strings: %d fields in %zu bytes, split %.3f s, find %.4f s, join %.3f s\n",
+    FIELDS, len, split, find, join);
+
+  interp_del(interp);
+
+  return 0;
+}
@@ -0,0 +1,498 @@
+/*
+ * Benchmark suite
+ *
+ * Runs micro-benchmarks of interpreter internals and macro-
+ * benchmarks of Lisp programs, each in its own process, and
+ * prints results as JSON array, one object per line:
+ *
+ *   {"name": ..., "kind": ..., "iterations": ..., "ns_per_op": ...,
+ *    "allocs_per_op": ..., "peak_rss_kb": ...}
+ *
+ * Allocations are counted by wrapping malloc, calloc and realloc
+ * at link time. With --compare, results are checked against
+ * earlier output and exit status is 1 if anything got slower
+ * than threshold allows.
+ *
+ * Usage: suite [--compare FILE] [--threshold PERCENT] [NAME...]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "../builtins.h"
+#include "../interp.h"
+#include "../lenv.h"
+#include "../lval.h"
+#include "../parser.h"
+
+#define MIN_TIME 0.2 // Seconds each benchmark runs at least
+#define MAX_BENCH 64
+
+/*
+ * Allocation counting
+ */
+
+static atomic_long allocs;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+  atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+  atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+  return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* p, size_t size)
+{
+  atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+  return __real_realloc(p, size);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Benchmarks
+ *
+ * Setup runs once in child process, run does n operations.
+ */
+
+typedef struct
+{
+  const char* name;
+  const char* kind;
+  void (*setup)(void);
+  void (*run)(long n);
+} lbench;
+
+static linterp* interp;
+static lval* data;
+static lval* form;
+static char* source;
+static size_t source_len;
+static char load_path[64];
+
+static void fail(lval* x)
+{
+  lval_println(x);
+  exit(1);
+}
+
+static lval* eval(const char* expr)
+{
+  lval* x = interp_eval_all(interp, expr, strlen(expr));
+  if (x->type == LVAL_ERROR)
+    fail(x);
+  return x;
+}
+
+static void setup_interp(void)
+{
+  interp = interp_new();
+
+  lval* x = interp_load(interp, "library.lsp");
+  if (x->type == LVAL_ERROR)
+    fail(x);
+  lval_del(x);
+}
+
+/* Parse expression evaluated by run_form */
+static void setup_form(const char* expr)
+{
+  setup_interp();
+
+  lval* x = parse(expr, strlen(expr));
+  if (x->type == LVAL_ERROR)
+    fail(x);
+  form = lval_take(x, 0);
+}
+
+static void run_form(long n)
+{
+  for (long i = 0; i < n; i++)
+  {
+    lval* x = lval_eval(interp->env, lval_copy(form));
+    if (x->type == LVAL_ERROR)
+      fail(x);
+    lval_del(x);
+  }
+}
+
+/* Mix of definitions, lists, numbers and strings */
+static void generate(size_t size)
+{
+  source = (char*)malloc(size);
+  source_len = 0;
+
+  for (int i = 0; source_len + 256 < size; i++)
+    source_len += sprintf(source + source_len,
+      "(fun {func-%d x y} {\n"
+      "  if (> x %d) {+ x y 3.25} {list \"string %d\" {1 2 %d} (* x -%d)}\n"
+      "})\n",
+      i, i, i, i, i);
+}
+
+/* Global defined last, so lookup scans whole environment */
+static void setup_lookup(void)
+{
+  setup_interp();
+  lval_del(eval("(def {bench-x} 1)"));
+  data = lval_sym("bench-x");
+}
+
+static void run_lookup(long n)
+{
+  for (long i = 0; i < n; i++)
+    lval_del(lenv_get(interp->env, data));
+}
+
+static void setup_copy(void)
+{
+  data = lval_qexpr();
+  for (int i = 0; i < 10000; i++)
+    lval_add(data, lval_num(i));
+}
+
+static void run_copy(long n)
+{
+  for (long i = 0; i < n; i++)
+    lval_del(lval_copy(data));
+}
+
+static void setup_arith(void)
+{
+  setup_interp();
+  data = lval_sexpr();
+  for (int i = 1; i <= 8; i++)
+    lval_add(data, lval_num(i));
+}
+
+static void run_arith(long n)
+{
+  for (long i = 0; i < n; i++)
+    lval_del(builtin_add(interp->env, lval_copy(data)));
+}
+
+static void setup_parse(void)
+{
+  generate(64 << 10);
+}
+
+static void run_parse(long n)
+{
+  for (long i = 0; i < n; i++)
+  {
+    lval* x = parse(source, source_len);
+    if (x->type == LVAL_ERROR)
+      fail(x);
+    lval_del(x);
+  }
+}
+
+static void setup_fib(void)
+{
+  setup_form("(fib 20)");
+}
+
+static void setup_map(void)
+{
+  setup_form("(map (\\ {x} {* x 2}) xs)");
+  lval_del(eval("(def {xs} (realize (range 0 2000)))"));
+}
+
+static void setup_filter(void)
+{
+  setup_form("(filter (\\ {x} {> x 1000}) xs)");
+  lval_del(eval("(def {xs} (realize (range 0 2000)))"));
+}
+
+static void setup_foldl(void)
+{
+  setup_form("(foldl + 0 xs)");
+  lval_del(eval("(def {xs} (realize (range 0 1000000)))"));
+}
+
+static void setup_lazy(void)
+{
+  setup_form("(foldl + 0 (lazy-map (\\ {x} {* x 2}) (range 0 1000000)))");
+}
+
+static void setup_case(void)
+{
+  setup_form("(day-name 6)");
+}
+
+static void setup_load(void)
+{
+  generate(512 << 10);
+
+  strcpy(load_path, "/tmp/lisp-bench-XXXXXX");
+  int fd = mkstemp(load_path);
+  if (fd < 0 || write(fd, source, source_len) != (ssize_t)source_len)
+  {
+    perror("bench file");
+    exit(1);
+  }
+  close(fd);
+
+  char expr[128];
+  sprintf(expr, "(load \"%s\")", load_path);
+  setup_form(expr);
+}
+
+static const lbench benches[] = {
+  { "env-lookup", "micro", setup_lookup, run_lookup },
+  { "copy-list-10k", "micro", setup_copy, run_copy },
+  { "builtin-op", "micro", setup_arith, run_arith },
+  { "parse-64k", "micro", setup_parse, run_parse },
+  { "fib-20", "macro", setup_fib, run_form },
+  { "map-2k", "macro", setup_map, run_form },
+  { "filter-2k", "macro", setup_filter, run_form },
+  { "foldl-1m", "macro", setup_foldl, run_form },
+  { "lazy-foldl-1m", "macro", setup_lazy, run_form },
+  { "case-dispatch", "macro", setup_case, run_form },
+  { "load-512k", "macro", setup_load, run_form },
+};
+
+#define BENCH_COUNT (sizeof(benches) / sizeof(benches[0]))
+
+/*
+ * Runner
+ */
+
+typedef struct
+{
+  char name[32];
+  double ns;
+  double allocs;
+} lresult;
+
+/* Run benchmark in child process, JSON object is written to fd */
+static void bench_child(const lbench* b, int fd)
+{
+  b->setup();
+
+  /* Grow iteration count until run is long enough */
+  long n = 1;
+  double t;
+  long count;
+  for (;;)
+  {
+    atomic_store(&allocs, 0);
+    double start = now();
+    b->run(n);
+    t = now() - start;
+    count = atomic_load(&allocs);
+
+    if (t >= MIN_TIME)
+      break;
+
+    long next = t > 0 ? (long)(n * MIN_TIME * 1.2 / t) : n * 100;
+    n = next > n * 100 ? n * 100 : next > n ? next : n + 1;
+  }
+
+  if (load_path[0])
+    unlink(load_path);
+
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+
+  char line[256];
+  int len = snprintf(line, sizeof(line),
+    "{\"name\": \"%s\", \"kind\": \"%s\", \"iterations\": %ld, "
+    "\"ns_per_op\": %.1f, \"allocs_per_op\": %.2f, \"peak_rss_kb\": %ld}",
+    b->name, b->kind, n, t * 1e9 / n, (double)count / n, ru.ru_maxrss);
+
+  if (write(fd, line, len) != len)
+    exit(1);
+}
+
+/* Run benchmark, 0 on success */
+static int bench_run(const lbench* b, char* line, size_t size)
+{
+  int fds[2];
+  if (pipe(fds) < 0)
+    return -1;
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0)
+    return -1;
+
+  if (pid == 0)
+  {
+    close(fds[0]);
+    bench_child(b, fds[1]);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  size_t len = 0;
+  ssize_t r;
+  while (len + 1 < size && (r = read(fds[0], line + len, size - len - 1)) > 0)
+    len += r;
+  line[len] = '\0';
+  close(fds[0]);
+
+  int status;
+  waitpid(pid, &status, 0);
+
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 && len > 0 ? 0 : -1;
+}
+
+static int parse_result(const char* line, lresult* r)
+{
+  const char* p = strstr(line, "\"name\": \"");
+  const char* ns = strstr(line, "\"ns_per_op\": ");
+  const char* al = strstr(line, "\"allocs_per_op\": ");
+  if (!p || !ns || !al)
+    return -1;
+
+  if (sscanf(p + 9, "%31[^\"]", r->name) != 1)
+    return -1;
+
+  return sscanf(ns + 13, "%lf", &r->ns) == 1 &&
+    sscanf(al + 17, "%lf", &r->allocs) == 1 ? 0 : -1;
+}
+
+/* Read results of earlier run, returns their count */
+static int load_results(const char* name, lresult* rs, int max)
+{
+  FILE* f = fopen(name, "r");
+  if (f == NULL)
+  {
+    perror(name);
+    return -1;
+  }
+
+  int count = 0;
+  char line[512];
+  while (count < max && fgets(line, sizeof(line), f))
+    if (parse_result(line, &rs[count]) == 0)
+      count++;
+
+  fclose(f);
+  return count;
+}
+
+/* Report changes, returns count of regressions */
+static int compare(lresult* old, int old_count, lresult* cur, int count,
+  double threshold)
+{
+  int regressions = 0;
+
+  for (int i = 0; i < count; i++)
+    for (int j = 0; j < old_count; j++)
+    {
+      if (strcmp(cur[i].name, old[j].name))
+        continue;
+
+      double change = (cur[i].ns / old[j].ns - 1) * 100;
+      int slow = change > threshold;
+      regressions += slow;
+
+      fprintf(stderr, "%-16s %12.1f -> %12.1f ns/op %+7.1f%%  "
+        "%9.2f -> %9.2f allocs/op%s\n", cur[i].name, old[j].ns, cur[i].ns,
+        change, old[j].allocs, cur[i].allocs, slow ? "  REGRESSION" : "");
+    }
+
+  return regressions;
+}
+
+static int selected(const char* name, int argc, char** argv)
+{
+  int any = 0;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--compare") || !strcmp(argv[i], "--threshold"))
+    {
+      i++;
+      continue;
+    }
+
+    any = 1;
+    if (strstr(name, argv[i]))
+      return 1;
+  }
+
+  return !any;
+}
+
+int main(int argc, char** argv)
+{
+  const char* baseline = NULL;
+  double threshold = 10;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--compare") && i + 1 < argc)
+      baseline = argv[++i];
+    else if (!strcmp(argv[i], "--threshold") && i + 1 < argc)
+      threshold = atof(argv[++i]);
+    else if (argv[i][0] == '-')
+    {
+      fprintf(stderr, "Usage: %s [--compare FILE] [--threshold PERCENT] [NAME...]\n",
+        argv[0]);
+      return 2;
+    }
+  }
+
+  lresult results[MAX_BENCH];
+  int count = 0;
+  int failed = 0;
+
+  printf("[\n");
+  for (size_t i = 0; i < BENCH_COUNT; i++)
+  {
+    if (!selected(benches[i].name, argc, argv))
+      continue;
+
+    char line[512];
+    if (bench_run(&benches[i], line, sizeof(line)) < 0 ||
+        parse_result(line, &results[count]) < 0)
+    {
+      fprintf(stderr, "%s: failed\n", benches[i].name);
+      failed = 1;
+      continue;
+    }
+
+    printf("%s  %s", count ? ",\n" : "", line);
+    fflush(stdout);
+    count++;
+  }
+  printf("\n]\n");
+
+  if (baseline)
+  {
+    lresult old[MAX_BENCH];
+    int old_count = load_results(baseline, old, MAX_BENCH);
+    if (old_count < 0)
+      return 2;
+
+    if (compare(old, old_count, results, count, threshold))
+      return 1;
+  }
+
+  return failed;
+}
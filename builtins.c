@@ -4,16 +4,50 @@
  * Built-in interpreter functions
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
 #include "lenv.h"
 #include "lval.h"
 #include "builtins.h"
 #include "lassert.h"
 #include "parser.h"
+#include "image.h"
+#include "serial.h"
+#include "heap.h"
+#include "seq.h"
+#include "stats.h"
+#include "timing.h"
+#include "trace.h"
+#include "interp.h"
+#include "isolate.h"
+#include "pool.h"
+#include "future.h"
+#include "evloop.h"
+#include "strbuf.h"
+#include "aot.h"
+#include "jit.h"
+
+/* Lists shorter than this are mapped sequentially by pmap */
+#define PMAP_MIN_ITEMS 8
+
+/* Chunks per pool worker, more chunks balance better */
+#define PMAP_CHUNKS_PER_WORKER 4
 
 lval* builtin_head(lenv* e, lval* a)
 {
@@ -250,13 +284,19 @@ lval* builtin_var(lenv* e, lval* x, const char* func)
   assert(putter != NULL);
 
   for (int i = 0; i < syms->count; i++)
+  {
+    /* Lambda is known by name it was first defined with */
+    lval* v = x->cell[i+1];
+    if (v->type == LVAL_FUN && !v->is_builtin && v->name == NULL)
+      v->name = lval_name(syms->cell[i]->sym);
 
-    if (putter(e, syms->cell[i], x->cell[i+1]))
+    if (putter(e, syms->cell[i], v))
     {
       lval_del(ret);
       ret = lval_err("Redefinition of '%s' is forbidden", syms->cell[i]->sym);
       break;
     }
+  }
 
   lval_del(x);
 
@@ -392,11 +432,12 @@ lval* builtin_if(lenv* e, lval* a)
 
 lval* builtin_and(lenv* e, lval* a)
 {
-  LASSERT_COUNT(a, "and", 2);
-  LASSERT_TYPE(a, "and", 0, LVAL_NUMBER);
-  LASSERT_TYPE(a, "and", 1, LVAL_NUMBER);
+  for (int i = 0; i < a->count; i++)
+    LASSERT_TYPE(a, "and", i, LVAL_NUMBER);
 
-  int r = a->cell[0]->num && a->cell[1]->num;
+  int r = 1;
+  for (int i = 0; r && i < a->count; i++)
+    r = a->cell[i]->num != 0;
 
   lval_del(a);
   return lval_num(r);
@@ -404,11 +445,12 @@ lval* builtin_and(lenv* e, lval* a)
 
 lval* builtin_or(lenv* e, lval* a)
 {
-  LASSERT_COUNT(a, "or", 2);
-  LASSERT_TYPE(a, "or", 0, LVAL_NUMBER);
-  LASSERT_TYPE(a, "or", 1, LVAL_NUMBER);
+  for (int i = 0; i < a->count; i++)
+    LASSERT_TYPE(a, "or", i, LVAL_NUMBER);
 
-  int r = a->cell[0]->num || a->cell[1]->num;
+  int r = 0;
+  for (int i = 0; !r && i < a->count; i++)
+    r = a->cell[i]->num != 0;
 
   lval_del(a);
   return lval_num(r);
@@ -437,84 +479,1892 @@ lval* builtin_not(lenv* e, lval* a)
   return lval_num(r);
 }
 
-/* Script loading */
-lval* builtin_load(lenv* e, lval* a)
+/* Perform several things in sequence */
+lval* builtin_do(lenv* e, lval* a)
 {
-  LASSERT_COUNT(a, "load", 1);
-  LASSERT_TYPE(a, "load", 0, LVAL_STR);
+  if (a->count == 0)
+  {
+    lval_del(a);
+    return lval_qexpr();
+  }
+
+  return lval_take(a, a->count-1);
+}
+
+/* Open new scope */
+lval* builtin_let(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "let", 1);
+  LASSERT_TYPE(a, "let", 0, LVAL_QEXPR);
+
+  return special_let(e, a);
+}
+
+/* Loops, condition and body are Q-expressions */
+lval* builtin_while(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "while", 2);
+  LASSERT_TYPE(a, "while", 0, LVAL_QEXPR);
+  LASSERT_TYPE(a, "while", 1, LVAL_QEXPR);
+
+  return special_while(e, a);
+}
+
+lval* builtin_dotimes(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "dotimes", 2);
+  LASSERT_TYPE(a, "dotimes", 1, LVAL_QEXPR);
+
+  return special_dotimes(e, a);
+}
+
+lval* builtin_loop(lenv* e, lval* a)
+{
+  if (a->count > 1)
+    LASSERT_TYPE(a, "loop", 1, LVAL_QEXPR);
+
+  return special_loop(e, a);
+}
+
+/*
+ * Special forms
+ *
+ * These get their arguments unevaluated and evaluate
+ * only what is needed. Q-expression branches of 'if'
+ * and 'let' are evaluated as bodies, so the usual
+ * (if c {a} {b}) style keeps working.
+ */
+
+lval* special_if(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "if", 3);
+
+  lval* c = lval_eval(e, lval_pop(a, 0));
+  if (c->type == LVAL_ERROR)
+  {
+    lval_del(a);
+    return c;
+  }
+
+  if (c->type != LVAL_NUMBER)
+  {
+    lval* err = lval_err("Function 'if' passed incorrect type for argument 0. "
+      "Got %s, Expected %s.", ltype_name(c->type), ltype_name(LVAL_NUMBER));
+    lval_del(c);
+    lval_del(a);
+    return err;
+  }
+
+  lval* x = lval_eval_body(e, lval_pop(a, c->num ? 0 : 1));
+
+  lval_del(c);
+  lval_del(a);
+  return x;
+}
+
+lval* special_let(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "let", 1);
+
+  lenv* scope = lenv_new();
+  scope->parent = e;
+
+  lval* x = lval_eval_body(scope, lval_take(a, 0));
+
+  lenv_del(scope);
+  return x;
+}
+
+lval* special_do(lenv* e, lval* a)
+{
+  lval* x = lval_qexpr();
+
+  while (a->count)
+  {
+    lval_del(x);
+    x = lval_eval(e, lval_pop(a, 0));
+    if (x->type == LVAL_ERROR)
+      break;
+  }
+
+  lval_del(a);
+  return x;
+}
+
+/* Short-circuit evaluation for 'and' and 'or' */
+lval* special_logic(lenv* e, lval* a, const char* op, int stop)
+{
+  int r = !stop;
+
+  for (int i = 0; i < a->count; i++)
+  {
+    a->cell[i] = lval_eval(e, a->cell[i]);
+
+    if (a->cell[i]->type == LVAL_ERROR)
+      return lval_take(a, i);
+
+    LASSERT_TYPE(a, op, i, LVAL_NUMBER);
+
+    if ((a->cell[i]->num != 0) == stop)
+    {
+      r = stop;
+      break;
+    }
+  }
+
+  lval_del(a);
+  return lval_num(r);
+}
+
+lval* special_and(lenv* e, lval* a)
+{
+  return special_logic(e, a, "and", 0);
+}
+
+lval* special_or(lenv* e, lval* a)
+{
+  return special_logic(e, a, "or", 1);
+}
+
+/*
+ * Loops
+ *
+ * Loop variables live in single frame that is reused by
+ * every iteration, their slots are overwritten in place
+ * instead of binding arguments of recursive call. Body,
+ * condition and steps are evaluated without taking them.
+ * Integer arithmetic on numbers and variables is done
+ * unboxed, its result is stored into number that is
+ * already there, so such loops allocate nothing.
+ */
+
+/* Built-ins computed unboxed, global ones can't be redefined */
+static const char* loop_ops[] = {
+  "+", "-", "*", "/", "<", ">", "<=", ">=", "==", "!="
+};
+
+/* Operations in order of loop_ops */
+typedef enum
+{
+  LOOP_ADD,
+  LOOP_SUB,
+  LOOP_MUL,
+  LOOP_DIV,
+  LOOP_LT,
+  LOOP_GT,
+  LOOP_LE,
+  LOOP_GE,
+  LOOP_EQ,
+  LOOP_NE,
+  LOOP_NONE
+} lloop_op;
+
+static int loop_num(lenv* e, lval* v, long* n);
+
+/* List that is arithmetic on integers, 0 if it has to be evaluated */
+static int loop_list_num(lenv* e, lval* v, long* n)
+{
+  if (v->count == 1)
+    return loop_num(e, v->cell[0], n);
+
+  if (v->count < 2 || v->cell[0]->type != LVAL_SYM
+    || atomic_load_explicit(&jit_shadows, memory_order_relaxed))
+    return 0;
+
+  lloop_op op = LOOP_ADD;
+  while (op < LOOP_NONE && strcmp(loop_ops[op], v->cell[0]->sym))
+    op++;
+  if (op == LOOP_NONE || (op >= LOOP_LT && v->count != 3))
+    return 0;
+
+  long x, y;
+  if (!loop_num(e, v->cell[1], &x))
+    return 0;
+
+  /* Unary minus negates, other operations of one operand keep it */
+  if (v->count == 2 && op == LOOP_SUB)
+    x = (long)(0UL - (unsigned long)x);
+
+  for (int i = 2; i < v->count; i++)
+  {
+    if (!loop_num(e, v->cell[i], &y))
+      return 0;
+
+    /* Wrap around like builtin_op, errors and traps are left to it */
+    switch (op)
+    {
+      case LOOP_ADD:
+        x = (long)((unsigned long)x + (unsigned long)y);
+        break;
+      case LOOP_SUB:
+        x = (long)((unsigned long)x - (unsigned long)y);
+        break;
+      case LOOP_MUL:
+        x = (long)((unsigned long)x * (unsigned long)y);
+        break;
+      case LOOP_DIV:
+        if (y == 0 || y == -1)
+          return 0;
+        x /= y;
+        break;
+      case LOOP_LT:
+        x = x < y;
+        break;
+      case LOOP_GT:
+        x = x > y;
+        break;
+      case LOOP_LE:
+        x = x <= y;
+        break;
+      case LOOP_GE:
+        x = x >= y;
+        break;
+      case LOOP_EQ:
+        x = x == y;
+        break;
+      default:
+        x = x != y;
+        break;
+    }
+  }
+
+  *n = x;
+  return 1;
+}
+
+/* Integer value computed without allocation, 0 if it isn't one */
+static int loop_num(lenv* e, lval* v, long* n)
+{
+  switch (v->type)
+  {
+    case LVAL_NUMBER:
+      *n = v->num;
+      return 1;
+    case LVAL_SYM:
+      return lenv_get_num(e, v, n);
+    case LVAL_SEXPR:
+      return loop_list_num(e, v, n);
+    default:
+      return 0;
+  }
+}
+
+/* Evaluate loop body, number left by previous iteration takes result */
+static lval* loop_body(lenv* e, lval* body, lval* x)
+{
+  long n;
+  int num = body->type == LVAL_QEXPR ? loop_list_num(e, body, &n) : loop_num(e, body, &n);
 
-  /* Parse File given by string name */
-  char* input = NULL;
-  tree* root = NULL;
-  FILE* f = fopen(a->cell[0]->str, "r");
-  if (f != NULL)
+  if (num && x->type == LVAL_NUMBER)
   {
-    fseek(f, 0, SEEK_END);
-    int size = ftell(f);
-    fseek(f, 0, SEEK_SET);
+    x->num = n;
+    return x;
+  }
 
-    input = (char*)malloc(size+1);
+  lval_del(x);
+  return num ? lval_num(n) : lval_eval_body_ref(e, body);
+}
 
-    fread(input, size, 1, f);
-    fclose(f);
+/* Evaluate loop condition, error is returned and 'ok' is left intact */
+static lval* loop_test(lenv* e, lval* test, const char* name, int* ok)
+{
+  long n;
+  if (test->type == LVAL_QEXPR ? loop_list_num(e, test, &n) : loop_num(e, test, &n))
+  {
+    *ok = n != 0;
+    return NULL;
+  }
 
-    input[size] = 0;
+  lval* c = lval_eval_body_ref(e, test);
+  if (c->type == LVAL_ERROR)
+    return c;
 
-    root = parse_and_free(input);
+  if (c->type != LVAL_NUMBER)
+  {
+    lval* err = lval_err("Function '%s' got condition of type %s, Expected %s.",
+      name, ltype_name(c->type), ltype_name(LVAL_NUMBER));
+    lval_del(c);
+    return err;
   }
 
-  // TODO: better error handling
+  *ok = c->num != 0;
+  lval_del(c);
+  return NULL;
+}
+
+/* Slot of loop variable, -1 if frame has no such */
+static int loop_slot(lenv* scope, const char* sym)
+{
+  for (int i = 0; i < scope->count; i++)
+    if (!strcmp(scope->syms[i], sym))
+      return i;
+
+  return -1;
+}
 
-  if (f != NULL)
+/* Store number into slot, reusing value that is there */
+static void loop_set_num(lenv* scope, int i, long n)
+{
+  lval* v = scope->vals[i];
+  if (v->type == LVAL_NUMBER)
   {
-    /* Read contents */
-    lval* expr = lval_read(root);
+    v->num = n;
+    return;
+  }
 
-    /* Free string pool used by parser */
-    parser_free_pool();
+  lval_del(v);
+  scope->vals[i] = lval_num(n);
+}
+
+/* Evaluate body while condition holds */
+lval* special_while(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "while", 2);
 
-    /* Evaluate each Expression */
-    while (expr->count)
+  lval* test = a->cell[0];
+  lval* body = a->cell[1];
+  lval* x = lval_qexpr();
+
+  for (;;)
+  {
+    int ok = 0;
+    lval* err = loop_test(e, test, "while", &ok);
+    if (err)
     {
-      lval* x = lval_eval(e, lval_pop(expr, 0));
-      /* If Evaluation leads to error print it */
-      if (x->type == LVAL_ERROR)
-        lval_println(x);
       lval_del(x);
+      x = err;
+      break;
     }
 
-    /* Delete expressions and arguments */
-    lval_del(expr);
-    lval_del(a);
+    if (!ok)
+      break;
 
-    /* Return empty list */
-    return lval_sexpr();
-  } else {
-    /* Create new error message using it */
-    lval* err = lval_err("Could not load Library %s", a->cell[0]->str);
+    x = loop_body(e, body, x);
+    if (x->type == LVAL_ERROR)
+      break;
+  }
+
+  lval_del(a);
+  return x;
+}
+
+/* Evaluate body with variable counting from 0 to n-1 */
+lval* special_dotimes(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "dotimes", 2);
+  LASSERT_TYPE(a, "dotimes", 0, LVAL_QEXPR);
 
+  lval* spec = a->cell[0];
+  LASSERT(a, spec->count == 2 && spec->cell[0]->type == LVAL_SYM,
+    "Function '%s' passed invalid counter. Expected {symbol count}.", "dotimes");
+
+  lval* n = lval_eval(e, lval_pop(spec, 1));
+  if (n->type == LVAL_ERROR)
+  {
     lval_del(a);
+    return n;
+  }
 
-    /* Cleanup and return error */
+  if (n->type != LVAL_NUMBER)
+  {
+    lval* err = lval_err("Function '%s' passed count of type %s, Expected %s.",
+      "dotimes", ltype_name(n->type), ltype_name(LVAL_NUMBER));
+    lval_del(n);
+    lval_del(a);
     return err;
   }
+
+  lenv* scope = lenv_new();
+  scope->parent = e;
+  lenv_put(scope, spec->cell[0], n);
+
+  lval* body = a->cell[1];
+  lval* x = lval_qexpr();
+
+  for (long i = 0; i < n->num; i++)
+  {
+    loop_set_num(scope, 0, i);
+
+    x = loop_body(scope, body, x);
+    if (x->type == LVAL_ERROR)
+      break;
+  }
+
+  lenv_del(scope);
+  lval_del(n);
+  lval_del(a);
+  return x;
 }
 
-/* Print */
-lval* builtin_print(lenv* e, lval* a)
+/* Bind variables, then step them while condition holds,
+   (loop {var init ...} {test} {var step ...} {result}) */
+lval* special_loop(lenv* e, lval* a)
 {
-  /* Print each argument followed by a space */
-  for (int i = 0; i < a->count; i++)
+  LASSERT(a, a->count == 3 || a->count == 4,
+    "Function '%s' passed wrong number of arguments. "
+    "Got %d, Expected 3 or 4.", "loop", a->count);
+  LASSERT_TYPE(a, "loop", 0, LVAL_QEXPR);
+  LASSERT_TYPE(a, "loop", 2, LVAL_QEXPR);
+
+  lval* vars = a->cell[0];
+  lval* steps = a->cell[2];
+  LASSERT(a, vars->count % 2 == 0 && steps->count % 2 == 0,
+    "Function '%s' passed odd number of elements in bindings.", "loop");
+  for (int i = 0; i < vars->count; i += 2)
+    LASSERT(a, vars->cell[i]->type == LVAL_SYM,
+      "Function '%s' cannot bind non-symbol. Got %s, Expected %s.",
+      "loop", ltype_name(vars->cell[i]->type), ltype_name(LVAL_SYM));
+
+  lenv* scope = lenv_new();
+  scope->parent = e;
+
+  /* Initial values see variables bound before them */
+  lval* x = NULL;
+  for (int i = 0; i < vars->count && x == NULL; i += 2)
+  {
+    lval* v = lval_eval(scope, lval_copy(vars->cell[i + 1]));
+    if (v->type == LVAL_ERROR)
+      x = v;
+    else
+    {
+      lenv_put(scope, vars->cell[i], v);
+      lval_del(v);
+    }
+  }
+
+  /* Map every step to its slot once */
+  int nsteps = steps->count / 2;
+  int* slots = (int*)malloc(sizeof(int) * (nsteps + 1));
+  lval** next = (lval**)malloc(sizeof(lval*) * (nsteps + 1));
+  long* nums = (long*)malloc(sizeof(long) * (nsteps + 1));
+  for (int i = 0; i < nsteps && x == NULL; i++)
+  {
+    lval* sym = steps->cell[i * 2];
+    slots[i] = sym->type == LVAL_SYM ? loop_slot(scope, sym->sym) : -1;
+    if (slots[i] < 0)
+      x = lval_err("Function '%s' can step only loop variables.", "loop");
+  }
+
+  while (x == NULL)
   {
-    lval_print(a->cell[i]);
-    fputc(' ', stdout);
+    int ok = 0;
+    x = loop_test(scope, a->cell[1], "loop", &ok);
+    if (x || !ok)
+      break;
+
+    /* Steps see old values, then all are stored at once,
+       integers are computed unboxed and stored in place */
+    int done = 0;
+    for (; done < nsteps; done++)
+    {
+      lval* step = steps->cell[done * 2 + 1];
+      if (loop_num(scope, step, &nums[done]))
+      {
+        next[done] = NULL;
+        continue;
+      }
+
+      next[done] = lval_eval_ref(scope, step);
+      if (next[done]->type == LVAL_ERROR)
+      {
+        x = next[done];
+        break;
+      }
+    }
+
+    if (x)
+    {
+      for (int i = 0; i < done; i++)
+        if (next[i])
+          lval_del(next[i]);
+      break;
+    }
+
+    for (int i = 0; i < nsteps; i++)
+      if (next[i] == NULL)
+        loop_set_num(scope, slots[i], nums[i]);
+      else
+      {
+        lval_del(scope->vals[slots[i]]);
+        scope->vals[slots[i]] = next[i];
+      }
   }
 
-  /* Print a newline and delete arguments */
-  fputc('\n', stdout);
+  if (x == NULL)
+    x = a->count == 4 ? lval_eval_body_ref(scope, a->cell[3]) : lval_qexpr();
+
+  free(nums);
+  free(next);
+  free(slots);
+  lenv_del(scope);
   lval_del(a);
+  return x;
+}
 
-  return lval_sexpr();
+#ifndef _WIN32
+
+/* Map whole file into memory */
+static char* load_map(const char* name, size_t* size)
+{
+  int fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  *size = st.st_size;
+
+  /* Empty file can't be mapped, but it's fine to load */
+  char* data = "";
+  if (*size > 0)
+  {
+    data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+      data = NULL;
+    else
+      posix_madvise(data, *size, POSIX_MADV_SEQUENTIAL);
+  }
+
+  close(fd);
+  return data;
+}
+
+static void load_unmap(char* data, size_t size)
+{
+  if (size > 0)
+    munmap(data, size);
+}
+
+#else
+
+/* No mmap, read whole file instead */
+static char* load_map(const char* name, size_t* size)
+{
+  FILE* f = fopen(name, "rb");
+  if (f == NULL)
+    return NULL;
+
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  char* data = (char*)malloc(len > 0 ? len : 1);
+  *size = fread(data, 1, len, f);
+  fclose(f);
+
+  return data;
+}
+
+static void load_unmap(char* data, size_t size)
+{
+  (void)size;
+  free(data);
+}
+
+#endif /* _WIN32 */
+
+/* Script loading */
+lval* builtin_load(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "load", 1);
+  LASSERT_TYPE(a, "load", 0, LVAL_STR);
+
+  /* Module built by 'lisp --compile' */
+  size_t n = a->cell[0]->len;
+  if (n > 3 && !memcmp(a->cell[0]->str + n - 3, ".so", 3))
+  {
+    lval* x = aot_load(e, lval_cstr(a->cell[0]));
+    lval_del(a);
+    return x;
+  }
+
+  size_t size = 0;
+  char* input = load_map(lval_cstr(a->cell[0]), &size);
+
+  if (input == NULL)
+  {
+    /* Create new error message using it */
+    lval* err = lval_err("Could not load Library %s", lval_cstr(a->cell[0]));
+
+    lval_del(a);
+
+    /* Cleanup and return error */
+    return err;
+  }
+
+  lval_del(a);
+
+  /* Read and evaluate expressions one by one */
+  lparser p;
+  parser_init(&p, input, size);
+
+  lval* expr;
+  lval* result = lval_sexpr();
+
+  while ((expr = parser_next(&p)))
+  {
+    /* Stop at parse error and report it */
+    if (expr->type == LVAL_ERROR)
+    {
+      lval_del(result);
+      result = expr;
+      break;
+    }
+
+    lval* x = lval_eval(e, expr);
+    /* If Evaluation leads to error print it */
+    if (x->type == LVAL_ERROR)
+      lval_println(x);
+    lval_del(x);
+  }
+
+  parser_free(&p);
+  load_unmap(input, size);
+
+  /* Return empty list or parse error */
+  return result;
+}
+
+/* Save global environment into image */
+lval* builtin_save_image(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "save-image", 1);
+  LASSERT_TYPE(a, "save-image", 0, LVAL_STR);
+
+  lval* x = image_save(e, lval_cstr(a->cell[0]));
+  lval_del(a);
+  return x;
+}
+
+/* Load definitions from image */
+lval* builtin_load_image(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "load-image", 1);
+  LASSERT_TYPE(a, "load-image", 0, LVAL_STR);
+
+  lval* x = image_load(e, lval_cstr(a->cell[0]));
+  lval_del(a);
+  return x;
+}
+
+/* Write value to file in binary form */
+lval* builtin_serialize(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "serialize", 2);
+  LASSERT_TYPE(a, "serialize", 0, LVAL_STR);
+
+  int fd = open(lval_cstr(a->cell[0]), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    lval* err = lval_err("Could not create %s", lval_cstr(a->cell[0]));
+    lval_del(a);
+    return err;
+  }
+
+  int failed = serial_write_fd(fd, a->cell[1]);
+  failed |= close(fd);
+
+  lval* x = failed ? lval_err("Could not write %s", lval_cstr(a->cell[0])) : lval_sexpr();
+  lval_del(a);
+  return x;
+}
+
+/* Read value written by serialize */
+lval* builtin_deserialize(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "deserialize", 1);
+  LASSERT_TYPE(a, "deserialize", 0, LVAL_STR);
+
+  int fd = open(lval_cstr(a->cell[0]), O_RDONLY);
+  if (fd < 0)
+  {
+    lval* err = lval_err("Could not open %s", lval_cstr(a->cell[0]));
+    lval_del(a);
+    return err;
+  }
+
+  lval* x = serial_read_fd(fd, e);
+  close(fd);
+
+  if (x == NULL)
+    x = lval_err("Malformed serialized data in %s", lval_cstr(a->cell[0]));
+
+  lval_del(a);
+  return x;
+}
+
+/* Run function in new isolate */
+lval* builtin_spawn(lenv* e, lval* a)
+{
+  LASSERT(a, a->count >= 1,
+    "Function '%s' passed no arguments.", "spawn");
+  LASSERT_TYPE(a, "spawn", 0, LVAL_FUN);
+
+  linterp* i = lenv_interp(e);
+  LASSERT(a, i != NULL, "Function '%s' called outside of interpreter.", "spawn");
+
+  lval* f = lval_pop(a, 0);
+  lisolate* s = isolate_spawn(i, f, a);
+  if (s == NULL)
+    return lval_err("Could not start isolate");
+
+  return lval_isolate(s);
+}
+
+/* Move value to isolate */
+lval* builtin_send(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "send", 2);
+  LASSERT_TYPE(a, "send", 0, LVAL_ISOLATE);
+
+  isolate_send(a->cell[0]->isolate, lval_pop(a, 1));
+
+  lval_del(a);
+  return lval_sexpr();
+}
+
+/* Wait for message, called as (receive ()) */
+lval* builtin_receive(lenv* e, lval* a)
+{
+  linterp* i = lenv_interp(e);
+  LASSERT(a, i != NULL, "Function '%s' called outside of interpreter.", "receive");
+
+  lval_del(a);
+  return isolate_receive(i->self);
+}
+
+/* Handle of current isolate, called as (self ()) */
+lval* builtin_self(lenv* e, lval* a)
+{
+  linterp* i = lenv_interp(e);
+  LASSERT(a, i != NULL, "Function '%s' called outside of interpreter.", "self");
+
+  lval_del(a);
+  return lval_isolate(isolate_ref(i->self));
+}
+
+/* Wait for isolate to finish and get its result */
+lval* builtin_wait(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "wait", 1);
+  LASSERT_TYPE(a, "wait", 0, LVAL_ISOLATE);
+
+  lval* x = isolate_join(a->cell[0]->isolate);
+  lval_del(a);
+  return x;
+}
+
+/* Part of list mapped by single task */
+typedef struct
+{
+  lenv* e;
+  lval* f;
+  lval** items;
+  lval** results;
+  int count;
+  atomic_int* pending;
+} pmap_chunk;
+
+static void pmap_run(void* arg)
+{
+  pmap_chunk* c = (pmap_chunk*)arg;
+
+  for (int i = 0; i < c->count; i++)
+  {
+    lval* f = lval_copy(c->f);
+    c->results[i] = lval_call(c->e, f, lval_add(lval_sexpr(), c->items[i]));
+    lval_del(f);
+  }
+
+  if (c->pending && atomic_fetch_sub(c->pending, 1) == 1)
+    pool_notify();
+}
+
+/*
+ * Parallel map
+ *
+ * Function is called concurrently in the same environment,
+ * it may read and define globals, but shouldn't change
+ * local variables of the caller.
+ */
+lval* builtin_pmap(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "pmap", 2);
+  LASSERT_TYPE(a, "pmap", 0, LVAL_FUN);
+  LASSERT_TYPE(a, "pmap", 1, LVAL_QEXPR);
+
+  lval* f = a->cell[0];
+  lval* l = a->cell[1];
+  int n = l->count;
+
+  lval* x = lval_qexpr();
+  x->cell = (lval**)malloc(sizeof(lval*) * n);
+  x->count = n;
+
+  /* Items are moved into calls */
+  lval** items = l->cell;
+  l->cell = NULL;
+  l->count = 0;
+
+  int workers = pool_size();
+
+  if (n < PMAP_MIN_ITEMS || workers < 2)
+  {
+    pmap_chunk c = { e, f, items, x->cell, n, NULL };
+    pmap_run(&c);
+  } else {
+    int chunks = workers * PMAP_CHUNKS_PER_WORKER;
+    if (chunks > n)
+      chunks = n;
+
+    pmap_chunk* c = (pmap_chunk*)malloc(sizeof(pmap_chunk) * chunks);
+    atomic_int pending;
+    atomic_init(&pending, chunks);
+
+    linterp* i = lenv_interp(e);
+    if (i)
+      interp_share(i);
+
+    for (int i = 0, start = 0; i < chunks; i++)
+    {
+      int end = (int)((long)n * (i + 1) / chunks);
+      c[i] = (pmap_chunk){ e, f, items + start, x->cell + start, end - start, &pending };
+      pool_submit(pmap_run, &c[i]);
+      start = end;
+    }
+
+    pool_wait(&pending);
+    free(c);
+
+    if (i)
+      interp_unshare(i);
+  }
+
+  free(items);
+  lval_del(a);
+
+  /* Report first error if there was any */
+  for (int i = 0; i < n; i++)
+    if (x->cell[i]->type == LVAL_ERROR)
+    {
+      lval* err = lval_pop(x, i);
+      lval_del(x);
+      return err;
+    }
+
+  return x;
+}
+
+/* Evaluate Q-expression on thread pool */
+lval* builtin_future(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "future", 1);
+  LASSERT_TYPE(a, "future", 0, LVAL_QEXPR);
+
+  lfuture* f = future_new(e, lval_take(a, 0));
+  return lval_future(f);
+}
+
+/* Wait for future result */
+lval* builtin_force(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "force", 1);
+  LASSERT_TYPE(a, "force", 0, LVAL_FUTURE);
+
+  lval* x = future_force(a->cell[0]->future);
+  lval_del(a);
+  return x;
+}
+
+/* Check if future result is there */
+lval* builtin_ready(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "ready?", 1);
+  LASSERT_TYPE(a, "ready?", 0, LVAL_FUTURE);
+
+  int r = future_ready(a->cell[0]->future);
+  lval_del(a);
+  return lval_num(r);
+}
+
+/*
+ * Strings
+ *
+ * Length is stored with string, substrings share
+ * characters with strings they were taken from.
+ */
+
+/* Find needle starting from given position, -1 if it isn't there */
+static long str_find(lval* s, lval* needle, size_t from)
+{
+  const char* p = needle->str;
+  size_t m = needle->len;
+
+  if (m == 0)
+    return from <= s->len ? (long)from : -1;
+
+  const char* cur = s->str + from;
+  const char* end = s->str + s->len;
+
+  /* memchr skips to candidates, it's vectorized in libc */
+  while (cur < end && (size_t)(end - cur) >= m)
+  {
+    cur = memchr(cur, p[0], end - cur - m + 1);
+    if (cur == NULL)
+      return -1;
+
+    if (!memcmp(cur + 1, p + 1, m - 1))
+      return cur - s->str;
+
+    cur++;
+  }
+
+  return -1;
+}
+
+lval* builtin_str_len(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "str-len", 1);
+  LASSERT_TYPE(a, "str-len", 0, LVAL_STR);
+
+  long n = a->cell[0]->len;
+  lval_del(a);
+  return lval_num(n);
+}
+
+/* Substring from start to the end or of given length */
+lval* builtin_substr(lenv* e, lval* a)
+{
+  LASSERT(a, a->count == 2 || a->count == 3,
+    "Function '%s' passed wrong number of arguments. "
+    "Got %d, Expected 2 or 3.", "substr", a->count);
+  LASSERT_TYPE(a, "substr", 0, LVAL_STR);
+  LASSERT_TYPE(a, "substr", 1, LVAL_NUMBER);
+  if (a->count == 3)
+    LASSERT_TYPE(a, "substr", 2, LVAL_NUMBER);
+
+  lval* s = a->cell[0];
+  long start = a->cell[1]->num;
+  LASSERT(a, start >= 0 && (size_t)start <= s->len,
+    "Function '%s' passed start %ld out of string of length %zu.",
+    "substr", start, s->len);
+
+  long len = a->count == 3 ? a->cell[2]->num : (long)(s->len - start);
+  LASSERT(a, len >= 0 && (size_t)len <= s->len - start,
+    "Function '%s' passed length %ld out of string of length %zu.",
+    "substr", len, s->len);
+
+  lval* x = lval_str_slice(s, start, len);
+  lval_del(a);
+  return x;
+}
+
+/* Concatenate strings into single new one */
+lval* builtin_concat(lenv* e, lval* a)
+{
+  size_t total = 0;
+  for (int i = 0; i < a->count; i++)
+  {
+    LASSERT_TYPE(a, "concat", i, LVAL_STR);
+    total += a->cell[i]->len;
+  }
+
+  if (a->count == 1)
+    return lval_take(a, 0);
+
+  lstrdata* d = lval_strdata(total);
+  char* p = d->data;
+  for (int i = 0; i < a->count; i++)
+  {
+    memcpy(p, a->cell[i]->str, a->cell[i]->len);
+    p += a->cell[i]->len;
+  }
+
+  lval_del(a);
+  return lval_str_data(d);
+}
+
+/* Position of substring, -1 if it isn't there */
+lval* builtin_str_find(lenv* e, lval* a)
+{
+  LASSERT(a, a->count == 2 || a->count == 3,
+    "Function '%s' passed wrong number of arguments. "
+    "Got %d, Expected 2 or 3.", "str-find", a->count);
+  LASSERT_TYPE(a, "str-find", 0, LVAL_STR);
+  LASSERT_TYPE(a, "str-find", 1, LVAL_STR);
+  if (a->count == 3)
+    LASSERT_TYPE(a, "str-find", 2, LVAL_NUMBER);
+
+  long from = a->count == 3 ? a->cell[2]->num : 0;
+  LASSERT(a, from >= 0 && (size_t)from <= a->cell[0]->len,
+    "Function '%s' passed start %ld out of string of length %zu.",
+    "str-find", from, a->cell[0]->len);
+
+  long i = str_find(a->cell[0], a->cell[1], from);
+  lval_del(a);
+  return lval_num(i);
+}
+
+/* Split string by separator into list of substrings */
+lval* builtin_split_str(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "split-str", 2);
+  LASSERT_TYPE(a, "split-str", 0, LVAL_STR);
+  LASSERT_TYPE(a, "split-str", 1, LVAL_STR);
+  LASSERT(a, a->cell[1]->len > 0,
+    "Function '%s' passed empty separator.", "split-str");
+
+  lval* s = a->cell[0];
+  lval* sep = a->cell[1];
+  lval* x = lval_qexpr();
+
+  size_t from = 0;
+  long i;
+  while ((i = str_find(s, sep, from)) >= 0)
+  {
+    lval_add(x, lval_str_slice(s, from, i - from));
+    from = i + sep->len;
+  }
+  lval_add(x, lval_str_slice(s, from, s->len - from));
+
+  lval_del(a);
+  return x;
+}
+
+/* Join list of strings putting separator between them */
+lval* builtin_join_str(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "join-str", 2);
+  LASSERT_TYPE(a, "join-str", 0, LVAL_STR);
+  LASSERT_TYPE(a, "join-str", 1, LVAL_QEXPR);
+
+  lval* sep = a->cell[0];
+  lval* l = a->cell[1];
+
+  size_t total = 0;
+  for (int i = 0; i < l->count; i++)
+  {
+    LASSERT(a, l->cell[i]->type == LVAL_STR,
+      "Function '%s' passed list with %s at %d, Expected String.",
+      "join-str", ltype_name(l->cell[i]->type), i);
+    total += l->cell[i]->len;
+  }
+  if (l->count > 1)
+    total += sep->len * (l->count - 1);
+
+  lstrdata* d = lval_strdata(total);
+  char* p = d->data;
+  for (int i = 0; i < l->count; i++)
+  {
+    if (i > 0)
+    {
+      memcpy(p, sep->str, sep->len);
+      p += sep->len;
+    }
+    memcpy(p, l->cell[i]->str, l->cell[i]->len);
+    p += l->cell[i]->len;
+  }
+
+  lval_del(a);
+  return lval_str_data(d);
+}
+
+/*
+ * Lazy sequences
+ *
+ * Elements are produced one at a time while sequence is
+ * consumed, so ranges and pipelines over them run in
+ * constant memory. Lists are accepted wherever sequence is.
+ */
+
+/* Check that argument is list or sequence */
+#define LASSERT_SEQ(args, name, num) \
+  LASSERT(args, args->cell[num]->type == LVAL_QEXPR || \
+    args->cell[num]->type == LVAL_SEQ, \
+    "Function '%s' passed incorrect type for argument %d. " \
+    "Got %s, Expected %s or %s.", name, num, \
+    ltype_name(args->cell[num]->type), ltype_name(LVAL_QEXPR), \
+    ltype_name(LVAL_SEQ))
+
+/* Numbers from start up to end, exclusive */
+lval* builtin_range(lenv* e, lval* a)
+{
+  LASSERT(a, a->count == 2 || a->count == 3,
+    "Function '%s' passed wrong number of arguments. "
+    "Got %d, Expected 2 or 3.", "range", a->count);
+  for (int i = 0; i < a->count; i++)
+    LASSERT_TYPE(a, "range", i, LVAL_NUMBER);
+
+  long step = a->count == 3 ? a->cell[2]->num : 1;
+  LASSERT(a, step != 0, "Function '%s' passed zero step.", "range");
+
+  lseq* s = seq_range(a->cell[0]->num, a->cell[1]->num, step);
+  lval_del(a);
+  return lval_seq(s);
+}
+
+/* Infinite sequence of x, (f x), (f (f x)), ... */
+lval* builtin_iterate(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "iterate", 2);
+  LASSERT_TYPE(a, "iterate", 0, LVAL_FUN);
+
+  lval* f = lval_pop(a, 0);
+  lval* x = lval_take(a, 0);
+  return lval_seq(seq_iterate(f, x));
+}
+
+/* Sequence built from function and source */
+static lval* builtin_seq_apply(lval* a, const char* name,
+  lseq* (*make)(lval*, lseq*))
+{
+  LASSERT_COUNT(a, name, 2);
+  LASSERT_TYPE(a, name, 0, LVAL_FUN);
+  LASSERT_SEQ(a, name, 1);
+
+  lval* f = lval_pop(a, 0);
+  return lval_seq(make(f, seq_from(lval_take(a, 0))));
+}
+
+lval* builtin_lazy_map(lenv* e, lval* a)
+{
+  return builtin_seq_apply(a, "lazy-map", seq_map);
+}
+
+lval* builtin_lazy_filter(lenv* e, lval* a)
+{
+  return builtin_seq_apply(a, "lazy-filter", seq_filter);
+}
+
+lval* builtin_take_while(lenv* e, lval* a)
+{
+  return builtin_seq_apply(a, "take-while", seq_take_while);
+}
+
+/* Collect elements of sequence into list, at most n if given */
+lval* builtin_realize(lenv* e, lval* a)
+{
+  LASSERT(a, a->count == 1 || a->count == 2,
+    "Function '%s' passed wrong number of arguments. "
+    "Got %d, Expected 1 or 2.", "realize", a->count);
+  LASSERT_SEQ(a, "realize", 0);
+  if (a->count == 2)
+    LASSERT_TYPE(a, "realize", 1, LVAL_NUMBER);
+
+  long n = a->count == 2 ? a->cell[1]->num : -1;
+  if (a->cell[0]->type == LVAL_QEXPR && n < 0)
+    return lval_take(a, 0);
+
+  lseq_iter* it = seq_iter(seq_from(lval_pop(a, 0)));
+  lval_del(a);
+
+  /* Grow cells geometrically instead of one by one */
+  lval* x = lval_qexpr();
+  int size = 0;
+  lval* v;
+  while (n-- != 0 && (v = seq_next(e, it)))
+  {
+    if (v->type == LVAL_ERROR)
+    {
+      lval_del(x);
+      x = v;
+      break;
+    }
+
+    if (x->count == size)
+    {
+      size = size ? size * 2 : 16;
+      x->cell = (lval**)realloc(x->cell, sizeof(lval*) * size);
+    }
+    x->cell[x->count++] = v;
+  }
+
+  lseq* s = it->seq;
+  seq_iter_free(it);
+  seq_unref(s);
+  return x;
+}
+
+/* Fold list or sequence from the left, elements are taken one by one */
+lval* builtin_foldl(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "foldl", 3);
+  LASSERT_TYPE(a, "foldl", 0, LVAL_FUN);
+  LASSERT_SEQ(a, "foldl", 2);
+
+  lval* f = lval_pop(a, 0);
+  lval* z = lval_pop(a, 0);
+  lseq_iter* it = seq_iter(seq_from(lval_take(a, 0)));
+
+  lval* v;
+  while (z->type != LVAL_ERROR && (v = seq_next(e, it)))
+  {
+    if (v->type == LVAL_ERROR)
+    {
+      lval_del(z);
+      z = v;
+      break;
+    }
+
+    /* Application uses up formals of lambda */
+    lval* g = lval_copy(f);
+    lval* args = lval_add(lval_add(lval_sexpr(), z), v);
+    z = lval_call(e, g, args);
+    lval_del(g);
+  }
+
+  lseq* s = it->seq;
+  seq_iter_free(it);
+  seq_unref(s);
+  lval_del(f);
+  return z;
+}
+
+/*
+ * Event loop and non-blocking I/O
+ *
+ * Descriptors are plain numbers. Non-blocking calls return
+ * () when they would block.
+ */
+
+#define IO_READ 65536
+
+static lloop* io_loop(lenv* e)
+{
+  linterp* i = lenv_interp(e);
+  return i ? interp_loop(i) : NULL;
+}
+
+/* Make descriptor non-blocking and close it on exec */
+static int io_setup(int fd)
+{
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    return -1;
+
+  return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+static int io_unix_addr(struct sockaddr_un* addr, const char* path)
+{
+  if (strlen(path) >= sizeof(addr->sun_path))
+    return -1;
+
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  strcpy(addr->sun_path, path);
+  return 0;
+}
+
+/* Open file in mode "r", "w", "a" or "rw" */
+lval* builtin_open(lenv* e, lval* a)
+{
+  LASSERT(a, a->count == 1 || a->count == 2,
+    "Function '%s' passed wrong number of arguments. "
+    "Got %d, Expected 1 or 2.", "open", a->count);
+  LASSERT_TYPE(a, "open", 0, LVAL_STR);
+
+  const char* mode = "r";
+  if (a->count == 2)
+  {
+    LASSERT_TYPE(a, "open", 1, LVAL_STR);
+    mode = lval_cstr(a->cell[1]);
+  }
+
+  int flags;
+  if (!strcmp(mode, "r"))
+    flags = O_RDONLY;
+  else if (!strcmp(mode, "w"))
+    flags = O_WRONLY | O_CREAT | O_TRUNC;
+  else if (!strcmp(mode, "a"))
+    flags = O_WRONLY | O_CREAT | O_APPEND;
+  else if (!strcmp(mode, "rw"))
+    flags = O_RDWR | O_CREAT;
+  else
+    LASSERT(a, 0, "Function '%s' passed unknown mode '%s'.", "open", mode);
+
+  int fd = open(lval_cstr(a->cell[0]), flags | O_NONBLOCK | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    lval* err = lval_err("Could not open %s: %s", lval_cstr(a->cell[0]), strerror(errno));
+    lval_del(a);
+    return err;
+  }
+
+  lval_del(a);
+  return lval_num(fd);
+}
+
+/* Close descriptor, forgetting its callbacks */
+lval* builtin_close(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "close", 1);
+  LASSERT_TYPE(a, "close", 0, LVAL_NUMBER);
+
+  int fd = a->cell[0]->num;
+  linterp* i = lenv_interp(e);
+  if (i && i->loop)
+    loop_unwatch(i->loop, fd);
+
+  lval_del(a);
+  if (close(fd) < 0)
+    return lval_err("Could not close %d: %s", fd, strerror(errno));
+
+  return lval_sexpr();
+}
+
+/* Create pipe, returns {read write} */
+lval* builtin_pipe(lenv* e, lval* a)
+{
+  lval_del(a);
+
+  int fds[2];
+  if (pipe(fds) < 0)
+    return lval_err("Could not create pipe: %s", strerror(errno));
+
+  io_setup(fds[0]);
+  io_setup(fds[1]);
+
+  lval* x = lval_qexpr();
+  lval_add(x, lval_num(fds[0]));
+  lval_add(x, lval_num(fds[1]));
+  return x;
+}
+
+/* Listen on Unix domain socket */
+lval* builtin_listen_unix(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "listen-unix", 1);
+  LASSERT_TYPE(a, "listen-unix", 0, LVAL_STR);
+
+  struct sockaddr_un addr;
+  LASSERT(a, io_unix_addr(&addr, lval_cstr(a->cell[0])) == 0,
+    "Socket path %s is too long", lval_cstr(a->cell[0]));
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || io_setup(fd) < 0
+    || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0
+    || listen(fd, SOMAXCONN) < 0)
+  {
+    lval* err = lval_err("Could not listen on %s: %s", lval_cstr(a->cell[0]), strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    lval_del(a);
+    return err;
+  }
+
+  lval_del(a);
+  return lval_num(fd);
+}
+
+/* Connect to Unix domain socket */
+lval* builtin_connect_unix(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "connect-unix", 1);
+  LASSERT_TYPE(a, "connect-unix", 0, LVAL_STR);
+
+  struct sockaddr_un addr;
+  LASSERT(a, io_unix_addr(&addr, lval_cstr(a->cell[0])) == 0,
+    "Socket path %s is too long", lval_cstr(a->cell[0]));
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || io_setup(fd) < 0
+    || (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS))
+  {
+    lval* err = lval_err("Could not connect to %s: %s", lval_cstr(a->cell[0]), strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    lval_del(a);
+    return err;
+  }
+
+  lval_del(a);
+  return lval_num(fd);
+}
+
+/* Accept connection on listening socket */
+lval* builtin_accept(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "accept", 1);
+  LASSERT_TYPE(a, "accept", 0, LVAL_NUMBER);
+
+  int fd = accept(a->cell[0]->num, NULL, NULL);
+  lval_del(a);
+
+  if (fd < 0)
+  {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+      return lval_sexpr();
+    return lval_err("Could not accept connection: %s", strerror(errno));
+  }
+
+  io_setup(fd);
+  return lval_num(fd);
+}
+
+/* Read what is available, "" at end of file */
+lval* builtin_read(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "read", 1);
+  LASSERT_TYPE(a, "read", 0, LVAL_NUMBER);
+
+  char buf[IO_READ];
+  ssize_t n = read(a->cell[0]->num, buf, sizeof(buf));
+  lval_del(a);
+
+  if (n < 0)
+  {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+      return lval_sexpr();
+    return lval_err("Could not read: %s", strerror(errno));
+  }
+
+  return lval_str_n(buf, n);
+}
+
+/* Write what fits, returns number of bytes written */
+lval* builtin_write(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "write", 2);
+  LASSERT_TYPE(a, "write", 0, LVAL_NUMBER);
+  LASSERT_TYPE(a, "write", 1, LVAL_STR);
+
+  ssize_t n = write(a->cell[0]->num, a->cell[1]->str, a->cell[1]->len);
+  lval_del(a);
+
+  if (n < 0)
+  {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+      return lval_num(0);
+    return lval_err("Could not write: %s", strerror(errno));
+  }
+
+  return lval_num(n);
+}
+
+/* Read once descriptor is readable, pass data to function */
+lval* builtin_read_async(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "read-async", 2);
+  LASSERT_TYPE(a, "read-async", 0, LVAL_NUMBER);
+  LASSERT_TYPE(a, "read-async", 1, LVAL_FUN);
+
+  lloop* l = io_loop(e);
+  LASSERT(a, l != NULL, "Function '%s' has no event loop.", "read-async");
+
+  int err = loop_watch_read(l, a->cell[0]->num, lval_pop(a, 1), 1);
+  lval_del(a);
+
+  return err ? lval_err("Could not watch descriptor: %s", strerror(-err)) : lval_sexpr();
+}
+
+/* Write whole string in background, pass count to function */
+lval* builtin_write_async(lenv* e, lval* a)
+{
+  LASSERT(a, a->count == 2 || a->count == 3,
+    "Function '%s' passed wrong number of arguments. "
+    "Got %d, Expected 2 or 3.", "write-async", a->count);
+  LASSERT_TYPE(a, "write-async", 0, LVAL_NUMBER);
+  LASSERT_TYPE(a, "write-async", 1, LVAL_STR);
+  if (a->count == 3)
+    LASSERT_TYPE(a, "write-async", 2, LVAL_FUN);
+
+  lloop* l = io_loop(e);
+  LASSERT(a, l != NULL, "Function '%s' has no event loop.", "write-async");
+
+  lval* f = a->count == 3 ? lval_pop(a, 2) : NULL;
+  int err = loop_write(l, a->cell[0]->num, a->cell[1]->str, a->cell[1]->len, f);
+  lval_del(a);
+
+  return err ? lval_err("Could not watch descriptor: %s", strerror(-err)) : lval_sexpr();
+}
+
+/* Call function with descriptor whenever it's readable */
+lval* builtin_on_readable(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "on-readable", 2);
+  LASSERT_TYPE(a, "on-readable", 0, LVAL_NUMBER);
+  LASSERT_TYPE(a, "on-readable", 1, LVAL_FUN);
+
+  lloop* l = io_loop(e);
+  LASSERT(a, l != NULL, "Function '%s' has no event loop.", "on-readable");
+
+  int err = loop_watch_read(l, a->cell[0]->num, lval_pop(a, 1), 0);
+  lval_del(a);
+
+  return err ? lval_err("Could not watch descriptor: %s", strerror(-err)) : lval_sexpr();
+}
+
+/* Stop watching descriptor */
+lval* builtin_unwatch(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "unwatch", 1);
+  LASSERT_TYPE(a, "unwatch", 0, LVAL_NUMBER);
+
+  linterp* i = lenv_interp(e);
+  if (i && i->loop)
+    loop_unwatch(i->loop, a->cell[0]->num);
+
+  lval_del(a);
+  return lval_sexpr();
+}
+
+static lval* builtin_timer(lenv* e, lval* a, const char* name, int repeat)
+{
+  LASSERT_COUNT(a, name, 2);
+  LASSERT_TYPE(a, name, 0, LVAL_NUMBER);
+  LASSERT_TYPE(a, name, 1, LVAL_FUN);
+
+  lloop* l = io_loop(e);
+  LASSERT(a, l != NULL, "Function '%s' has no event loop.", name);
+
+  long ms = a->cell[0]->num;
+  LASSERT(a, !repeat || ms > 0,
+    "Function '%s' passed non-positive interval.", name);
+
+  int id = loop_timer(l, ms, repeat ? ms : 0, lval_pop(a, 1));
+  lval_del(a);
+  return lval_num(id);
+}
+
+/* Call function after given milliseconds, returns timer id */
+lval* builtin_after(lenv* e, lval* a)
+{
+  return builtin_timer(e, a, "after", 0);
+}
+
+/* Call function every given milliseconds, returns timer id */
+lval* builtin_every(lenv* e, lval* a)
+{
+  return builtin_timer(e, a, "every", 1);
+}
+
+lval* builtin_cancel_timer(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "cancel-timer", 1);
+  LASSERT_TYPE(a, "cancel-timer", 0, LVAL_NUMBER);
+
+  linterp* i = lenv_interp(e);
+  int found = i && i->loop && loop_cancel(i->loop, a->cell[0]->num);
+
+  lval_del(a);
+  return lval_num(found);
+}
+
+/* Run event loop until there is nothing to wait for */
+lval* builtin_run_loop(lenv* e, lval* a)
+{
+  lloop* l = io_loop(e);
+  LASSERT(a, l != NULL, "Function '%s' has no event loop.", "run-loop");
+  lval_del(a);
+  return loop_run(l, e);
+}
+
+/* Make running event loop return */
+lval* builtin_stop_loop(lenv* e, lval* a)
+{
+  linterp* i = lenv_interp(e);
+  if (i && i->loop)
+    loop_stop(i->loop);
+
+  lval_del(a);
+  return lval_sexpr();
+}
+
+/* Print */
+lval* builtin_print(lenv* e, lval* a)
+{
+  lstrbuf b;
+  strbuf_init(&b);
+
+  /* Render each argument followed by a space */
+  for (int i = 0; i < a->count; i++)
+  {
+    lval_write(&b, a->cell[i]);
+    strbuf_putc(&b, ' ');
+  }
+
+  /* Write whole line at once and delete arguments */
+  strbuf_putc(&b, '\n');
+  fwrite(b.data, 1, b.len, stdout);
+  strbuf_free(&b);
+  lval_del(a);
+
+  return lval_sexpr();
+}
+
+/* Render value as it would be printed, strings stay as they are */
+lval* builtin_to_string(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "to-string", 1);
+
+  if (a->cell[0]->type == LVAL_STR)
+    return lval_take(a, 0);
+
+  lstrbuf b;
+  strbuf_init(&b);
+  lval_write(&b, a->cell[0]);
+  lval_del(a);
+
+  lval* x = lval_str_n(b.data, b.len);
+  strbuf_free(&b);
+  return x;
+}
+
+/* Pair of counter name and value */
+static lval* stats_pair(const char* name, lval* v)
+{
+  return lval_add(lval_add(lval_qexpr(), lval_str(name)), v);
+}
+
+static lval* stats_by_type(const atomic_long* c)
+{
+  lval* x = lval_qexpr();
+  for (int t = 0; t < LVAL_TYPE_COUNT; t++)
+    if (t != LVAL_QEXPR)
+      lval_add(x, stats_pair(stats_type_name(t), lval_num(stats_type_count(c, t))));
+  return x;
+}
+
+/* Runtime counters of interpreter as list of {name value} pairs */
+lval* builtin_stats(lenv* e, lval* a)
+{
+  lstats s;
+  LASSERT(a, stats_read(&s), "Function '%s' unavailable, "
+    "counters were compiled out.", "stats");
+  lval_del(a);
+
+  lval* x = lval_qexpr();
+  lval_add(x, stats_pair("allocated", stats_by_type(s.allocs)));
+  lval_add(x, stats_pair("freed", stats_by_type(s.frees)));
+  lval_add(x, stats_pair("copies", lval_num(s.copies)));
+  lval_add(x, stats_pair("copy-bytes", lval_num(s.copy_bytes)));
+  lval_add(x, stats_pair("lookups", lval_num(s.lookups)));
+  lval_add(x, stats_pair("lookup-frames", lval_num(s.frames)));
+  lval_add(x, stats_pair("builtin-calls", lval_num(s.builtin_calls)));
+  lval_add(x, stats_pair("lambda-calls", lval_num(s.lambda_calls)));
+  lval_add(x, stats_pair("eval-depth-max", lval_num(s.depth_max)));
+  return x;
+}
+
+static lval* heap_entries(const lheap_entry* es, int count)
+{
+  lval* x = lval_qexpr();
+  for (int i = 0; i < count; i++)
+  {
+    if (es[i].name == NULL)
+      continue;
+
+    lval* y = lval_add(lval_qexpr(), lval_str(es[i].name));
+    lval_add(y, lval_num(es[i].count));
+    lval_add(y, lval_num(es[i].bytes));
+    lval_add(x, y);
+  }
+  return x;
+}
+
+/* Live objects as {{"types" {{name count bytes} ...}} {"sites" ...}} */
+lval* builtin_heap_stats(lenv* e, lval* a)
+{
+  lheap_stats s;
+  LASSERT(a, heap_read(&s), "Function '%s' unavailable, "
+    "heap tracking is off.", "heap-stats");
+  lval_del(a);
+
+  lval* x = lval_qexpr();
+  lval_add(x, stats_pair("types", heap_entries(s.types, HEAP_TYPES)));
+  lval_add(x, stats_pair("sites", heap_entries(s.sites, s.site_count)));
+  return x;
+}
+
+/*
+ * Timing
+ *
+ * Expressions are given as Q-expressions and evaluated in
+ * caller's environment. Hardware counters are reported only
+ * where kernel lets us open them.
+ */
+
+typedef struct
+{
+  long long ns;
+  long long hw[TIMING_COUNTERS];
+  long allocs;
+} lsample;
+
+static const char* timing_names[TIMING_COUNTERS] = {
+  "cycles", "instructions", "cache-misses"
+};
+
+/* Take sample, clock is read last at start and first at end */
+static void timing_sample(lcounters* c, lsample* s, int start)
+{
+  if (start)
+  {
+    s->allocs = stats_thread_allocs();
+    timing_read(c, s->hw);
+    s->ns = timing_now();
+  } else {
+    s->ns = timing_now();
+    timing_read(c, s->hw);
+    s->allocs = stats_thread_allocs();
+  }
+}
+
+/* Add counters that are available, averaged over n runs */
+static void timing_add_counters(lval* x, const long long* hw, long allocs, long n)
+{
+  for (int i = 0; i < TIMING_COUNTERS; i++)
+    if (hw[i] >= 0)
+      lval_add(x, stats_pair(timing_names[i], lval_num((hw[i] + n / 2) / n)));
+
+  if (allocs >= 0)
+    lval_add(x, stats_pair("allocs", lval_num((allocs + n / 2) / n)));
+}
+
+/* Evaluate expression once, returns result and what it took */
+lval* builtin_time(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "time", 1);
+  LASSERT_TYPE(a, "time", 0, LVAL_QEXPR);
+
+  lcounters c;
+  timing_open(&c);
+
+  lsample s0, s1;
+  timing_sample(&c, &s0, 1);
+  lval* r = lval_eval_body(e, lval_pop(a, 0));
+  timing_sample(&c, &s1, 0);
+
+  timing_close(&c);
+  lval_del(a);
+
+  if (r->type == LVAL_ERROR)
+    return r;
+
+  long long hw[TIMING_COUNTERS];
+  for (int i = 0; i < TIMING_COUNTERS; i++)
+    hw[i] = s0.hw[i] >= 0 ? s1.hw[i] - s0.hw[i] : -1;
+
+  lval* x = lval_qexpr();
+  lval_add(x, stats_pair("result", r));
+  lval_add(x, stats_pair("ns", lval_num(s1.ns - s0.ns)));
+  timing_add_counters(x, hw, s0.allocs >= 0 ? s1.allocs - s0.allocs : -1, 1);
+  return x;
+}
+
+static int timing_cmp(const void* a, const void* b)
+{
+  long long x = *(const long long*)a;
+  long long y = *(const long long*)b;
+  return (x > y) - (x < y);
+}
+
+/* Evaluate expression n times, returns distribution of times
+   and counters per run */
+lval* builtin_bench(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "bench", 2);
+  LASSERT_TYPE(a, "bench", 0, LVAL_NUMBER);
+  LASSERT_TYPE(a, "bench", 1, LVAL_QEXPR);
+
+  long n = a->cell[0]->num;
+  LASSERT(a, n > 0, "Function '%s' passed non-positive count %ld.", "bench", n);
+
+  long long* ns = (size_t)n <= SIZE_MAX / sizeof(long long)
+    ? (long long*)malloc(sizeof(long long) * n) : NULL;
+  LASSERT(a, ns != NULL, "Function '%s' cannot keep times of %ld runs.", "bench", n);
+
+  lval* body = a->cell[1];
+
+  lcounters c;
+  timing_open(&c);
+
+  long long hw[TIMING_COUNTERS] = { 0 };
+  long allocs = 0;
+  long long total = 0;
+  lval* err = NULL;
+
+  for (long i = 0; i < n && err == NULL; i++)
+  {
+    lsample s0, s1;
+    timing_sample(&c, &s0, 1);
+    lval* r = lval_eval_body(e, lval_copy(body));
+    timing_sample(&c, &s1, 0);
+
+    if (r->type == LVAL_ERROR)
+    {
+      err = r;
+      break;
+    }
+    lval_del(r);
+
+    ns[i] = s1.ns - s0.ns;
+    total += ns[i];
+    for (int k = 0; k < TIMING_COUNTERS; k++)
+      hw[k] = s0.hw[k] >= 0 && hw[k] >= 0 ? hw[k] + s1.hw[k] - s0.hw[k] : -1;
+    allocs = s0.allocs >= 0 ? allocs + s1.allocs - s0.allocs : -1;
+  }
+
+  timing_close(&c);
+  lval_del(a);
+
+  if (err)
+  {
+    free(ns);
+    return err;
+  }
+
+  qsort(ns, n, sizeof(long long), timing_cmp);
+
+  /* Nearest-rank percentiles */
+  lval* x = lval_qexpr();
+  lval_add(x, stats_pair("runs", lval_num(n)));
+  lval_add(x, stats_pair("min", lval_num(ns[0])));
+  lval_add(x, stats_pair("median", lval_num(ns[(n - 1) / 2])));
+  lval_add(x, stats_pair("p99", lval_num(ns[n - n / 100 - 1])));
+  lval_add(x, stats_pair("mean", lval_num(total / n)));
+  timing_add_counters(x, hw, allocs, n);
+
+  free(ns);
+  return x;
+}
+
+/*
+ * Tracing
+ */
+
+/* Turn call trace on or off, returns previous state */
+lval* builtin_trace(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "trace", 1);
+  LASSERT_TYPE(a, "trace", 0, LVAL_NUMBER);
+
+  int was = trace_set(a->cell[0]->num != 0);
+  lval_del(a);
+  return lval_num(was);
+}
+
+/* Write trace of all threads into file */
+lval* builtin_trace_dump(lenv* e, lval* a)
+{
+  LASSERT_COUNT(a, "trace-dump", 1);
+  LASSERT_TYPE(a, "trace-dump", 0, LVAL_STR);
+
+  lval* x = lval_sexpr();
+  if (trace_dump(lval_cstr(a->cell[0])) < 0)
+  {
+    lval_del(x);
+    x = lval_err("Could not write trace to %s: %s", lval_cstr(a->cell[0]), strerror(errno));
+  }
+
+  lval_del(a);
+  return x;
 }
 
 /* Error generation */
@@ -524,7 +2374,7 @@ lval* builtin_error(lenv* e, lval* a)
   LASSERT_TYPE(a, "error", 0, LVAL_STR);
 
   /* Construct Error from first argument */
-  lval* err = lval_err(a->cell[0]->str);
+  lval* err = lval_err("%s", lval_cstr(a->cell[0]));
 
   /* Delete arguments and return */
   lval_del(a);
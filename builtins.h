@@ -8,6 +8,13 @@
 
 typedef lval* (*lbuiltin)(lenv*, lval*);
 
+/* Built-in defined by embedding program, gets its own data */
+typedef lval* (*lnative)(lenv*, lval*, void*);
+
+/* Body of lambda compiled ahead of time, runs in environment
+   with parameters bound, NULL result means interpret it */
+typedef lval* (*lcompiled)(lenv*);
+
 lval* builtin_head(lenv* e, lval* a);
 lval* builtin_tail(lenv* e, lval* a);
 lval* builtin_list(lenv* e, lval* a);
@@ -37,8 +44,73 @@ lval* builtin_and(lenv* e, lval* a);
 lval* builtin_or(lenv* e, lval* a);
 lval* builtin_xor(lenv* e, lval* a);
 lval* builtin_not(lenv* e, lval* a);
+lval* builtin_do(lenv* e, lval* a);
+lval* builtin_let(lenv* e, lval* a);
+lval* builtin_while(lenv* e, lval* a);
+lval* builtin_dotimes(lenv* e, lval* a);
+lval* builtin_loop(lenv* e, lval* a);
 lval* builtin_load(lenv* e, lval* a);
+lval* builtin_save_image(lenv* e, lval* a);
+lval* builtin_load_image(lenv* e, lval* a);
+lval* builtin_serialize(lenv* e, lval* a);
+lval* builtin_deserialize(lenv* e, lval* a);
+lval* builtin_spawn(lenv* e, lval* a);
+lval* builtin_send(lenv* e, lval* a);
+lval* builtin_receive(lenv* e, lval* a);
+lval* builtin_self(lenv* e, lval* a);
+lval* builtin_wait(lenv* e, lval* a);
+lval* builtin_pmap(lenv* e, lval* a);
+lval* builtin_future(lenv* e, lval* a);
+lval* builtin_force(lenv* e, lval* a);
+lval* builtin_ready(lenv* e, lval* a);
+lval* builtin_str_len(lenv* e, lval* a);
+lval* builtin_substr(lenv* e, lval* a);
+lval* builtin_concat(lenv* e, lval* a);
+lval* builtin_str_find(lenv* e, lval* a);
+lval* builtin_split_str(lenv* e, lval* a);
+lval* builtin_join_str(lenv* e, lval* a);
+lval* builtin_range(lenv* e, lval* a);
+lval* builtin_iterate(lenv* e, lval* a);
+lval* builtin_lazy_map(lenv* e, lval* a);
+lval* builtin_lazy_filter(lenv* e, lval* a);
+lval* builtin_take_while(lenv* e, lval* a);
+lval* builtin_realize(lenv* e, lval* a);
+lval* builtin_foldl(lenv* e, lval* a);
+lval* builtin_open(lenv* e, lval* a);
+lval* builtin_close(lenv* e, lval* a);
+lval* builtin_pipe(lenv* e, lval* a);
+lval* builtin_listen_unix(lenv* e, lval* a);
+lval* builtin_connect_unix(lenv* e, lval* a);
+lval* builtin_accept(lenv* e, lval* a);
+lval* builtin_read(lenv* e, lval* a);
+lval* builtin_write(lenv* e, lval* a);
+lval* builtin_read_async(lenv* e, lval* a);
+lval* builtin_write_async(lenv* e, lval* a);
+lval* builtin_on_readable(lenv* e, lval* a);
+lval* builtin_unwatch(lenv* e, lval* a);
+lval* builtin_after(lenv* e, lval* a);
+lval* builtin_every(lenv* e, lval* a);
+lval* builtin_cancel_timer(lenv* e, lval* a);
+lval* builtin_run_loop(lenv* e, lval* a);
+lval* builtin_stop_loop(lenv* e, lval* a);
 lval* builtin_print(lenv* e, lval* a);
+lval* builtin_to_string(lenv* e, lval* a);
+lval* builtin_stats(lenv* e, lval* a);
+lval* builtin_heap_stats(lenv* e, lval* a);
+lval* builtin_time(lenv* e, lval* a);
+lval* builtin_bench(lenv* e, lval* a);
+lval* builtin_trace(lenv* e, lval* a);
+lval* builtin_trace_dump(lenv* e, lval* a);
 lval* builtin_error(lenv* e, lval* a);
 
+/* Special forms, arguments are passed unevaluated */
+lval* special_if(lenv* e, lval* a);
+lval* special_let(lenv* e, lval* a);
+lval* special_do(lenv* e, lval* a);
+lval* special_and(lenv* e, lval* a);
+lval* special_or(lenv* e, lval* a);
+lval* special_while(lenv* e, lval* a);
+lval* special_dotimes(lenv* e, lval* a);
+lval* special_loop(lenv* e, lval* a);
+
 #endif // __BUILTINS_H__
@@ -7,9 +7,19 @@
 /* Forward declarations */
 struct _lval;
 struct _lenv;
+struct _linterp;
+struct _lstrbuf;
 
 typedef struct _lval lval;
 typedef struct _lenv lenv;
+typedef struct _linterp linterp;
 
+/* Thread-locals of hot paths are kept in static TLS, otherwise
+   position-independent code calls resolver on every access */
+#if defined(__GNUC__)
+#define LTHREAD_FAST __attribute__((tls_model("initial-exec")))
+#else
+#define LTHREAD_FAST
+#endif
 
 #endif // __COMMON_H__
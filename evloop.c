@@ -0,0 +1,530 @@
+/*
+ * Event loop
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "evloop.h"
+#include "lval.h"
+
+#define LOOP_EVENTS 256
+#define LOOP_READ 65536
+
+static long long loop_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+lloop* loop_new(void)
+{
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0)
+    return NULL;
+
+  lloop* l = (lloop*)calloc(1, sizeof(lloop));
+  l->epfd = epfd;
+  l->next_timer = 1;
+
+  return l;
+}
+
+static void loop_free_writes(lwrite* q)
+{
+  while (q)
+  {
+    lwrite* next = q->next;
+    if (q->callback)
+      lval_del(q->callback);
+    free(q->data);
+    free(q);
+    q = next;
+  }
+}
+
+void loop_del(lloop* l)
+{
+  for (int fd = 0; fd < l->watch_size; fd++)
+  {
+    lwatch* w = l->watches[fd];
+    if (w == NULL)
+      continue;
+
+    if (w->on_read)
+      lval_del(w->on_read);
+    loop_free_writes(w->writes);
+    free(w);
+  }
+
+  for (int i = 0; i < l->timer_count; i++)
+    lval_del(l->timers[i].callback);
+
+  close(l->epfd);
+  free(l->watches);
+  free(l->timers);
+  free(l);
+}
+
+/* Find or create watch for descriptor */
+static lwatch* loop_watch(lloop* l, int fd)
+{
+  if (fd >= l->watch_size)
+  {
+    int size = l->watch_size ? l->watch_size : 64;
+    while (size <= fd)
+      size *= 2;
+
+    l->watches = (lwatch**)realloc(l->watches, sizeof(lwatch*) * size);
+    memset(l->watches + l->watch_size, 0,
+      sizeof(lwatch*) * (size - l->watch_size));
+    l->watch_size = size;
+  }
+
+  if (l->watches[fd] == NULL)
+  {
+    l->watches[fd] = (lwatch*)calloc(1, sizeof(lwatch));
+    l->watches[fd]->polled = 1;
+    l->active++;
+  }
+
+  return l->watches[fd];
+}
+
+static lwatch* loop_find(lloop* l, int fd)
+{
+  return fd < l->watch_size ? l->watches[fd] : NULL;
+}
+
+/* Sync epoll set with what watch is waiting for, drop idle watch */
+static int loop_update(lloop* l, int fd)
+{
+  lwatch* w = l->watches[fd];
+  unsigned events = (w->on_read ? EPOLLIN : 0) | (w->writes ? EPOLLOUT : 0);
+
+  if (events == 0)
+  {
+    if (w->registered)
+      epoll_ctl(l->epfd, EPOLL_CTL_DEL, fd, NULL);
+    if (!w->polled)
+      l->unpolled--;
+
+    free(w);
+    l->watches[fd] = NULL;
+    l->active--;
+    return 0;
+  }
+
+  if (!w->polled)
+    return 0;
+
+  struct epoll_event ev;
+  ev.events = events;
+  ev.data.fd = fd;
+
+  if (w->registered)
+    return epoll_ctl(l->epfd, EPOLL_CTL_MOD, fd, &ev) ? -errno : 0;
+
+  if (epoll_ctl(l->epfd, EPOLL_CTL_ADD, fd, &ev) == 0)
+  {
+    w->registered = 1;
+    return 0;
+  }
+
+  /* Regular files are always ready */
+  if (errno == EPERM)
+  {
+    w->polled = 0;
+    l->unpolled++;
+    return 0;
+  }
+
+  return -errno;
+}
+
+/* Call function with descriptor whenever it's readable,
+   or once with data read from it if 'once' is set */
+int loop_watch_read(lloop* l, int fd, lval* callback, int once)
+{
+  if (fd < 0)
+    return -EBADF;
+
+  lwatch* w = loop_watch(l, fd);
+  if (w->on_read)
+    lval_del(w->on_read);
+
+  w->on_read = callback;
+  w->read_once = once;
+
+  int err = loop_update(l, fd);
+  if (err)
+  {
+    lval_del(w->on_read);
+    w->on_read = NULL;
+    loop_update(l, fd);
+  }
+
+  return err;
+}
+
+/* Queue write, callback may be NULL */
+int loop_write(lloop* l, int fd, const char* data, size_t len, lval* callback)
+{
+  if (fd < 0)
+    return -EBADF;
+
+  lwrite* q = (lwrite*)malloc(sizeof(lwrite));
+  q->next = NULL;
+  q->data = (char*)malloc(len ? len : 1);
+  memcpy(q->data, data, len);
+  q->len = len;
+  q->pos = 0;
+  q->callback = callback;
+
+  lwatch* w = loop_watch(l, fd);
+  if (w->last)
+    w->last->next = q;
+  else
+    w->writes = q;
+  w->last = q;
+
+  int err = loop_update(l, fd);
+  if (err)
+  {
+    /* Nothing was written yet, so whole queue goes */
+    loop_free_writes(w->writes);
+    w->writes = w->last = NULL;
+    loop_update(l, fd);
+  }
+
+  return err;
+}
+
+/* Forget callbacks and pending writes of descriptor */
+void loop_unwatch(lloop* l, int fd)
+{
+  lwatch* w = fd >= 0 ? loop_find(l, fd) : NULL;
+  if (w == NULL)
+    return;
+
+  if (w->on_read)
+    lval_del(w->on_read);
+  w->on_read = NULL;
+
+  loop_free_writes(w->writes);
+  w->writes = w->last = NULL;
+
+  loop_update(l, fd);
+}
+
+/*
+ * Timers
+ */
+
+static void timer_swap(lloop* l, int i, int j)
+{
+  ltimer t = l->timers[i];
+  l->timers[i] = l->timers[j];
+  l->timers[j] = t;
+}
+
+static void timer_up(lloop* l, int i)
+{
+  while (i > 0 && l->timers[(i - 1) / 2].due > l->timers[i].due)
+  {
+    timer_swap(l, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void timer_down(lloop* l, int i)
+{
+  for (;;)
+  {
+    int min = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+
+    if (left < l->timer_count && l->timers[left].due < l->timers[min].due)
+      min = left;
+    if (right < l->timer_count && l->timers[right].due < l->timers[min].due)
+      min = right;
+    if (min == i)
+      return;
+
+    timer_swap(l, i, min);
+    i = min;
+  }
+}
+
+static void timer_push(lloop* l, ltimer t)
+{
+  if (l->timer_count == l->timer_size)
+  {
+    l->timer_size = l->timer_size ? l->timer_size * 2 : 16;
+    l->timers = (ltimer*)realloc(l->timers, sizeof(ltimer) * l->timer_size);
+  }
+
+  l->timers[l->timer_count] = t;
+  timer_up(l, l->timer_count++);
+}
+
+static ltimer timer_remove(lloop* l, int i)
+{
+  ltimer t = l->timers[i];
+
+  l->timers[i] = l->timers[--l->timer_count];
+  if (i < l->timer_count)
+  {
+    timer_up(l, i);
+    timer_down(l, i);
+  }
+
+  return t;
+}
+
+/* Call function after delay, repeatedly if interval is set */
+int loop_timer(lloop* l, long long delay, long long interval, lval* callback)
+{
+  ltimer t;
+  t.due = loop_now() + (delay > 0 ? delay : 0);
+  t.interval = interval;
+  t.id = l->next_timer++;
+  t.callback = callback;
+
+  timer_push(l, t);
+  return t.id;
+}
+
+/* Cancel timer, 0 if there was no such timer */
+int loop_cancel(lloop* l, int id)
+{
+  for (int i = 0; i < l->timer_count; i++)
+  {
+    if (l->timers[i].id == id)
+    {
+      lval_del(timer_remove(l, i).callback);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Dispatching
+ */
+
+/* Call callback, only errors are interesting */
+static lval* loop_call(lenv* e, lval* callback, lval* args)
+{
+  lval* f = lval_copy(callback);
+  lval* r = lval_call(e, f, args);
+  lval_del(f);
+
+  if (r->type == LVAL_ERROR)
+    return r;
+
+  lval_del(r);
+  return NULL;
+}
+
+static int loop_again(void)
+{
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+static lval* loop_readable(lloop* l, lenv* e, int fd)
+{
+  lwatch* w = loop_find(l, fd);
+  if (w == NULL || w->on_read == NULL)
+    return NULL;
+
+  if (!w->read_once)
+    return loop_call(e, w->on_read, lval_add(lval_sexpr(), lval_num(fd)));
+
+  char buf[LOOP_READ];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  if (n < 0 && loop_again())
+    return NULL;
+
+  /* Callback may want to read again */
+  lval* callback = w->on_read;
+  w->on_read = NULL;
+  loop_update(l, fd);
+
+  lval* arg = n < 0
+    ? lval_err("Could not read: %s", strerror(errno))
+    : lval_str_n(buf, n);
+
+  lval* r = loop_call(e, callback, lval_add(lval_sexpr(), arg));
+  lval_del(callback);
+  return r;
+}
+
+/* Write to descriptor, closed socket peer fails write
+   instead of raising SIGPIPE */
+static ssize_t loop_send(int fd, const char* data, size_t len)
+{
+  ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+  if (n < 0 && errno == ENOTSOCK)
+    n = write(fd, data, len);
+  return n;
+}
+
+static lval* loop_writable(lloop* l, lenv* e, int fd)
+{
+  lwatch* w = loop_find(l, fd);
+  if (w == NULL || w->writes == NULL)
+    return NULL;
+
+  lwrite* q = w->writes;
+  lval* arg;
+
+  ssize_t n = loop_send(fd, q->data + q->pos, q->len - q->pos);
+  if (n < 0)
+  {
+    if (loop_again())
+      return NULL;
+    arg = lval_err("Could not write: %s", strerror(errno));
+  }
+  else
+  {
+    q->pos += n;
+    if (q->pos < q->len)
+      return NULL;
+    arg = lval_num(q->len);
+  }
+
+  w->writes = q->next;
+  if (w->writes == NULL)
+    w->last = NULL;
+  loop_update(l, fd);
+
+  lval* r = NULL;
+  if (q->callback)
+  {
+    r = loop_call(e, q->callback, lval_add(lval_sexpr(), arg));
+    lval_del(q->callback);
+  }
+  else
+  {
+    lval_del(arg);
+  }
+
+  free(q->data);
+  free(q);
+  return r;
+}
+
+static lval* loop_dispatch(lloop* l, lenv* e, int fd, unsigned events)
+{
+  /* Hang-up and errors are reported by read and write */
+  if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+  {
+    lval* r = loop_readable(l, e, fd);
+    if (r)
+      return r;
+  }
+
+  if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+    return loop_writable(l, e, fd);
+
+  return NULL;
+}
+
+static lval* loop_timers(lloop* l, lenv* e)
+{
+  long long now = loop_now();
+
+  while (l->timer_count && l->timers[0].due <= now)
+  {
+    ltimer t = timer_remove(l, 0);
+    lval* r;
+
+    if (t.interval)
+    {
+      /* Reschedule first, so callback can cancel it */
+      t.due = now + t.interval;
+      timer_push(l, t);
+      r = loop_call(e, t.callback, lval_sexpr());
+    }
+    else
+    {
+      r = loop_call(e, t.callback, lval_sexpr());
+      lval_del(t.callback);
+    }
+
+    if (r)
+      return r;
+  }
+
+  return NULL;
+}
+
+/* Run until there is nothing to wait for, loop is stopped
+   or callback returns error */
+lval* loop_run(lloop* l, lenv* e)
+{
+  if (l->running)
+    return lval_err("Event loop is already running");
+
+  struct epoll_event events[LOOP_EVENTS];
+  lval* r = NULL;
+
+  l->running = 1;
+  l->stopped = 0;
+
+  while (!r && !l->stopped && (l->active || l->timer_count))
+  {
+    int timeout = -1;
+    if (l->unpolled)
+    {
+      timeout = 0;
+    }
+    else if (l->timer_count)
+    {
+      long long wait = l->timers[0].due - loop_now();
+      timeout = wait < 0 ? 0 : wait > INT_MAX ? INT_MAX : (int)wait;
+    }
+
+    int n = epoll_wait(l->epfd, events, LOOP_EVENTS, timeout);
+    if (n < 0 && errno != EINTR)
+    {
+      r = lval_err("Event loop failed: %s", strerror(errno));
+      break;
+    }
+
+    for (int i = 0; i < n && !r && !l->stopped; i++)
+      r = loop_dispatch(l, e, events[i].data.fd, events[i].events);
+
+    for (int fd = 0; l->unpolled && fd < l->watch_size && !r && !l->stopped; fd++)
+    {
+      lwatch* w = l->watches[fd];
+      if (w && !w->polled)
+        r = loop_dispatch(l, e, fd, EPOLLIN | EPOLLOUT);
+    }
+
+    if (!r && !l->stopped)
+      r = loop_timers(l, e);
+  }
+
+  l->running = 0;
+  return r ? r : lval_sexpr();
+}
+
+/* Make running loop return after current callback */
+void loop_stop(lloop* l)
+{
+  l->stopped = 1;
+}
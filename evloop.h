@@ -0,0 +1,88 @@
+#ifndef __EVLOOP_H__
+#define __EVLOOP_H__
+/*
+ * Event loop
+ *
+ * Single-threaded loop over epoll, one per interpreter. File
+ * descriptors are non-blocking, callbacks are Lisp functions
+ * called on the interpreter thread when descriptor becomes
+ * readable, pending write is done or timer fires. Regular
+ * files can't be polled, they are always treated as ready.
+ */
+
+#include <stddef.h>
+
+#include "common.h"
+
+/* Queued write, callback gets number of bytes written */
+typedef struct _lwrite
+{
+  struct _lwrite* next;
+  char* data;
+  size_t len;
+  size_t pos;
+  lval* callback;
+} lwrite;
+
+/* Everything loop does with one descriptor */
+typedef struct _lwatch
+{
+  lval* on_read; // Callback for readable descriptor
+  int read_once; // Read data for callback and forget it
+  lwrite* writes; // Queue of pending writes
+  lwrite* last;
+  int registered; // Descriptor is in epoll set
+  int polled; // Descriptor can be polled, regular files can't
+} lwatch;
+
+typedef struct _ltimer
+{
+  long long due; // Monotonic time in milliseconds
+  long long interval; // Repeat period, 0 for one-shot
+  int id;
+  lval* callback;
+} ltimer;
+
+typedef struct _lloop
+{
+  int epfd;
+  lwatch** watches; // Indexed by descriptor
+  int watch_size;
+  int active; // Count of watched descriptors
+  int unpolled; // Count of watched descriptors epoll refused
+  ltimer* timers; // Binary min-heap by due time
+  int timer_count;
+  int timer_size;
+  int next_timer;
+  int running;
+  int stopped;
+} lloop;
+
+lloop* loop_new(void);
+
+void loop_del(lloop* l);
+
+/* Call function with descriptor whenever it's readable,
+   or once with data read from it if 'once' is set */
+int loop_watch_read(lloop* l, int fd, lval* callback, int once);
+
+/* Queue write, callback may be NULL */
+int loop_write(lloop* l, int fd, const char* data, size_t len, lval* callback);
+
+/* Forget callbacks and pending writes of descriptor */
+void loop_unwatch(lloop* l, int fd);
+
+/* Call function after delay, repeatedly if interval is set */
+int loop_timer(lloop* l, long long delay, long long interval, lval* callback);
+
+/* Cancel timer, 0 if there was no such timer */
+int loop_cancel(lloop* l, int id);
+
+/* Run until there is nothing to wait for, loop is stopped
+   or callback returns error */
+lval* loop_run(lloop* l, lenv* e);
+
+/* Make running loop return after current callback */
+void loop_stop(lloop* l);
+
+#endif // __EVLOOP_H__
@@ -0,0 +1,106 @@
+/*
+ * Futures
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+
+#include "future.h"
+#include "interp.h"
+#include "lenv.h"
+#include "lval.h"
+#include "pool.h"
+
+/* Copy local environments, global one is shared */
+static lenv* future_capture(lenv* e)
+{
+  if (e->parent == NULL)
+    return e;
+
+  lenv* c = lenv_copy(e);
+  c->parent = future_capture(e->parent);
+  return c;
+}
+
+static void future_release(lenv* e)
+{
+  while (e->parent)
+  {
+    lenv* p = e->parent;
+    lenv_del(e);
+    e = p;
+  }
+}
+
+static void future_run(void* arg)
+{
+  lfuture* f = (lfuture*)arg;
+
+  f->result = lval_eval_body(f->env, f->expr);
+  f->expr = NULL;
+
+  future_release(f->env);
+  f->env = NULL;
+
+  linterp* i = f->interp;
+
+  atomic_store_explicit(&f->pending, 0, memory_order_release);
+  pool_notify();
+
+  future_unref(f);
+
+  if (i)
+    interp_unshare(i);
+}
+
+/* Schedule evaluation of expression in environment */
+lfuture* future_new(lenv* e, lval* expr)
+{
+  lfuture* f = (lfuture*)malloc(sizeof(lfuture));
+
+  /* One reference for caller, one for task */
+  atomic_init(&f->refs, 2);
+  atomic_init(&f->pending, 1);
+  f->interp = lenv_interp(e);
+  f->env = future_capture(e);
+  f->expr = expr;
+  f->result = NULL;
+
+  if (f->interp)
+    interp_share(f->interp);
+
+  pool_submit(future_run, f);
+
+  return f;
+}
+
+lfuture* future_ref(lfuture* f)
+{
+  atomic_fetch_add_explicit(&f->refs, 1, memory_order_relaxed);
+  return f;
+}
+
+void future_unref(lfuture* f)
+{
+  if (atomic_fetch_sub_explicit(&f->refs, 1, memory_order_acq_rel) != 1)
+    return;
+
+  if (f->result)
+    lval_del(f->result);
+
+  free(f);
+}
+
+/* Check if result is there */
+int future_ready(lfuture* f)
+{
+  return atomic_load_explicit(&f->pending, memory_order_acquire) == 0;
+}
+
+/* Wait for result, helping thread pool meanwhile */
+lval* future_force(lfuture* f)
+{
+  pool_wait(&f->pending);
+  return lval_copy(f->result);
+}
@@ -0,0 +1,39 @@
+#ifndef __FUTURE_H__
+#define __FUTURE_H__
+/*
+ * Futures
+ *
+ * Future evaluates expression on thread pool. It takes
+ * a snapshot of local environments, so the expression
+ * sees variables of the scope it was created in even
+ * after that scope is gone.
+ */
+
+#include <stdatomic.h>
+
+#include "common.h"
+
+typedef struct _lfuture
+{
+  atomic_int refs;
+  atomic_int pending; // 1 until result is there
+  linterp* interp;
+  lenv* env; // Snapshot of environment chain
+  lval* expr;
+  lval* result;
+} lfuture;
+
+/* Schedule evaluation of expression in environment */
+lfuture* future_new(lenv* e, lval* expr);
+
+lfuture* future_ref(lfuture* f);
+
+void future_unref(lfuture* f);
+
+/* Check if result is there */
+int future_ready(lfuture* f);
+
+/* Wait for result, helping thread pool meanwhile */
+lval* future_force(lfuture* f);
+
+#endif // __FUTURE_H__
@@ -0,0 +1,221 @@
+/*
+ * Heap tracking
+ *
+ * Live objects are kept in open-addressing table keyed by
+ * address, deleted slots are marked so probing goes past.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "heap.h"
+
+#ifndef LISP_NO_STATS
+
+#define HEAP_DELETED ((void*)1)
+
+typedef struct
+{
+  void* p; // NULL for free slot
+  uint32_t size;
+  uint8_t type;
+  uint8_t site;
+} lheap_obj;
+
+atomic_int heap_tracking;
+
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static lheap_obj* heap_objs;
+static size_t heap_size; // Power of two
+static size_t heap_used; // Live and deleted slots
+static size_t heap_count; // Live objects
+static lheap_stats heap_live;
+
+static size_t heap_slot(void* p, size_t size)
+{
+  uintptr_t h = (uintptr_t)p;
+  h ^= h >> 17;
+  h *= 0x9e3779b97f4a7c15ull;
+  return (h >> 20) & (size - 1);
+}
+
+/* Rebuild table dropping deleted slots, growing it if needed */
+static int heap_rehash(size_t size)
+{
+  lheap_obj* objs = (lheap_obj*)calloc(size, sizeof(lheap_obj));
+  if (objs == NULL)
+    return -1;
+
+  heap_used = 0;
+  for (size_t i = 0; i < heap_size; i++)
+  {
+    void* p = heap_objs[i].p;
+    if (p == NULL || p == HEAP_DELETED)
+      continue;
+
+    size_t k = heap_slot(p, size);
+    while (objs[k].p)
+      k = (k + 1) & (size - 1);
+    objs[k] = heap_objs[i];
+    heap_used++;
+  }
+
+  free(heap_objs);
+  heap_objs = objs;
+  heap_size = size;
+  return 0;
+}
+
+/* Index of site, sites are told apart by address of name */
+static int heap_site(const char* site)
+{
+  for (int i = 0; i < heap_live.site_count; i++)
+    if (heap_live.sites[i].name == site)
+      return i;
+
+  if (heap_live.site_count == HEAP_SITES)
+    return HEAP_SITES - 1;
+
+  heap_live.sites[heap_live.site_count].name = site;
+  return heap_live.site_count++;
+}
+
+void heap_alloc(void* p, int type, size_t size, const char* site)
+{
+  pthread_mutex_lock(&heap_lock);
+
+  /* Grow if table is mostly live, otherwise just drop deleted slots */
+  if (heap_used * 2 >= heap_size &&
+    heap_rehash(heap_count * 4 >= heap_size ? heap_size * 2 : heap_size) < 0)
+  {
+    pthread_mutex_unlock(&heap_lock);
+    return;
+  }
+
+  size_t k = heap_slot(p, heap_size);
+  while (heap_objs[k].p && heap_objs[k].p != HEAP_DELETED)
+    k = (k + 1) & (heap_size - 1);
+
+  if (heap_objs[k].p == NULL)
+    heap_used++;
+
+  int s = heap_site(site);
+  heap_objs[k].p = p;
+  heap_objs[k].size = size;
+  heap_objs[k].type = type;
+  heap_objs[k].site = s;
+  heap_count++;
+
+  heap_live.types[type].count++;
+  heap_live.types[type].bytes += size;
+  heap_live.sites[s].count++;
+  heap_live.sites[s].bytes += size;
+
+  pthread_mutex_unlock(&heap_lock);
+}
+
+void heap_free(void* p)
+{
+  pthread_mutex_lock(&heap_lock);
+
+  /* Objects made before tracking started aren't there */
+  size_t k = heap_slot(p, heap_size);
+  while (heap_objs[k].p && heap_objs[k].p != p)
+    k = (k + 1) & (heap_size - 1);
+
+  lheap_obj* o = &heap_objs[k];
+  if (o->p == p)
+  {
+    heap_live.types[o->type].count--;
+    heap_live.types[o->type].bytes -= o->size;
+    heap_live.sites[o->site].count--;
+    heap_live.sites[o->site].bytes -= o->size;
+    o->p = HEAP_DELETED;
+    heap_count--;
+  }
+
+  pthread_mutex_unlock(&heap_lock);
+}
+
+/* Start recording allocations, 0 on success */
+int heap_start(void)
+{
+  pthread_mutex_lock(&heap_lock);
+
+  int ok = heap_objs || heap_rehash(1 << 16) == 0;
+  for (int t = 0; t < HEAP_TYPES; t++)
+    heap_live.types[t].name = t == HEAP_ENV ? "Environment" : ltype_name(t);
+
+  pthread_mutex_unlock(&heap_lock);
+
+  if (!ok)
+    return -1;
+
+  atomic_store(&heap_tracking, 1);
+  return 0;
+}
+
+/* Snapshot of live objects, 0 if tracking is off */
+int heap_read(lheap_stats* out)
+{
+  if (!heap_on())
+    return 0;
+
+  pthread_mutex_lock(&heap_lock);
+  *out = heap_live;
+  pthread_mutex_unlock(&heap_lock);
+
+  return 1;
+}
+
+#else
+
+int heap_start(void)
+{
+  return -1;
+}
+
+int heap_read(lheap_stats* out)
+{
+  memset(out, 0, sizeof(*out));
+  return 0;
+}
+
+#endif // LISP_NO_STATS
+
+/* Print live objects by type and site, returns their count */
+long heap_report(FILE* out)
+{
+  lheap_stats s;
+  if (!heap_read(&s))
+    return 0;
+
+  long count = 0;
+  long bytes = 0;
+  for (int t = 0; t < HEAP_TYPES; t++)
+  {
+    count += s.types[t].count;
+    bytes += s.types[t].bytes;
+  }
+
+  fprintf(out, "Heap: %ld objects, %ld bytes still live\n", count, bytes);
+  if (count == 0)
+    return 0;
+
+  for (int t = 0; t < HEAP_TYPES; t++)
+    if (s.types[t].count)
+      fprintf(out, "  %-24s %10ld objects %12ld bytes\n",
+        s.types[t].name, s.types[t].count, s.types[t].bytes);
+
+  fprintf(out, "Allocated by:\n");
+  for (int i = 0; i < s.site_count; i++)
+    if (s.sites[i].count)
+      fprintf(out, "  %-24s %10ld objects %12ld bytes\n",
+        s.sites[i].name, s.sites[i].count, s.sites[i].bytes);
+
+  return count;
+}
@@ -0,0 +1,82 @@
+#ifndef __HEAP_H__
+#define __HEAP_H__
+/*
+ * Heap tracking
+ *
+ * When turned on, every value and environment is recorded
+ * with the constructor that made it, so live objects can be
+ * counted by type and by allocation site, and whatever is
+ * left after interpreter is destroyed is reported as leak.
+ * Objects are counted by type they were created with and
+ * by size of their structure, strings and cell arrays they
+ * own aren't included. Tracking is for diagnostics: every
+ * allocation takes global lock while it's on. Building with
+ * LISP_NO_STATS removes it together with counters.
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "lval.h"
+
+/* Pseudo-type of environments */
+#define HEAP_ENV LVAL_TYPE_COUNT
+
+/* Types and pseudo-types */
+#define HEAP_TYPES (HEAP_ENV + 1)
+
+/* Allocation sites tracked at most */
+#define HEAP_SITES 64
+
+typedef struct
+{
+  const char* name;
+  long count;
+  long bytes;
+} lheap_entry;
+
+/* Live objects by type and by site */
+typedef struct
+{
+  lheap_entry types[HEAP_TYPES];
+  lheap_entry sites[HEAP_SITES];
+  int site_count;
+} lheap_stats;
+
+#ifndef LISP_NO_STATS
+
+extern atomic_int heap_tracking;
+
+static inline int heap_on(void)
+{
+  return atomic_load_explicit(&heap_tracking, memory_order_relaxed);
+}
+
+void heap_alloc(void* p, int type, size_t size, const char* site);
+
+void heap_free(void* p);
+
+#define HEAP_ALLOC(p, type, size, site) \
+  do { if (heap_on()) heap_alloc((p), (type), (size), (site)); } while (0)
+#define HEAP_FREE(p) \
+  do { if (heap_on()) heap_free(p); } while (0)
+
+#else
+
+#define HEAP_ALLOC(p, type, size, site) ((void)0)
+#define HEAP_FREE(p) ((void)0)
+
+#endif // LISP_NO_STATS
+
+/* Start recording allocations, 0 on success */
+int heap_start(void);
+
+/* Snapshot of live objects, 0 if tracking is off */
+int heap_read(lheap_stats* out);
+
+/* Print live objects by type and site, returns their count */
+long heap_report(FILE* out);
+
+#endif // __HEAP_H__
@@ -0,0 +1,142 @@
+/*
+ * Environment images
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "image.h"
+#include "lenv.h"
+#include "lval.h"
+#include "serial.h"
+
+/* Image header */
+#define IMAGE_MAGIC "LSPI"
+#define IMAGE_VERSION 2
+
+/* Built-ins are registered at startup and aren't saved */
+static int image_skip(lenv* e, int i)
+{
+  lval* v = e->vals[i];
+  return v->type == LVAL_FUN && v->is_builtin && !strcmp(v->name, e->syms[i]);
+}
+
+/* Save global environment into image file */
+lval* image_save(lenv* e, const char* name)
+{
+  while (e->parent)
+    e = e->parent;
+
+  serial_buf b;
+  serial_buf_init(&b);
+
+  int count = 0;
+  for (int i = 0; i < e->count; i++)
+    count += !image_skip(e, i);
+
+  serial_put_str(&b, IMAGE_MAGIC, 4);
+  serial_put_varint(&b, IMAGE_VERSION);
+  serial_put_varint(&b, count);
+
+  for (int i = 0; i < e->count; i++)
+    if (!image_skip(e, i))
+    {
+      serial_put_str(&b, e->syms[i], strlen(e->syms[i]));
+      serial_put(&b, e->vals[i]);
+    }
+
+  FILE* f = fopen(name, "wb");
+  if (f == NULL)
+  {
+    serial_buf_free(&b);
+    return lval_err("Could not create image %s", name);
+  }
+
+  size_t written = fwrite(b.data, 1, b.len, f);
+  int failed = fclose(f) || written != b.len;
+
+  serial_buf_free(&b);
+
+  if (failed)
+    return lval_err("Could not write image %s", name);
+
+  return lval_sexpr();
+}
+
+/* Read name and value, put them into environment */
+static int image_read_def(serial_reader* r, lenv* e)
+{
+  const char* s;
+  size_t len;
+
+  if (!serial_get_str(r, &s, &len))
+    return 0;
+
+  lval* v = serial_get(r);
+  if (v == NULL)
+    return 0;
+
+  lval* k = lval_sym_n(s, len);
+  lenv_put(e, k, v);
+  lval_del(k);
+  lval_del(v);
+
+  return 1;
+}
+
+/* Load definitions from image file into global environment */
+lval* image_load(lenv* e, const char* name)
+{
+  while (e->parent)
+    e = e->parent;
+
+  int fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return lval_err("Could not load image %s", name);
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0)
+  {
+    close(fd);
+    return lval_err("Invalid image %s", name);
+  }
+
+  char* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED)
+    return lval_err("Could not load image %s", name);
+
+  /* Built-ins are fixed up by name against fresh environment */
+  serial_reader r = { data, data + st.st_size, e };
+  lval* result = NULL;
+
+  const char* magic;
+  size_t len;
+  uint64_t version, count;
+
+  if (!serial_get_str(&r, &magic, &len) || len != 4 || memcmp(magic, IMAGE_MAGIC, 4)
+    || !serial_get_varint(&r, &version) || !serial_get_varint(&r, &count))
+  {
+    result = lval_err("Invalid image %s", name);
+  } else if (version != IMAGE_VERSION) {
+    result = lval_err("Image %s has version %d, expected %d",
+      name, (int)version, IMAGE_VERSION);
+  } else {
+    for (uint64_t i = 0; i < count && result == NULL; i++)
+      if (!image_read_def(&r, e))
+        result = lval_err("Image %s is corrupted", name);
+  }
+
+  munmap(data, st.st_size);
+
+  return result ? result : lval_sexpr();
+}
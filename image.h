@@ -0,0 +1,19 @@
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+/*
+ * Environment images
+ *
+ * Image holds all global definitions in relocatable
+ * binary form: there are no pointers inside, built-in
+ * functions are referenced by name and resolved on load.
+ */
+
+#include "common.h"
+
+/* Save global environment into image file */
+lval* image_save(lenv* e, const char* name);
+
+/* Load definitions from image file into global environment */
+lval* image_load(lenv* e, const char* name);
+
+#endif // __IMAGE_H__
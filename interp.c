@@ -0,0 +1,111 @@
+/*
+ * Interpreter context
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+
+#include "builtins.h"
+#include "evloop.h"
+#include "image.h"
+#include "interp.h"
+#include "isolate.h"
+#include "lenv.h"
+#include "lval.h"
+#include "parser.h"
+#include "pool.h"
+
+/* Create interpreter with built-ins */
+linterp* interp_new(void)
+{
+  linterp* i = (linterp*)malloc(sizeof(linterp));
+
+  pthread_rwlock_init(&i->lock, NULL);
+  atomic_init(&i->shared, 0);
+
+  i->env = lenv_new();
+  i->env->interp = i;
+  i->self = isolate_new(i);
+  i->loop = NULL;
+  lenv_add_builtins(i->env);
+
+  return i;
+}
+
+/* Destroy interpreter */
+void interp_del(linterp* i)
+{
+  /* Let running futures finish */
+  pool_wait(&i->shared);
+
+  lenv_del(i->env);
+  isolate_unref(i->self);
+  if (i->loop)
+    loop_del(i->loop);
+  pthread_rwlock_destroy(&i->lock);
+  free(i);
+}
+
+/* Event loop of interpreter, NULL if it can't be created */
+lloop* interp_loop(linterp* i)
+{
+  if (i->loop == NULL)
+    i->loop = loop_new();
+
+  return i->loop;
+}
+
+/* Task is going to use interpreter from another thread */
+void interp_share(linterp* i)
+{
+  atomic_fetch_add_explicit(&i->shared, 1, memory_order_acq_rel);
+}
+
+/* Task on another thread is done with interpreter */
+void interp_unshare(linterp* i)
+{
+  if (atomic_fetch_sub_explicit(&i->shared, 1, memory_order_acq_rel) == 1)
+    pool_notify();
+}
+
+/* Read input as single S-expression and evaluate it */
+lval* interp_eval(linterp* i, const char* input, size_t len)
+{
+  return lval_eval(i->env, parse(input, len));
+}
+
+/* Evaluate expressions one by one, returns last result
+   or first error */
+lval* interp_eval_all(linterp* i, const char* input, size_t len)
+{
+  lparser p;
+  parser_init(&p, input, len);
+
+  lval* result = lval_sexpr();
+  lval* expr;
+
+  while ((expr = parser_next(&p)))
+  {
+    lval_del(result);
+    result = expr->type == LVAL_ERROR ? expr : lval_eval(i->env, expr);
+
+    if (result->type == LVAL_ERROR)
+      break;
+  }
+
+  parser_free(&p);
+  return result;
+}
+
+/* Load and evaluate file */
+lval* interp_load(linterp* i, const char* name)
+{
+  return builtin_load(i->env, lval_add(lval_sexpr(), lval_str(name)));
+}
+
+/* Load image into interpreter */
+lval* interp_load_image(linterp* i, const char* name)
+{
+  return image_load(i->env, name);
+}
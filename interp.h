@@ -0,0 +1,56 @@
+#ifndef __INTERP_H__
+#define __INTERP_H__
+/*
+ * Interpreter context
+ *
+ * Holds everything single interpreter needs, there is no
+ * process-global state, so any number of interpreters can
+ * live in one process. Interpreter itself may run futures
+ * and parallel maps on pool threads, while they run global
+ * environment is guarded by read-write lock.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "common.h"
+
+typedef struct _linterp
+{
+  lenv* env; // Global environment
+  struct _lisolate* self; // Isolate interpreter runs in
+  struct _lloop* loop; // Event loop, created on first use
+  pthread_rwlock_t lock; // Guards global environment when shared
+  atomic_int shared; // Count of tasks running on other threads
+} linterp;
+
+/* Create interpreter with built-ins */
+linterp* interp_new(void);
+
+/* Destroy interpreter */
+void interp_del(linterp* i);
+
+/* Event loop of interpreter, NULL if it can't be created */
+struct _lloop* interp_loop(linterp* i);
+
+/* Task is going to use interpreter from another thread */
+void interp_share(linterp* i);
+
+/* Task on another thread is done with interpreter */
+void interp_unshare(linterp* i);
+
+/* Read input as single S-expression and evaluate it */
+lval* interp_eval(linterp* i, const char* input, size_t len);
+
+/* Evaluate expressions one by one, returns last result
+   or first error */
+lval* interp_eval_all(linterp* i, const char* input, size_t len);
+
+/* Load and evaluate file */
+lval* interp_load(linterp* i, const char* name);
+
+/* Load image into interpreter */
+lval* interp_load_image(linterp* i, const char* name);
+
+#endif // __INTERP_H__
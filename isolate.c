@@ -0,0 +1,224 @@
+/*
+ * Isolates
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interp.h"
+#include "isolate.h"
+#include "lenv.h"
+#include "lval.h"
+
+/* Isolate numbers, only used for printing */
+static atomic_int isolate_ids;
+
+static void mailbox_init(lmailbox* m)
+{
+  atomic_store(&m->stub.next, NULL);
+  m->stub.v = NULL;
+  atomic_store(&m->head, &m->stub);
+  m->tail = &m->stub;
+  sem_init(&m->ready, 0, 0);
+}
+
+static void mailbox_push(lmailbox* m, lmsg* n)
+{
+  atomic_store_explicit(&n->next, NULL, memory_order_relaxed);
+  lmsg* prev = atomic_exchange_explicit(&m->head, n, memory_order_acq_rel);
+  atomic_store_explicit(&prev->next, n, memory_order_release);
+}
+
+/* NULL when empty or when producer is in the middle of push */
+static lmsg* mailbox_pop(lmailbox* m)
+{
+  lmsg* tail = m->tail;
+  lmsg* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+  if (tail == &m->stub)
+  {
+    if (next == NULL)
+      return NULL;
+
+    m->tail = next;
+    tail = next;
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+  }
+
+  if (next)
+  {
+    m->tail = next;
+    return tail;
+  }
+
+  if (tail != atomic_load_explicit(&m->head, memory_order_acquire))
+    return NULL;
+
+  /* Last message, put stub behind it so it can be taken */
+  mailbox_push(m, &m->stub);
+
+  next = atomic_load_explicit(&tail->next, memory_order_acquire);
+  if (next)
+  {
+    m->tail = next;
+    return tail;
+  }
+
+  return NULL;
+}
+
+static void mailbox_free(lmailbox* m)
+{
+  lmsg* n;
+  while ((n = mailbox_pop(m)))
+  {
+    lval_del(n->v);
+    free(n);
+  }
+
+  sem_destroy(&m->ready);
+}
+
+/* Create isolate for interpreter running on current thread */
+lisolate* isolate_new(linterp* i)
+{
+  lisolate* s = (lisolate*)malloc(sizeof(lisolate));
+
+  atomic_init(&s->refs, 1);
+  s->id = atomic_fetch_add(&isolate_ids, 1);
+  s->has_thread = 0;
+  pthread_mutex_init(&s->lock, NULL);
+  s->joined = 0;
+  s->interp = i;
+  s->func = NULL;
+  s->args = NULL;
+  s->result = NULL;
+  mailbox_init(&s->mailbox);
+
+  return s;
+}
+
+lisolate* isolate_ref(lisolate* s)
+{
+  atomic_fetch_add_explicit(&s->refs, 1, memory_order_relaxed);
+  return s;
+}
+
+void isolate_unref(lisolate* s)
+{
+  if (atomic_fetch_sub_explicit(&s->refs, 1, memory_order_acq_rel) != 1)
+    return;
+
+  /* Nobody is going to join it */
+  if (s->has_thread && !s->joined)
+    pthread_detach(s->thread);
+
+  if (s->result)
+    lval_del(s->result);
+
+  mailbox_free(&s->mailbox);
+  pthread_mutex_destroy(&s->lock);
+  free(s);
+}
+
+static void* isolate_run(void* arg)
+{
+  lisolate* s = (lisolate*)arg;
+  linterp* i = s->interp;
+
+  s->result = lval_call(i->env, s->func, s->args);
+  lval_del(s->func);
+  s->func = NULL;
+  s->args = NULL;
+
+  /* Interpreter holds reference to isolate, so it can be gone after this */
+  s->interp = NULL;
+  interp_del(i);
+
+  return NULL;
+}
+
+/* Run f with args in new isolate seeded with definitions of i */
+lisolate* isolate_spawn(linterp* i, lval* f, lval* args)
+{
+  linterp* child = interp_new();
+  lenv* e = i->env;
+
+  /* Copy everything but built-ins, they are already there */
+  for (int k = 0; k < e->count; k++)
+  {
+    lval* v = e->vals[k];
+    if (v->type == LVAL_FUN && v->is_builtin && !strcmp(v->name, e->syms[k]))
+      continue;
+
+    lval* sym = lval_sym(e->syms[k]);
+    lenv_put(child->env, sym, v);
+    lval_del(sym);
+  }
+
+  lisolate* s = isolate_ref(child->self);
+  s->func = f;
+  s->args = args;
+  s->has_thread = 1;
+
+  if (pthread_create(&s->thread, NULL, isolate_run, s))
+  {
+    s->has_thread = 0;
+    lval_del(f);
+    lval_del(args);
+    s->func = NULL;
+    s->args = NULL;
+    interp_del(child);
+    isolate_unref(s);
+    return NULL;
+  }
+
+  return s;
+}
+
+/* Move value into isolate's mailbox */
+void isolate_send(lisolate* s, lval* v)
+{
+  lmsg* n = (lmsg*)malloc(sizeof(lmsg));
+  n->v = v;
+
+  mailbox_push(&s->mailbox, n);
+  sem_post(&s->mailbox.ready);
+}
+
+/* Take value from own mailbox, waiting for it */
+lval* isolate_receive(lisolate* s)
+{
+  while (sem_wait(&s->mailbox.ready) && errno == EINTR)
+    ;
+
+  /* Message is there, but producer may not have linked it yet */
+  lmsg* n;
+  while ((n = mailbox_pop(&s->mailbox)) == NULL)
+    sched_yield();
+
+  lval* v = n->v;
+  free(n);
+  return v;
+}
+
+/* Wait for isolate to finish and get its result */
+lval* isolate_join(lisolate* s)
+{
+  if (!s->has_thread)
+    return lval_err("Isolate %d has no thread to join", s->id);
+
+  pthread_mutex_lock(&s->lock);
+  if (!s->joined)
+  {
+    pthread_join(s->thread, NULL);
+    s->joined = 1;
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  return lval_copy(s->result);
+}
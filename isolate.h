@@ -0,0 +1,68 @@
+#ifndef __ISOLATE_H__
+#define __ISOLATE_H__
+/*
+ * Isolates
+ *
+ * Isolate is an interpreter with its own global environment
+ * running on its own thread. Isolates share nothing and talk
+ * by moving values through mailboxes, which are lock-free
+ * multiple-producer single-consumer queues.
+ */
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+#include "common.h"
+
+/* Message in mailbox */
+typedef struct _lmsg
+{
+  _Atomic(struct _lmsg*) next;
+  lval* v;
+} lmsg;
+
+/* Intrusive MPSC queue, producers only swap the head */
+typedef struct _lmailbox
+{
+  _Atomic(lmsg*) head; // Last pushed message
+  lmsg* tail; // Next message to take, owned by consumer
+  lmsg stub;
+  sem_t ready; // Count of pushed messages, for sleeping
+} lmailbox;
+
+typedef struct _lisolate
+{
+  atomic_int refs;
+  int id;
+  int has_thread;
+  pthread_t thread;
+  pthread_mutex_t lock; // Guards joining
+  int joined;
+  linterp* interp; // Interpreter running on the thread
+  lval* func; // Function to run and its arguments
+  lval* args;
+  lval* result;
+  lmailbox mailbox;
+} lisolate;
+
+/* Create isolate for interpreter running on current thread */
+lisolate* isolate_new(linterp* i);
+
+lisolate* isolate_ref(lisolate* s);
+
+void isolate_unref(lisolate* s);
+
+/* Run f with args in new isolate seeded with definitions of i */
+lisolate* isolate_spawn(linterp* i, lval* f, lval* args);
+
+/* Move value into isolate's mailbox */
+void isolate_send(lisolate* s, lval* v);
+
+/* Take value from own mailbox, waiting for it */
+lval* isolate_receive(lisolate* s);
+
+/* Wait for isolate to finish and get its result */
+lval* isolate_join(lisolate* s);
+
+#endif // __ISOLATE_H__
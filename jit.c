@@ -0,0 +1,995 @@
+/*
+ * Template JIT
+ *
+ * Every node of body becomes fixed sequence of instructions.
+ * Code keeps its context in rbx and temporaries in stack slots,
+ * value of node is either integer or owned lval in rax.
+ *
+ * Subexpressions made only of integer literals, parameters and
+ * inlined operations are pure, they are computed unboxed with
+ * guards on parameter types. Other operands are evaluated once
+ * into boxes before inlined operation starts, and so are pure
+ * ones to the left of them, as they may assign parameters pure
+ * ones read. When guard fails, interpreter does operation with
+ * boxes as they are and evaluates remaining pure operands again,
+ * nothing could change them since. Inlined names may be bound
+ * locally while body runs, so every inlined operation checks
+ * that first.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jit.h"
+#include "lenv.h"
+#include "lval.h"
+
+/* Names of inlined built-ins, global ones can't be redefined */
+static const char* jit_names[] = {
+  "+", "-", "*", "/", "<", ">", "<=", ">=", "==", "!=", "if"
+};
+
+/* Built-ins modules compiled ahead of time call directly */
+static const char* jit_called[] = {
+  "do", "head", "tail", "list", "join", "eval", "len", "cons", "init", "not"
+};
+
+atomic_int jit_shadows;
+
+/* Name is one of built-ins compiled code inlines or calls directly */
+int jit_inlined(const char* name)
+{
+  if (!strchr("+-*/<>=!idhtljecn", name[0]))
+    return 0;
+
+  for (size_t i = 0; i < sizeof(jit_names) / sizeof(jit_names[0]); i++)
+    if (!strcmp(name, jit_names[i]))
+      return 1;
+  for (size_t i = 0; i < sizeof(jit_called) / sizeof(jit_called[0]); i++)
+    if (!strcmp(name, jit_called[i]))
+      return 1;
+  return 0;
+}
+
+/* Local environments binding inlined names come and go */
+void jit_shadow(int delta)
+{
+  atomic_fetch_add_explicit(&jit_shadows, delta, memory_order_relaxed);
+}
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+#define JIT_LOCALS 16 // Parameters read straight from environment
+
+typedef enum
+{
+  JIT_COLD,
+  JIT_BUSY, // Being compiled
+  JIT_READY,
+  JIT_FAILED
+} ljit_state;
+
+/* Operations in order of jit_names */
+typedef enum
+{
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_LT,
+  OP_GT,
+  OP_LE,
+  OP_GE,
+  OP_EQ,
+  OP_NE,
+  OP_IF,
+  OP_NONE
+} ljit_op;
+
+/* What compiled code sees, pointed to by rbx */
+typedef struct
+{
+  lenv* env; // Environment of call
+  ljit* jit;
+  lval* ret; // Result of special form helper has evaluated
+  int locals[JIT_LOCALS]; // Position of each parameter in environment
+} ljit_ctx;
+
+typedef lval* (*ljit_entry)(ljit_ctx* c);
+
+struct _ljit
+{
+  atomic_int refs;
+  atomic_int calls;
+  atomic_int state;
+  lval* body; // Copy compiled code refers to
+  char* locals[JIT_LOCALS];
+  int local_count;
+  ljit_entry entry;
+  void* code;
+  size_t size;
+};
+
+static atomic_int jit_active = 1;
+
+/* Turn compilation of new lambdas on or off,
+   -1 if JIT isn't supported on this platform */
+int jit_enable(int on)
+{
+  atomic_store(&jit_active, on);
+  return 0;
+}
+
+/* Counter for new lambda, NULL if JIT is off */
+ljit* jit_new(void)
+{
+  if (!atomic_load_explicit(&jit_active, memory_order_relaxed))
+    return NULL;
+
+  ljit* j = (ljit*)calloc(1, sizeof(ljit));
+  atomic_init(&j->refs, 1);
+  return j;
+}
+
+ljit* jit_ref(ljit* j)
+{
+  if (j)
+    atomic_fetch_add_explicit(&j->refs, 1, memory_order_relaxed);
+  return j;
+}
+
+void jit_unref(ljit* j)
+{
+  if (j == NULL || atomic_fetch_sub_explicit(&j->refs, 1, memory_order_acq_rel) != 1)
+    return;
+
+  if (j->body)
+    lval_del(j->body);
+  for (int i = 0; i < j->local_count; i++)
+    free(j->locals[i]);
+  if (j->code)
+    munmap(j->code, j->size);
+  free(j);
+}
+
+/*
+ * Analysis
+ */
+
+static int jit_local(ljit* j, const char* name)
+{
+  for (int i = 0; i < j->local_count; i++)
+    if (!strcmp(j->locals[i], name))
+      return i;
+  return -1;
+}
+
+/* Inlined operation list stands for, its arity is checked */
+static ljit_op jit_op(ljit* j, lval* v)
+{
+  if (v->count < 2 || v->cell[0]->type != LVAL_SYM)
+    return OP_NONE;
+
+  const char* name = v->cell[0]->sym;
+  if (!jit_inlined(name) || jit_local(j, name) >= 0)
+    return OP_NONE;
+
+  ljit_op op = OP_ADD;
+  while (op < OP_NONE && strcmp(jit_names[op], name))
+    op++;
+
+  if (op == OP_NONE)
+    return op;
+  if (op == OP_IF)
+    return v->count == 4 ? op : OP_NONE;
+  if (op >= OP_LT)
+    return v->count == 3 ? op : OP_NONE;
+  return op;
+}
+
+static int jit_pure_op(ljit* j, lval* v);
+
+/* Value can be computed unboxed without side effects */
+static int jit_pure(ljit* j, lval* v)
+{
+  switch (v->type)
+  {
+    case LVAL_NUMBER:
+      return 1;
+    case LVAL_SYM:
+      return jit_local(j, v->sym) >= 0;
+    case LVAL_SEXPR:
+      return jit_pure_op(j, v);
+    default:
+      return 0;
+  }
+}
+
+static int jit_pure_op(ljit* j, lval* v)
+{
+  ljit_op op = jit_op(j, v);
+  if (op == OP_NONE || op == OP_IF)
+    return 0;
+
+  for (int i = 1; i < v->count; i++)
+    if (!jit_pure(j, v->cell[i]))
+      return 0;
+  return 1;
+}
+
+/* Operand is evaluated into box in order, not read unboxed
+   after impure operands that follow it */
+static int jit_boxed(ljit* j, lval* v, int i)
+{
+  for (int k = i; k < v->count; k++)
+    if (!jit_pure(j, v->cell[k]))
+      return 1;
+  return 0;
+}
+
+/*
+ * Runtime called by compiled code
+ */
+
+static lval* jit_lookup(ljit_ctx* c, lval* sym)
+{
+  return lenv_get(c->env, sym);
+}
+
+/* Evaluate list as code */
+static lval* jit_eval_list(ljit_ctx* c, lval* v)
+{
+  lval* x = lval_copy(v);
+  x->type = LVAL_SEXPR;
+  return lval_eval(c->env, x);
+}
+
+/* Evaluate head of call, special form is evaluated whole
+   with result left in context and NULL returned */
+static lval* jit_head(ljit_ctx* c, lval* v)
+{
+  lval* h = lval_eval(c->env, lval_copy(v->cell[0]));
+  if (h->type != LVAL_FUN || !h->is_builtin || !h->special)
+    return h;
+
+  lval* a = lval_sexpr();
+  for (int i = 1; i < v->count; i++)
+    lval_add(a, lval_copy(v->cell[i]));
+
+  c->ret = h->special(c->env, a);
+  lval_del(h);
+  return NULL;
+}
+
+/* Call evaluated head with evaluated arguments, takes them */
+static lval* jit_apply(ljit_ctx* c, lval** cells, long count)
+{
+  lval* x = lval_sexpr();
+  x->count = count;
+  x->cell = (lval**)malloc(sizeof(lval*) * count);
+  memcpy(x->cell, cells, sizeof(lval*) * count);
+  return lval_eval_call(c->env, x);
+}
+
+/* Guard of inlined operation failed, interpreter does it with
+   boxed operands and evaluates pure ones again */
+static lval* jit_slow(ljit_ctx* c, lval* v, lval** boxes)
+{
+  lval* x = lval_add(lval_sexpr(), lenv_get(c->env, v->cell[0]));
+
+  for (int i = 1; i < v->count; i++)
+    if (jit_boxed(c->jit, v, i))
+      lval_add(x, *boxes++);
+    else
+      lval_add(x, lval_eval(c->env, lval_copy(v->cell[i])));
+
+  return lval_eval_call(c->env, x);
+}
+
+/* Condition of 'if', takes it. Returns -1 with result of
+   'if' left in context when it isn't a number. */
+static long jit_test(ljit_ctx* c, lval* x)
+{
+  if (x->type == LVAL_ERROR)
+  {
+    c->ret = x;
+    return -1;
+  }
+
+  if (x->type != LVAL_NUMBER)
+  {
+    c->ret = lval_err("Function 'if' passed incorrect type for argument 0. "
+      "Got %s, Expected %s.", ltype_name(x->type), ltype_name(LVAL_NUMBER));
+    lval_del(x);
+    return -1;
+  }
+
+  long r = x->num != 0;
+  lval_del(x);
+  return r;
+}
+
+/* Box that held operand takes result */
+static lval* jit_renum(lval* x, long n)
+{
+  x->num = n;
+  return x;
+}
+
+/*
+ * Code generation
+ */
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI };
+
+/* Condition codes of jcc and setcc */
+enum { CC_E = 0x4, CC_NE = 0x5, CC_S = 0x8, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+
+#define JIT_CODE (1 << 20) // Largest body compiled
+#define JIT_SLOTS 4096
+
+typedef struct
+{
+  unsigned char* code;
+  size_t len;
+  size_t cap;
+  int slots; // Temporaries in use
+  int max_slots;
+  size_t* labels; // Offset of each label
+  int label_count;
+  size_t* fix_at; // Displacements to patch
+  int* fix_label;
+  int fix_count;
+  ljit* j;
+  int failed;
+} lgen;
+
+static void gen_bytes(lgen* g, const void* p, size_t n)
+{
+  if (g->len + n > g->cap)
+  {
+    if (g->len + n > JIT_CODE)
+    {
+      g->failed = 1;
+      return;
+    }
+    g->cap = g->cap ? g->cap * 2 : 4096;
+    g->code = (unsigned char*)realloc(g->code, g->cap);
+  }
+
+  memcpy(g->code + g->len, p, n);
+  g->len += n;
+}
+
+#define GEN(g, ...) do { \
+    const unsigned char b_[] = { __VA_ARGS__ }; \
+    gen_bytes(g, b_, sizeof(b_)); \
+  } while (0)
+
+static void gen_u32(lgen* g, uint32_t x)
+{
+  gen_bytes(g, &x, sizeof(x));
+}
+
+static void gen_u64(lgen* g, uint64_t x)
+{
+  gen_bytes(g, &x, sizeof(x));
+}
+
+static int slot_alloc(lgen* g, int n)
+{
+  int s = g->slots;
+  g->slots += n;
+  if (g->slots > g->max_slots)
+    g->max_slots = g->slots;
+  if (g->slots > JIT_SLOTS)
+    g->failed = 1;
+  return s;
+}
+
+static void slot_free(lgen* g, int n)
+{
+  g->slots -= n;
+}
+
+static int label_new(lgen* g)
+{
+  g->labels = (size_t*)realloc(g->labels, sizeof(size_t) * (g->label_count + 1));
+  g->labels[g->label_count] = SIZE_MAX;
+  return g->label_count++;
+}
+
+static void label_here(lgen* g, int l)
+{
+  g->labels[l] = g->len;
+}
+
+static void gen_fixup(lgen* g, int l)
+{
+  g->fix_at = (size_t*)realloc(g->fix_at, sizeof(size_t) * (g->fix_count + 1));
+  g->fix_label = (int*)realloc(g->fix_label, sizeof(int) * (g->fix_count + 1));
+  g->fix_at[g->fix_count] = g->len;
+  g->fix_label[g->fix_count] = l;
+  g->fix_count++;
+  gen_u32(g, 0);
+}
+
+static void gen_jmp(lgen* g, int l)
+{
+  GEN(g, 0xE9);
+  gen_fixup(g, l);
+}
+
+static void gen_jcc(lgen* g, int cc, int l)
+{
+  GEN(g, 0x0F, 0x80 | cc);
+  gen_fixup(g, l);
+}
+
+/* mov reg, imm64 */
+static void gen_imm(lgen* g, int reg, uint64_t x)
+{
+  GEN(g, 0x48, 0xB8 | reg);
+  gen_u64(g, x);
+}
+
+static void gen_ptr(lgen* g, int reg, const void* p)
+{
+  gen_imm(g, reg, (uintptr_t)p);
+}
+
+/* mov r11, f; call r11 */
+static void gen_call(lgen* g, uintptr_t f)
+{
+  GEN(g, 0x49, 0xBB);
+  gen_u64(g, f);
+  GEN(g, 0x41, 0xFF, 0xD3);
+}
+
+#define GEN_CALL(g, f) gen_call(g, (uintptr_t)(f))
+
+/* mov dst, src */
+static void gen_mov(lgen* g, int dst, int src)
+{
+  GEN(g, 0x48, 0x89, 0xC0 | src << 3 | dst);
+}
+
+/* mov [rsp + 8 * slot], reg */
+static void gen_store(lgen* g, int reg, int slot)
+{
+  GEN(g, 0x48, 0x89, 0x84 | reg << 3, 0x24);
+  gen_u32(g, slot * 8);
+}
+
+/* mov reg, [rsp + 8 * slot] */
+static void gen_load(lgen* g, int reg, int slot)
+{
+  GEN(g, 0x48, 0x8B, 0x84 | reg << 3, 0x24);
+  gen_u32(g, slot * 8);
+}
+
+/* lea reg, [rsp + 8 * slot] */
+static void gen_lea(lgen* g, int reg, int slot)
+{
+  GEN(g, 0x48, 0x8D, 0x84 | reg << 3, 0x24);
+  gen_u32(g, slot * 8);
+}
+
+/* mov reg, [rbx + off] */
+static void gen_ctx(lgen* g, int reg, size_t off)
+{
+  GEN(g, 0x48, 0x8B, 0x83 | reg << 3);
+  gen_u32(g, off);
+}
+
+/* mov rax, [rax + off] */
+static void gen_field(lgen* g, size_t off)
+{
+  GEN(g, 0x48, 0x8B, 0x80);
+  gen_u32(g, off);
+}
+
+/* rax = env->vals[locals[k]] */
+static void gen_local(lgen* g, int k)
+{
+  gen_ctx(g, RAX, offsetof(ljit_ctx, env));
+  gen_field(g, offsetof(lenv, vals));
+  GEN(g, 0x48, 0x63, 0x8B); // movsxd rcx, [rbx + off]
+  gen_u32(g, offsetof(ljit_ctx, locals) + sizeof(int) * k);
+  GEN(g, 0x48, 0x8B, 0x04, 0xC8); // mov rax, [rax + rcx * 8]
+}
+
+/* Unbox number in rax, jump to fail if it's something else */
+static void gen_guard(lgen* g, int fail)
+{
+  GEN(g, 0x83, 0xB8); // cmp dword [rax + off], imm8
+  gen_u32(g, offsetof(lval, type));
+  GEN(g, LVAL_NUMBER);
+  gen_jcc(g, CC_NE, fail);
+  gen_field(g, offsetof(lval, num));
+}
+
+/* Jump to fail if some local environment binds inlined name,
+   body itself may have done it since call started */
+static void gen_shadowed(lgen* g, int fail)
+{
+  gen_ptr(g, RAX, &jit_shadows);
+  GEN(g, 0x83, 0x38, 0x00); // cmp dword [rax], 0
+  gen_jcc(g, CC_NE, fail);
+}
+
+static void gen_box(lgen* g, lval* v);
+static void gen_list(lgen* g, lval* v);
+static void gen_arith(lgen* g, lval* v, int fail, int box);
+
+/* Pure value into rax unboxed */
+static void gen_int(lgen* g, lval* v, int fail)
+{
+  if (v->type == LVAL_NUMBER)
+    gen_imm(g, RAX, v->num);
+  else if (v->type == LVAL_SYM)
+  {
+    gen_local(g, jit_local(g->j, v->sym));
+    gen_guard(g, fail);
+  }
+  else
+    gen_arith(g, v, fail, 0);
+}
+
+/* Operand of inlined operation, boxed ones are taken from slots */
+static void gen_operand(lgen* g, lval* v, int i, int fail, int* box)
+{
+  if (!jit_boxed(g->j, v, i))
+    gen_int(g, v->cell[i], fail);
+  else
+  {
+    gen_load(g, RAX, (*box)++);
+    gen_guard(g, fail);
+  }
+}
+
+/* Inlined operation, result is in rax unboxed */
+static void gen_arith(lgen* g, lval* v, int fail, int box)
+{
+  static const unsigned char setcc[] = {
+    [OP_LT] = CC_L, [OP_GT] = CC_G, [OP_LE] = CC_LE,
+    [OP_GE] = CC_GE, [OP_EQ] = CC_E, [OP_NE] = CC_NE
+  };
+
+  ljit_op op = jit_op(g->j, v);
+  gen_operand(g, v, 1, fail, &box);
+
+  /* Unary minus negates, other operations of one operand keep it */
+  if (v->count == 2 && op == OP_SUB)
+    GEN(g, 0x48, 0xF7, 0xD8); // neg rax
+
+  int t = slot_alloc(g, 1);
+  for (int i = 2; i < v->count; i++)
+  {
+    gen_store(g, RAX, t);
+    gen_operand(g, v, i, fail, &box);
+    gen_mov(g, RCX, RAX);
+    gen_load(g, RAX, t);
+
+    switch (op)
+    {
+      case OP_ADD:
+        GEN(g, 0x48, 0x01, 0xC8); // add rax, rcx
+        break;
+      case OP_SUB:
+        GEN(g, 0x48, 0x29, 0xC8); // sub rax, rcx
+        break;
+      case OP_MUL:
+        GEN(g, 0x48, 0x0F, 0xAF, 0xC1); // imul rax, rcx
+        break;
+      case OP_DIV:
+        /* Division by zero is error, by -1 may trap */
+        GEN(g, 0x48, 0x85, 0xC9); // test rcx, rcx
+        gen_jcc(g, CC_E, fail);
+        GEN(g, 0x48, 0x83, 0xF9, 0xFF); // cmp rcx, -1
+        gen_jcc(g, CC_E, fail);
+        GEN(g, 0x48, 0x99); // cqo
+        GEN(g, 0x48, 0xF7, 0xF9); // idiv rcx
+        break;
+      default:
+        GEN(g, 0x48, 0x39, 0xC8); // cmp rax, rcx
+        GEN(g, 0x0F, 0x90 | setcc[op], 0xC0); // setcc al
+        GEN(g, 0x0F, 0xB6, 0xC0); // movzx eax, al
+        break;
+    }
+  }
+  slot_free(g, 1);
+}
+
+/* Inlined operation on pure operands */
+static void gen_pure(lgen* g, lval* v)
+{
+  int fail = label_new(g);
+  int done = label_new(g);
+
+  gen_shadowed(g, fail);
+  gen_arith(g, v, fail, 0);
+  gen_mov(g, RDI, RAX);
+  GEN_CALL(g, lval_num);
+  gen_jmp(g, done);
+
+  label_here(g, fail);
+  gen_mov(g, RDI, RBX);
+  gen_ptr(g, RSI, v);
+  GEN_CALL(g, jit_eval_list);
+
+  label_here(g, done);
+}
+
+/* Inlined operation with operands that have to be boxed */
+static void gen_mixed(lgen* g, lval* v)
+{
+  int n = 0;
+  for (int i = 1; i < v->count; i++)
+    n += jit_boxed(g->j, v, i);
+
+  int base = slot_alloc(g, n);
+  for (int i = 1, k = base; i < v->count; i++)
+    if (jit_boxed(g->j, v, i))
+    {
+      gen_box(g, v->cell[i]);
+      gen_store(g, RAX, k++);
+    }
+
+  int fail = label_new(g);
+  int done = label_new(g);
+
+  gen_shadowed(g, fail);
+  gen_arith(g, v, fail, base);
+
+  /* First box takes result, others are released */
+  gen_mov(g, RSI, RAX);
+  gen_load(g, RDI, base);
+  GEN_CALL(g, jit_renum);
+  if (n > 1)
+  {
+    gen_store(g, RAX, base);
+    for (int k = 1; k < n; k++)
+    {
+      gen_load(g, RDI, base + k);
+      GEN_CALL(g, lval_del);
+    }
+    gen_load(g, RAX, base);
+  }
+  gen_jmp(g, done);
+
+  label_here(g, fail);
+  gen_mov(g, RDI, RBX);
+  gen_ptr(g, RSI, v);
+  gen_lea(g, RDX, base);
+  GEN_CALL(g, jit_slow);
+
+  label_here(g, done);
+  slot_free(g, n);
+}
+
+/* Branch of 'if', Q-expression is treated as body */
+static void gen_branch(lgen* g, lval* v)
+{
+  if (v->type == LVAL_QEXPR)
+    gen_list(g, v);
+  else
+    gen_box(g, v);
+}
+
+static void gen_if(lgen* g, lval* v)
+{
+  lval* c = v->cell[1];
+  int then = label_new(g);
+  int other = label_new(g);
+  int error = label_new(g);
+  int done = label_new(g);
+  int shadowed = label_new(g);
+
+  gen_shadowed(g, shadowed);
+
+  /* Pure condition is tested unboxed */
+  if (c->type == LVAL_SEXPR && jit_pure_op(g->j, c))
+  {
+    int slow = label_new(g);
+    gen_arith(g, c, slow, 0);
+    GEN(g, 0x48, 0x85, 0xC0); // test rax, rax
+    gen_jcc(g, CC_E, other);
+    gen_jmp(g, then);
+
+    label_here(g, slow);
+    gen_mov(g, RDI, RBX);
+    gen_ptr(g, RSI, c);
+    GEN_CALL(g, jit_eval_list);
+  }
+  else
+    gen_box(g, c);
+
+  gen_mov(g, RSI, RAX);
+  gen_mov(g, RDI, RBX);
+  GEN_CALL(g, jit_test);
+  GEN(g, 0x48, 0x85, 0xC0); // test rax, rax
+  gen_jcc(g, CC_E, other);
+  gen_jcc(g, CC_S, error);
+
+  label_here(g, then);
+  gen_branch(g, v->cell[2]);
+  gen_jmp(g, done);
+
+  label_here(g, other);
+  gen_branch(g, v->cell[3]);
+  gen_jmp(g, done);
+
+  label_here(g, error);
+  gen_ctx(g, RAX, offsetof(ljit_ctx, ret));
+  gen_jmp(g, done);
+
+  label_here(g, shadowed);
+  gen_mov(g, RDI, RBX);
+  gen_ptr(g, RSI, v);
+  GEN_CALL(g, jit_eval_list);
+
+  label_here(g, done);
+}
+
+/* Call of anything that isn't inlined */
+static void gen_apply(lgen* g, lval* v)
+{
+  int n = v->count;
+  int base = slot_alloc(g, n);
+  int go = label_new(g);
+  int done = label_new(g);
+
+  gen_mov(g, RDI, RBX);
+  gen_ptr(g, RSI, v);
+  GEN_CALL(g, jit_head);
+  GEN(g, 0x48, 0x85, 0xC0); // test rax, rax
+  gen_jcc(g, CC_NE, go);
+  gen_ctx(g, RAX, offsetof(ljit_ctx, ret));
+  gen_jmp(g, done);
+
+  label_here(g, go);
+  gen_store(g, RAX, base);
+  for (int i = 1; i < n; i++)
+  {
+    gen_box(g, v->cell[i]);
+    gen_store(g, RAX, base + i);
+  }
+
+  gen_mov(g, RDI, RBX);
+  gen_lea(g, RSI, base);
+  gen_imm(g, RDX, n);
+  GEN_CALL(g, jit_apply);
+
+  label_here(g, done);
+  slot_free(g, n);
+}
+
+/* Evaluation of list as S-expression */
+static void gen_list(lgen* g, lval* v)
+{
+  if (v->count == 0)
+  {
+    GEN_CALL(g, lval_sexpr);
+    return;
+  }
+
+  if (v->count == 1)
+  {
+    gen_box(g, v->cell[0]);
+    return;
+  }
+
+  switch (jit_op(g->j, v))
+  {
+    case OP_NONE:
+      gen_apply(g, v);
+      break;
+    case OP_IF:
+      gen_if(g, v);
+      break;
+    default:
+      if (jit_pure_op(g->j, v))
+        gen_pure(g, v);
+      else
+        gen_mixed(g, v);
+      break;
+  }
+}
+
+/* Evaluation of any value, result is boxed */
+static void gen_box(lgen* g, lval* v)
+{
+  int k;
+
+  switch (v->type)
+  {
+    case LVAL_NUMBER:
+      gen_imm(g, RDI, v->num);
+      GEN_CALL(g, lval_num);
+      break;
+
+    case LVAL_SYM:
+      if ((k = jit_local(g->j, v->sym)) >= 0)
+      {
+        gen_local(g, k);
+        gen_mov(g, RDI, RAX);
+        GEN_CALL(g, lval_copy);
+      }
+      else
+      {
+        gen_mov(g, RDI, RBX);
+        gen_ptr(g, RSI, v);
+        GEN_CALL(g, jit_lookup);
+      }
+      break;
+
+    case LVAL_SEXPR:
+      gen_list(g, v);
+      break;
+
+    default:
+      gen_ptr(g, RDI, v);
+      GEN_CALL(g, lval_copy);
+      break;
+  }
+}
+
+/* Compile body of lambda with parameters bound in its environment */
+static int jit_compile(ljit* j, lval* f)
+{
+  if (f->body->type != LVAL_QEXPR)
+    return 0;
+
+  j->body = lval_copy(f->body);
+  j->local_count = f->env->count < JIT_LOCALS ? f->env->count : JIT_LOCALS;
+  for (int i = 0; i < j->local_count; i++)
+    j->locals[i] = strdup(f->env->syms[i]);
+
+  lgen g;
+  memset(&g, 0, sizeof(g));
+  g.j = j;
+
+  /* push rbp; mov rbp, rsp; push rbx; sub rsp, frame; mov rbx, rdi */
+  GEN(&g, 0x55, 0x48, 0x89, 0xE5, 0x53, 0x48, 0x81, 0xEC);
+  size_t frame = g.len;
+  gen_u32(&g, 0);
+  gen_mov(&g, RBX, RDI);
+
+  gen_list(&g, j->body);
+
+  /* mov rbx, [rbp - 8]; leave; ret */
+  GEN(&g, 0x48, 0x8B, 0x5D, 0xF8, 0xC9, 0xC3);
+
+  int ok = !g.failed;
+  if (ok)
+  {
+    /* Keep stack aligned at calls */
+    uint32_t size = g.max_slots * 8;
+    if (size % 16 == 0)
+      size += 8;
+    memcpy(g.code + frame, &size, sizeof(size));
+
+    for (int i = 0; i < g.fix_count; i++)
+    {
+      int32_t rel = g.labels[g.fix_label[i]] - (g.fix_at[i] + 4);
+      memcpy(g.code + g.fix_at[i], &rel, sizeof(rel));
+    }
+
+    j->size = g.len;
+    j->code = mmap(NULL, j->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (j->code == MAP_FAILED)
+    {
+      j->code = NULL;
+      ok = 0;
+    }
+    else
+    {
+      memcpy(j->code, g.code, g.len);
+      if (mprotect(j->code, j->size, PROT_READ | PROT_EXEC) < 0)
+        ok = 0;
+      memcpy(&j->entry, &j->code, sizeof(j->entry));
+    }
+  }
+
+  free(g.code);
+  free(g.labels);
+  free(g.fix_at);
+  free(g.fix_label);
+  return ok;
+}
+
+/* Find parameters in environment, usually they are where they were */
+static int jit_bind(ljit* j, lenv* e, int* locals)
+{
+  for (int k = 0; k < j->local_count; k++)
+  {
+    if (k < e->count && !strcmp(e->syms[k], j->locals[k]))
+    {
+      locals[k] = k;
+      continue;
+    }
+
+    int i = 0;
+    while (i < e->count && strcmp(e->syms[i], j->locals[k]))
+      i++;
+    if (i == e->count)
+      return 0;
+    locals[k] = i;
+  }
+
+  return 1;
+}
+
+/* Evaluate body of lambda whose parameters are bound,
+   NULL if it has to be interpreted */
+lval* jit_run(lval* f)
+{
+  ljit* j = f->jit;
+
+  int state = atomic_load_explicit(&j->state, memory_order_acquire);
+  if (state != JIT_READY)
+  {
+    if (state != JIT_COLD
+      || atomic_fetch_add_explicit(&j->calls, 1, memory_order_relaxed) + 1 < JIT_THRESHOLD)
+      return NULL;
+
+    int cold = JIT_COLD;
+    if (!atomic_compare_exchange_strong(&j->state, &cold, JIT_BUSY))
+      return NULL;
+
+    state = jit_compile(j, f) ? JIT_READY : JIT_FAILED;
+    atomic_store_explicit(&j->state, state, memory_order_release);
+    if (state != JIT_READY)
+      return NULL;
+  }
+
+  if (atomic_load_explicit(&jit_shadows, memory_order_relaxed))
+    return NULL;
+
+  ljit_ctx c;
+  c.env = f->env;
+  c.jit = j;
+  c.ret = NULL;
+  if (!jit_bind(j, f->env, c.locals))
+    return NULL;
+
+  return j->entry(&c);
+}
+
+#else
+
+int jit_enable(int on)
+{
+  return on ? -1 : 0;
+}
+
+ljit* jit_new(void)
+{
+  return NULL;
+}
+
+ljit* jit_ref(ljit* j)
+{
+  return j;
+}
+
+void jit_unref(ljit* j)
+{
+  (void)j;
+}
+
+lval* jit_run(lval* f)
+{
+  (void)f;
+  return NULL;
+}
+
+#endif
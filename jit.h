@@ -0,0 +1,50 @@
+#ifndef __JIT_H__
+#define __JIT_H__
+/*
+ * Template JIT
+ *
+ * Lambdas count their calls, past threshold body is compiled
+ * into x86-64 code once for lambda and all of its copies.
+ * Integer arithmetic and comparisons on literals, parameters
+ * and results of calls are done inline, everything else calls
+ * back into interpreter. When operand turns out not to be an
+ * integer, operation is done by interpreter instead.
+ *
+ * Inlined built-ins are assumed to be global ones. While any
+ * local environment binds their names, compiled code isn't run.
+ * Code compiled ahead of time relies on the same count.
+ */
+
+#include <stdatomic.h>
+
+#include "common.h"
+
+#define JIT_THRESHOLD 50 // Calls before lambda is compiled
+
+typedef struct _ljit ljit;
+
+/* Turn compilation of new lambdas on or off,
+   -1 if JIT isn't supported on this platform */
+int jit_enable(int on);
+
+/* Counter for new lambda, NULL if JIT is off */
+ljit* jit_new(void);
+
+ljit* jit_ref(ljit* j);
+
+void jit_unref(ljit* j);
+
+/* Evaluate body of lambda whose parameters are bound,
+   NULL if it has to be interpreted */
+lval* jit_run(lval* f);
+
+/* Name is one of built-ins compiled code inlines or calls directly */
+int jit_inlined(const char* name);
+
+/* Local environments binding inlined names come and go */
+void jit_shadow(int delta);
+
+/* Count of local bindings of inlined names */
+extern atomic_int jit_shadows;
+
+#endif // __JIT_H__
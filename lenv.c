@@ -2,12 +2,40 @@
  * Lisp Environment
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "heap.h"
+#include "interp.h"
+#include "jit.h"
 #include "lenv.h"
 #include "lval.h"
+#include "stats.h"
+
+/* Lock global environment if interpreter is used by several threads */
+static linterp* lenv_lock(lenv* e, int write)
+{
+  linterp* i = e->interp;
+
+  if (i == NULL || atomic_load_explicit(&i->shared, memory_order_acquire) == 0)
+    return NULL;
+
+  if (write)
+    pthread_rwlock_wrlock(&i->lock);
+  else
+    pthread_rwlock_rdlock(&i->lock);
+
+  return i;
+}
+
+static void lenv_unlock(linterp* i)
+{
+  if (i)
+    pthread_rwlock_unlock(&i->lock);
+}
 
 /* Create environment */
 lenv* lenv_new(void)
@@ -18,7 +46,10 @@ lenv* lenv_new(void)
   e->syms = NULL;
   e->vals = NULL;
   e->parent = NULL;
+  e->interp = NULL;
+  e->shadows = 0;
 
+  HEAP_ALLOC(e, HEAP_ENV, sizeof(lenv), __func__);
   return e;
 }
 
@@ -33,25 +64,69 @@ void lenv_del(lenv* e)
 
   free(e->vals);
   free(e->syms);
+  if (e->shadows)
+    jit_shadow(-e->shadows);
+  HEAP_FREE(e);
   free(e);
 }
 
 /* Get value from environment */
 lval* lenv_get(lenv* e, lval* k)
 {
-  for (int i = 0; i < e->count; i++)
-    if (!strcmp(e->syms[i], k->sym))
-      return lval_copy(e->vals[i]);
+  STAT_INC(lookups);
+
+  for (; e; e = e->parent)
+  {
+    STAT_INC(frames);
+    linterp* locked = lenv_lock(e, 0);
 
-  if (e->parent)
-    return lenv_get(e->parent, k);
+    for (int i = 0; i < e->count; i++)
+      if (!strcmp(e->syms[i], k->sym))
+      {
+        lval* v = lval_copy(e->vals[i]);
+        lenv_unlock(locked);
+        return v;
+      }
+
+    lenv_unlock(locked);
+  }
 
   return lval_err("Unbound symbol '%s'!", k->sym);
 }
 
+/* Read number bound to symbol without copying it,
+   0 if symbol is unbound or bound to something else */
+int lenv_get_num(lenv* e, lval* k, long* n)
+{
+  STAT_INC(lookups);
+
+  for (; e; e = e->parent)
+  {
+    STAT_INC(frames);
+    linterp* locked = lenv_lock(e, 0);
+
+    for (int i = 0; i < e->count; i++)
+      if (!strcmp(e->syms[i], k->sym))
+      {
+        lval* v = e->vals[i];
+        int found = v->type == LVAL_NUMBER;
+        if (found)
+          *n = v->num;
+        lenv_unlock(locked);
+        return found;
+      }
+
+    lenv_unlock(locked);
+  }
+
+  return 0;
+}
+
 /* Put value into environment */
 int lenv_put(lenv* e, lval* k, lval* v)
 {
+  linterp* locked = lenv_lock(e, 1);
+
   /* First check if this symbol already exists */
   for (int i = 0; i < e->count; i++)
     if (!strcmp(e->syms[i], k->sym))
@@ -60,13 +135,22 @@ int lenv_put(lenv* e, lval* k, lval* v)
       if ((o->type == LVAL_FUN) && o->is_builtin)
       {
         /* Forbid built-ins redefinition */
+        lenv_unlock(locked);
         return 1;
       }
       lval_del(o);
       e->vals[i] = lval_copy(v);
+      lenv_unlock(locked);
       return 0;
     }
 
+  /* Compiled code can't use built-ins it inlines while they are hidden */
+  if (e->interp == NULL && jit_inlined(k->sym))
+  {
+    e->shadows++;
+    jit_shadow(1);
+  }
+
   /* If it isn't, then put it there */
   e->count++;
   e->vals = realloc(e->vals, e->count * sizeof(lval*));
@@ -76,6 +160,7 @@ int lenv_put(lenv* e, lval* k, lval* v)
   e->syms[e->count-1] = (char*)malloc(strlen(k->sym)+1);
   strcpy(e->syms[e->count-1], k->sym);
 
+  lenv_unlock(locked);
   return 0;
 }
 
@@ -92,9 +177,14 @@ int lenv_def(lenv* e, lval* k, lval* v)
 lenv* lenv_copy(lenv* e)
 {
   lenv* n = (lenv*)malloc(sizeof(lenv));
+  HEAP_ALLOC(n, HEAP_ENV, sizeof(lenv), __func__);
 
   n->parent = e->parent;
+  n->interp = NULL;
   n->count = e->count;
+  n->shadows = e->shadows;
+  if (n->shadows)
+    jit_shadow(n->shadows);
   n->syms = (char**)malloc(sizeof(char*) * n->count);
   n->vals = (lval**)malloc(sizeof(lval*) * n->count);
 
@@ -108,6 +198,15 @@ lenv* lenv_copy(lenv* e)
   return n;
 }
 
+/* Get interpreter environment belongs to */
+linterp* lenv_interp(lenv* e)
+{
+  while (e->parent)
+    e = e->parent;
+
+  return e->interp;
+}
+
 void lenv_add_builtin(lenv* e, const char* name, lbuiltin f)
 {
   lval* k = lval_sym(name);
@@ -117,6 +216,15 @@ void lenv_add_builtin(lenv* e, const char* name, lbuiltin f)
   lval_del(v);
 }
 
+void lenv_add_special(lenv* e, const char* name, lbuiltin f, lbuiltin s)
+{
+  lval* k = lval_sym(name);
+  lval* v = lval_special(f, s, name);
+  lenv_put(e, k, v);
+  lval_del(k);
+  lval_del(v);
+}
+
 void lenv_add_builtins(lenv* e)
 {
   /* List Functions */
@@ -131,12 +239,18 @@ void lenv_add_builtins(lenv* e)
   lenv_add_builtin(e, "cons", builtin_cons);
   lenv_add_builtin(e, "init", builtin_init);
   lenv_add_builtin(e, "len", builtin_len);
+  lenv_add_builtin(e, "pmap", builtin_pmap);
   lenv_add_builtin(e, "def", builtin_def);
   lenv_add_builtin(e, "exit", builtin_exit);
   lenv_add_builtin(e, "env", builtin_env);
   lenv_add_builtin(e, "\\", builtin_lambda);
   lenv_add_builtin(e, "def", builtin_def);
   lenv_add_builtin(e, "=",   builtin_put);
+  lenv_add_special(e, "do",  builtin_do, special_do);
+  lenv_add_special(e, "let", builtin_let, special_let);
+  lenv_add_special(e, "while", builtin_while, special_while);
+  lenv_add_special(e, "dotimes", builtin_dotimes, special_dotimes);
+  lenv_add_special(e, "loop", builtin_loop, special_loop);
 
   /* Mathematical Functions */
   lenv_add_builtin(e, "+", builtin_add);
@@ -146,7 +260,7 @@ void lenv_add_builtins(lenv* e)
   lenv_add_builtin(e, "%", builtin_mod);
 
   /* Comparison Functions */
-  lenv_add_builtin(e, "if", builtin_if);
+  lenv_add_special(e, "if", builtin_if, special_if);
   lenv_add_builtin(e, "==", builtin_eq);
   lenv_add_builtin(e, "!=", builtin_ne);
   lenv_add_builtin(e, ">",  builtin_gt);
@@ -155,18 +269,78 @@ void lenv_add_builtins(lenv* e)
   lenv_add_builtin(e, "<=", builtin_le);
 
   /* Logical functions */
-  lenv_add_builtin(e, "and", builtin_and);
-  lenv_add_builtin(e, "or", builtin_or);
+  lenv_add_special(e, "and", builtin_and, special_and);
+  lenv_add_special(e, "or", builtin_or, special_or);
   lenv_add_builtin(e, "xor", builtin_xor);
   lenv_add_builtin(e, "not", builtin_not);
-  lenv_add_builtin(e, "&&", builtin_and);
-  lenv_add_builtin(e, "||", builtin_or);
+  lenv_add_special(e, "&&", builtin_and, special_and);
+  lenv_add_special(e, "||", builtin_or, special_or);
   lenv_add_builtin(e, "^", builtin_xor);
   lenv_add_builtin(e, "!", builtin_not);
 
+  /* Isolates */
+  lenv_add_builtin(e, "spawn", builtin_spawn);
+  lenv_add_builtin(e, "send", builtin_send);
+  lenv_add_builtin(e, "receive", builtin_receive);
+  lenv_add_builtin(e, "self", builtin_self);
+  lenv_add_builtin(e, "wait", builtin_wait);
+
+  /* Futures */
+  lenv_add_builtin(e, "future", builtin_future);
+  lenv_add_builtin(e, "force", builtin_force);
+  lenv_add_builtin(e, "await", builtin_force);
+  lenv_add_builtin(e, "ready?", builtin_ready);
+
+  /* Strings */
+  lenv_add_builtin(e, "str-len", builtin_str_len);
+  lenv_add_builtin(e, "substr", builtin_substr);
+  lenv_add_builtin(e, "concat", builtin_concat);
+  lenv_add_builtin(e, "str-find", builtin_str_find);
+  lenv_add_builtin(e, "split-str", builtin_split_str);
+  lenv_add_builtin(e, "join-str", builtin_join_str);
+
+  /* Lazy sequences */
+  lenv_add_builtin(e, "range", builtin_range);
+  lenv_add_builtin(e, "iterate", builtin_iterate);
+  lenv_add_builtin(e, "lazy-map", builtin_lazy_map);
+  lenv_add_builtin(e, "lazy-filter", builtin_lazy_filter);
+  lenv_add_builtin(e, "take-while", builtin_take_while);
+  lenv_add_builtin(e, "realize", builtin_realize);
+  lenv_add_builtin(e, "foldl", builtin_foldl);
+
+  /* Event loop */
+  lenv_add_builtin(e, "open", builtin_open);
+  lenv_add_builtin(e, "close", builtin_close);
+  lenv_add_builtin(e, "pipe", builtin_pipe);
+  lenv_add_builtin(e, "listen-unix", builtin_listen_unix);
+  lenv_add_builtin(e, "connect-unix", builtin_connect_unix);
+  lenv_add_builtin(e, "accept", builtin_accept);
+  lenv_add_builtin(e, "read", builtin_read);
+  lenv_add_builtin(e, "write", builtin_write);
+  lenv_add_builtin(e, "read-async", builtin_read_async);
+  lenv_add_builtin(e, "write-async", builtin_write_async);
+  lenv_add_builtin(e, "on-readable", builtin_on_readable);
+  lenv_add_builtin(e, "unwatch", builtin_unwatch);
+  lenv_add_builtin(e, "after", builtin_after);
+  lenv_add_builtin(e, "every", builtin_every);
+  lenv_add_builtin(e, "cancel-timer", builtin_cancel_timer);
+  lenv_add_builtin(e, "run-loop", builtin_run_loop);
+  lenv_add_builtin(e, "stop-loop", builtin_stop_loop);
+
   /* Misc */
   lenv_add_builtin(e, "load",  builtin_load);
+  lenv_add_builtin(e, "save-image", builtin_save_image);
+  lenv_add_builtin(e, "load-image", builtin_load_image);
+  lenv_add_builtin(e, "serialize", builtin_serialize);
+  lenv_add_builtin(e, "deserialize", builtin_deserialize);
   lenv_add_builtin(e, "error", builtin_error);
   lenv_add_builtin(e, "print", builtin_print);
+  lenv_add_builtin(e, "to-string", builtin_to_string);
+  lenv_add_builtin(e, "stats", builtin_stats);
+  lenv_add_builtin(e, "heap-stats", builtin_heap_stats);
+  lenv_add_builtin(e, "time", builtin_time);
+  lenv_add_builtin(e, "bench", builtin_bench);
+  lenv_add_builtin(e, "trace", builtin_trace);
+  lenv_add_builtin(e, "trace-dump", builtin_trace_dump);
 }
 
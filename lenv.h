@@ -13,6 +13,8 @@ typedef struct _lenv
   char** syms;
   lval** vals;
   lenv* parent;
+  linterp* interp; // Owner of global environment
+  int shadows; // Local bindings of names JIT inlines
 } lenv;
 
 /* Create environment */
@@ -24,6 +26,10 @@ void lenv_del(lenv* e);
 /* Get value from environment */
 lval* lenv_get(lenv* e, lval* k);
 
+/* Read number bound to symbol without copying it,
+   0 if symbol is unbound or bound to something else */
+int lenv_get_num(lenv* e, lval* k, long* n);
+
 /* Put value into environment */
 int lenv_put(lenv* e, lval* k, lval* v);
 
@@ -33,6 +39,9 @@ int lenv_def(lenv* e, lval* k, lval* v);
 /* Copy environment */
 lenv* lenv_copy(lenv* e);
 
+/* Get interpreter environment belongs to */
+linterp* lenv_interp(lenv* e);
+
 void lenv_add_builtins(lenv* e);
 
 #endif // __LENV_H__
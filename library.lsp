@@ -20,17 +20,7 @@
 (def {curry} unpack)
 (def {uncurry} pack)
 
-; Perform Several things in Sequence
-(fun {do & l} {
-  if (== l nil)
-    {nil}
-    {last l}
-})
-
-; Open new scope
-(fun {let b} {
-  ((\ {_} b) ())
-})
+; Sequencing ('do') and scoping ('let') are built-in special forms
 
 ; Misc
 (fun {flip f a b} {f b a})
@@ -97,12 +87,7 @@
     {join (if (f (fst l)) {head l} {nil}) (filter f (tail l))}
 })
 
-; Fold Left
-(fun {foldl f z l} {
-  if (== l nil)
-    {z}
-    {foldl f (f z (fst l)) (tail l)}
-})
+; Fold Left ('foldl') is built-in, it also walks lazy sequences
 
 ; Sum and product
 (fun {sum l} {foldl + 0 l})
@@ -0,0 +1,366 @@
+/*
+ * Embedding API
+ *
+ * Handles are plain lvals behind opaque pointer.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "interp.h"
+#include "lenv.h"
+#include "lisp.h"
+#include "lval.h"
+#include "parser.h"
+
+#define V(h) ((lval*)(h))
+#define H(v) ((lisp_value*)(v))
+
+/* Registered native function */
+typedef struct _lnative_entry
+{
+  struct _lnative_entry* next;
+  lisp* l;
+  lisp_native f;
+  void* data;
+} lnative_entry;
+
+struct lisp
+{
+  linterp* interp;
+  lnative_entry* natives;
+};
+
+struct lisp_form
+{
+  lval* forms; // S-expression of all forms or parse error
+};
+
+/* Version library was built with */
+int lisp_version(void)
+{
+  return LISP_API_VERSION;
+}
+
+/*
+ * Interpreter
+ */
+
+/* Create interpreter with built-ins, NULL on failure */
+lisp* lisp_new(void)
+{
+  lisp* l = (lisp*)malloc(sizeof(lisp));
+  if (l == NULL)
+    return NULL;
+
+  l->interp = interp_new();
+  l->natives = NULL;
+  return l;
+}
+
+void lisp_free(lisp* l)
+{
+  interp_del(l->interp);
+
+  /* Functions are gone, so is their data */
+  while (l->natives)
+  {
+    lnative_entry* n = l->natives;
+    l->natives = n->next;
+    free(n);
+  }
+
+  free(l);
+}
+
+/* Load and evaluate file */
+lisp_value* lisp_load(lisp* l, const char* file)
+{
+  return H(interp_load(l->interp, file));
+}
+
+/* Evaluate every expression of source, returns last result */
+lisp_value* lisp_eval(lisp* l, const char* src, size_t len)
+{
+  return H(interp_eval_all(l->interp, src, len));
+}
+
+/* Evaluate NUL-terminated sources, results go into array,
+   returns number of errors */
+size_t lisp_eval_batch(lisp* l, const char* const* srcs,
+  size_t count, lisp_value** results)
+{
+  size_t errors = 0;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    results[i] = lisp_eval(l, srcs[i], strlen(srcs[i]));
+    errors += V(results[i])->type == LVAL_ERROR;
+  }
+
+  return errors;
+}
+
+/* Parse source once to evaluate it many times */
+lisp_form* lisp_parse(lisp* l, const char* src, size_t len)
+{
+  (void)l;
+
+  lisp_form* f = (lisp_form*)malloc(sizeof(lisp_form));
+  f->forms = parse(src, len);
+  return f;
+}
+
+/* Evaluate parsed source, parse errors are returned here */
+lisp_value* lisp_eval_form(lisp* l, const lisp_form* f)
+{
+  if (f->forms->type == LVAL_ERROR)
+    return H(lval_copy(f->forms));
+
+  lval* result = lval_sexpr();
+
+  for (int i = 0; i < f->forms->count; i++)
+  {
+    lval_del(result);
+    result = lval_eval(l->interp->env, lval_copy(f->forms->cell[i]));
+
+    if (result->type == LVAL_ERROR)
+      break;
+  }
+
+  return H(result);
+}
+
+void lisp_form_free(lisp_form* f)
+{
+  lval_del(f->forms);
+  free(f);
+}
+
+/* Bind global name to copy of value, 0 on success */
+int lisp_define(lisp* l, const char* name, const lisp_value* v)
+{
+  lval* k = lval_sym(name);
+  int r = lenv_put(l->interp->env, k, V(v));
+  lval_del(k);
+  return r;
+}
+
+/* Look up global name, error value if it's unbound */
+lisp_value* lisp_lookup(lisp* l, const char* name)
+{
+  lval* k = lval_sym(name);
+  lval* v = lenv_get(l->interp->env, k);
+  lval_del(k);
+  return H(v);
+}
+
+/* Call function with copies of arguments */
+lisp_value* lisp_call(lisp* l, const lisp_value* f,
+  lisp_value* const* args, size_t count)
+{
+  if (V(f)->type != LVAL_FUN)
+    return H(lval_err("Value passed to lisp_call is not a function"));
+
+  lval* a = lval_sexpr();
+  for (size_t i = 0; i < count; i++)
+    lval_add(a, lval_copy(V(args[i])));
+
+  lval* fn = lval_copy(V(f));
+  lval* r = lval_call(l->interp->env, fn, a);
+  lval_del(fn);
+  return H(r);
+}
+
+/* Pass arguments to native function as handles */
+static lval* lisp_trampoline(lenv* e, lval* a, void* data)
+{
+  (void)e;
+
+  lnative_entry* n = (lnative_entry*)data;
+  lisp_value* r = n->f(n->l, (lisp_value* const*)a->cell, a->count, n->data);
+  lval_del(a);
+
+  return r ? V(r) : lval_sexpr();
+}
+
+/* Register native function under global name, 0 on success.
+   Isolates spawned by interpreter don't see it. */
+int lisp_register(lisp* l, const char* name, lisp_native f, void* data)
+{
+  lnative_entry* n = (lnative_entry*)malloc(sizeof(lnative_entry));
+  n->l = l;
+  n->f = f;
+  n->data = data;
+
+  lval* k = lval_sym(name);
+  lval* v = lval_native(lisp_trampoline, n, lval_name(name));
+  int r = lenv_put(l->interp->env, k, v);
+  lval_del(k);
+  lval_del(v);
+
+  if (r)
+  {
+    free(n);
+    return r;
+  }
+
+  n->next = l->natives;
+  l->natives = n;
+  return 0;
+}
+
+/*
+ * Values
+ */
+
+lisp_value* lisp_number(long x)
+{
+  return H(lval_num(x));
+}
+
+lisp_value* lisp_float(double x)
+{
+  return H(lval_fnum(x));
+}
+
+lisp_value* lisp_string(const char* s)
+{
+  return H(lval_str(s));
+}
+
+lisp_value* lisp_symbol(const char* s)
+{
+  return H(lval_sym(s));
+}
+
+lisp_value* lisp_error(const char* msg)
+{
+  return H(lval_err("%s", msg));
+}
+
+/* Create empty Q-expression */
+lisp_value* lisp_list(void)
+{
+  return H(lval_qexpr());
+}
+
+/* Append copy of item to list */
+void lisp_list_push(lisp_value* list, const lisp_value* item)
+{
+  lval_add(V(list), lval_copy(V(item)));
+}
+
+lisp_value* lisp_copy(const lisp_value* v)
+{
+  return H(lval_copy(V(v)));
+}
+
+void lisp_release(lisp_value* v)
+{
+  if (v)
+    lval_del(V(v));
+}
+
+lisp_type lisp_typeof(const lisp_value* v)
+{
+  switch (V(v)->type)
+  {
+    case LVAL_NUMBER:
+      return LISP_NUMBER;
+
+    case LVAL_FNUMBER:
+      return LISP_FLOAT;
+
+    case LVAL_STR:
+      return LISP_STRING;
+
+    case LVAL_SYM:
+      return LISP_SYMBOL;
+
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+      return LISP_LIST;
+
+    case LVAL_FUN:
+      return LISP_FUNCTION;
+
+    case LVAL_ERROR:
+      return LISP_ERROR;
+
+    default:
+      return LISP_OTHER;
+  }
+}
+
+/* Value of number, floats are truncated */
+long lisp_to_number(const lisp_value* v)
+{
+  switch (V(v)->type)
+  {
+    case LVAL_NUMBER:
+      return V(v)->num;
+
+    case LVAL_FNUMBER:
+      return (long)V(v)->fnum;
+
+    default:
+      return 0;
+  }
+}
+
+/* Value of number as float */
+double lisp_to_float(const lisp_value* v)
+{
+  switch (V(v)->type)
+  {
+    case LVAL_NUMBER:
+      return V(v)->num;
+
+    case LVAL_FNUMBER:
+      return V(v)->fnum;
+
+    default:
+      return 0;
+  }
+}
+
+/* Text of string, symbol or error, NULL for other types.
+   Pointer is valid while value is alive. */
+const char* lisp_to_string(const lisp_value* v)
+{
+  switch (V(v)->type)
+  {
+    case LVAL_STR:
+      return lval_cstr(V(v));
+
+    case LVAL_SYM:
+      return V(v)->sym;
+
+    case LVAL_ERROR:
+      return V(v)->err;
+
+    default:
+      return NULL;
+  }
+}
+
+/* Length of list, 0 for other types */
+size_t lisp_length(const lisp_value* v)
+{
+  if (V(v)->type == LVAL_SEXPR || V(v)->type == LVAL_QEXPR)
+    return V(v)->count;
+
+  return 0;
+}
+
+/* Copy of list element */
+lisp_value* lisp_list_get(const lisp_value* list, size_t i)
+{
+  if (i >= lisp_length(list))
+    return H(lval_err("List index %zu out of range", i));
+
+  return H(lval_copy(V(list)->cell[i]));
+}
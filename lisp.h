@@ -0,0 +1,144 @@
+#ifndef __LISP_H__
+#define __LISP_H__
+/*
+ * Embedding API
+ *
+ * Stable interface of liblisp. Everything is reached through
+ * opaque pointers, so internals may change without breaking
+ * programs built against this header. Only symbols declared
+ * here are exported from liblisp.so.
+ *
+ * Interpreter is not thread-safe, each one should be used by
+ * one thread at a time. Value handles are owned by caller and
+ * must be released with lisp_release.
+ *
+ * Library leaves signal dispositions alone. Event loop writes
+ * to sockets without SIGPIPE, but writing to closed pipe raises
+ * it, so host that wants such writes to fail with EPIPE has to
+ * ignore SIGPIPE itself.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define LISP_API __attribute__((visibility("default")))
+#else
+#define LISP_API
+#endif
+
+/* Bumped on incompatible changes */
+#define LISP_API_VERSION 1
+
+typedef struct lisp lisp;
+typedef struct lisp_value lisp_value;
+typedef struct lisp_form lisp_form;
+
+typedef enum
+{
+  LISP_NUMBER,
+  LISP_FLOAT,
+  LISP_STRING,
+  LISP_SYMBOL,
+  LISP_LIST, // Both S- and Q-expressions
+  LISP_FUNCTION,
+  LISP_ERROR,
+  LISP_OTHER // Handles of isolates, futures and so on
+} lisp_type;
+
+/* Native function, arguments belong to interpreter, returned
+   value is taken by it, NULL stands for empty list */
+typedef lisp_value* (*lisp_native)(lisp* l, lisp_value* const* args,
+  size_t count, void* data);
+
+/* Version library was built with */
+LISP_API int lisp_version(void);
+
+/*
+ * Interpreter
+ */
+
+/* Create interpreter with built-ins, NULL on failure */
+LISP_API lisp* lisp_new(void);
+
+LISP_API void lisp_free(lisp* l);
+
+/* Load and evaluate file */
+LISP_API lisp_value* lisp_load(lisp* l, const char* file);
+
+/* Evaluate every expression of source, returns last result */
+LISP_API lisp_value* lisp_eval(lisp* l, const char* src, size_t len);
+
+/* Evaluate NUL-terminated sources, results go into array,
+   returns number of errors */
+LISP_API size_t lisp_eval_batch(lisp* l, const char* const* srcs,
+  size_t count, lisp_value** results);
+
+/* Parse source once to evaluate it many times */
+LISP_API lisp_form* lisp_parse(lisp* l, const char* src, size_t len);
+
+/* Evaluate parsed source, parse errors are returned here */
+LISP_API lisp_value* lisp_eval_form(lisp* l, const lisp_form* f);
+
+LISP_API void lisp_form_free(lisp_form* f);
+
+/* Bind global name to copy of value, 0 on success */
+LISP_API int lisp_define(lisp* l, const char* name, const lisp_value* v);
+
+/* Look up global name, error value if it's unbound */
+LISP_API lisp_value* lisp_lookup(lisp* l, const char* name);
+
+/* Call function with copies of arguments */
+LISP_API lisp_value* lisp_call(lisp* l, const lisp_value* f,
+  lisp_value* const* args, size_t count);
+
+/* Register native function under global name, 0 on success.
+   Isolates spawned by interpreter don't see it. */
+LISP_API int lisp_register(lisp* l, const char* name, lisp_native f, void* data);
+
+/*
+ * Values
+ */
+
+LISP_API lisp_value* lisp_number(long x);
+LISP_API lisp_value* lisp_float(double x);
+LISP_API lisp_value* lisp_string(const char* s);
+LISP_API lisp_value* lisp_symbol(const char* s);
+LISP_API lisp_value* lisp_error(const char* msg);
+
+/* Create empty Q-expression */
+LISP_API lisp_value* lisp_list(void);
+
+/* Append copy of item to list */
+LISP_API void lisp_list_push(lisp_value* list, const lisp_value* item);
+
+LISP_API lisp_value* lisp_copy(const lisp_value* v);
+
+LISP_API void lisp_release(lisp_value* v);
+
+LISP_API lisp_type lisp_typeof(const lisp_value* v);
+
+/* Value of number, floats are truncated */
+LISP_API long lisp_to_number(const lisp_value* v);
+
+/* Value of number as float */
+LISP_API double lisp_to_float(const lisp_value* v);
+
+/* Text of string, symbol or error, NULL for other types.
+   Pointer is valid while value is alive. */
+LISP_API const char* lisp_to_string(const lisp_value* v);
+
+/* Length of list, 0 for other types */
+LISP_API size_t lisp_length(const lisp_value* v);
+
+/* Copy of list element */
+LISP_API lisp_value* lisp_list_get(const lisp_value* list, size_t i);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __LISP_H__
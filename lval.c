@@ -2,22 +2,41 @@
  * Everything About Lisp Values
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include <errno.h>
-
+#include "future.h"
+#include "heap.h"
+#include "isolate.h"
+#include "jit.h"
 #include "lenv.h"
 #include "lval.h"
+#include "profile.h"
+#include "stats.h"
+#include "seq.h"
+#include "strbuf.h"
+#include "trace.h"
+
+/* Allocate value of given type, the rest is up to caller */
+static lval* lval_alloc(lval_type_t type, const char* site)
+{
+  lval* v = (lval*)malloc(sizeof(lval));
+  v->type = type;
+  STAT_INC(allocs[type]);
+  HEAP_ALLOC(v, type, sizeof(lval), site);
+  return v;
+}
 
 /* Create number */
 lval* lval_num(long x)
 {
-  lval* v = (lval*)malloc(sizeof(lval));
-  v->type = LVAL_NUMBER;
+  lval* v = lval_alloc(LVAL_NUMBER, __func__);
   v->num = x;
   return v;
 }
@@ -25,8 +44,7 @@ lval* lval_num(long x)
 /* Create floating-point number */
 lval* lval_fnum(double x)
 {
-  lval* v = (lval*)malloc(sizeof(lval));
-  v->type = LVAL_FNUMBER;
+  lval* v = lval_alloc(LVAL_FNUMBER, __func__);
   v->fnum = x;
   return v;
 }
@@ -36,8 +54,7 @@ lval* lval_err(const char* fmt, ...)
 {
   const int err_len = 512;
 
-  lval* v = (lval*)malloc(sizeof(lval));
-  v->type = LVAL_ERROR;
+  lval* v = lval_alloc(LVAL_ERROR, __func__);
 
   v->err = (char*)malloc(err_len);
 
@@ -54,19 +71,25 @@ lval* lval_err(const char* fmt, ...)
 /* Create symbol */
 lval* lval_sym(const char* x)
 {
-  lval* v = (lval*)malloc(sizeof(lval));
-  v->type = LVAL_SYM;
-  v->sym = malloc(strlen(x)+1);
-  strcpy(v->sym, x);
+  return lval_sym_n(x, strlen(x));
+}
+
+/* Create symbol from first n characters */
+lval* lval_sym_n(const char* x, size_t n)
+{
+  lval* v = lval_alloc(LVAL_SYM, __func__);
+  v->sym = malloc(n+1);
+  memcpy(v->sym, x, n);
+  v->sym[n] = '\0';
   return v;
 }
 
 /* Create S-expression */
 lval* lval_sexpr(void)
 {
-  lval* v = (lval*)malloc(sizeof(lval));
-  v->type = LVAL_SEXPR;
+  lval* v = lval_alloc(LVAL_SEXPR, __func__);
   v->count = 0;
+  v->line = 0;
   v->cell = NULL;
   return v;
 }
@@ -74,9 +97,9 @@ lval* lval_sexpr(void)
 /* Create Q-expression */
 lval* lval_qexpr(void)
 {
-  lval* v = (lval*)malloc(sizeof(lval));
-  v->type = LVAL_QEXPR;
+  lval* v = lval_alloc(LVAL_QEXPR, __func__);
   v->count = 0;
+  v->line = 0;
   v->cell = NULL;
   return v;
 }
@@ -84,11 +107,14 @@ lval* lval_qexpr(void)
 /* Create function */
 lval* lval_fun_ex(lbuiltin f, const char* name, int builtin)
 {
-  lval* v = (lval*)malloc(sizeof(lval));
-  v->type = LVAL_FUN;
+  lval* v = lval_alloc(LVAL_FUN, __func__);
   v->builtin = f;
+  v->special = NULL;
+  v->native = NULL;
+  v->data = NULL;
   v->name = name;
   v->is_builtin = builtin;
+  v->line = 0;
   return v;
 }
 
@@ -97,34 +123,202 @@ lval* lval_fun(lbuiltin f)
   return lval_fun_ex(f, NULL, 0);
 }
 
+/* Create special form */
+lval* lval_special(lbuiltin f, lbuiltin s, const char* name)
+{
+  lval* v = lval_fun_ex(f, name, 1);
+  v->special = s;
+  return v;
+}
+
+/* Create built-in of embedding program, name isn't copied */
+lval* lval_native(lnative f, void* data, const char* name)
+{
+  lval* v = lval_fun_ex(NULL, name, 1);
+  v->native = f;
+  v->data = data;
+  return v;
+}
+
 /* Create lambda */
 lval* lval_lambda(lval* formals, lval* body) 
 {
-  lval* v = (lval*)malloc(sizeof(lval));
-  v->type = LVAL_FUN;
+  lval* v = lval_alloc(LVAL_FUN, __func__);
   v->builtin = NULL;
+  v->special = NULL;
+  v->native = NULL;
+  v->data = NULL;
   v->env = lenv_new();
   v->formals = formals;
   v->body = body;
+  v->name = NULL;
   v->is_builtin = 0;
+  v->jit = jit_new();
+  v->code = NULL;
+  v->line = body->type == LVAL_QEXPR || body->type == LVAL_SEXPR ? body->line : 0;
   return v;
 }
 
+/* Names are never freed, so frames of profiler may point to them */
+static struct
+{
+  pthread_mutex_t lock;
+  char** names;
+  int count;
+  int size;
+} lval_names = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 };
+
+static unsigned lval_name_hash(const char* s)
+{
+  unsigned h = 5381;
+  for (; *s; s++)
+    h = h * 33 + (unsigned char)*s;
+  return h;
+}
+
+/* Interned copy of function name, lives as long as process */
+const char* lval_name(const char* s)
+{
+  pthread_mutex_lock(&lval_names.lock);
+
+  /* Open addressing by string hash */
+  if (lval_names.count * 2 >= lval_names.size)
+  {
+    int size = lval_names.size ? lval_names.size * 2 : 256;
+    char** names = (char**)calloc(size, sizeof(char*));
+
+    for (int i = 0; i < lval_names.size; i++)
+    {
+      char* n = lval_names.names[i];
+      if (n == NULL)
+        continue;
+
+      int k = lval_name_hash(n) & (size - 1);
+      while (names[k])
+        k = (k + 1) & (size - 1);
+      names[k] = n;
+    }
+
+    free(lval_names.names);
+    lval_names.names = names;
+    lval_names.size = size;
+  }
+
+  int k = lval_name_hash(s) & (lval_names.size - 1);
+  while (lval_names.names[k] && strcmp(lval_names.names[k], s))
+    k = (k + 1) & (lval_names.size - 1);
+
+  if (lval_names.names[k] == NULL)
+  {
+    lval_names.names[k] = strdup(s);
+    lval_names.count++;
+  }
+
+  const char* n = lval_names.names[k];
+  pthread_mutex_unlock(&lval_names.lock);
+  return n;
+}
+
 /* Create string */
 lval* lval_str(const char* s) 
 {
-  lval* v = (lval*)malloc(sizeof(lval));
+  return lval_str_n(s, strlen(s));
+}
 
-  v->type = LVAL_STR;
-  v->str = (char*)malloc(strlen(s) + 1);
-  strcpy(v->str, s);
-  
+/* Create string from first n characters */
+lval* lval_str_n(const char* s, size_t n)
+{
+  lstrdata* d = lval_strdata(n);
+  memcpy(d->data, s, n);
+  return lval_str_data(d);
+}
+
+/* Allocate string buffer for n characters, contents are up to caller */
+lstrdata* lval_strdata(size_t n)
+{
+  lstrdata* d = (lstrdata*)malloc(sizeof(lstrdata) + n + 1);
+  atomic_init(&d->refs, 1);
+  d->len = n;
+  d->data[n] = '\0';
+  return d;
+}
+
+/* Create string over whole buffer, takes reference */
+lval* lval_str_data(lstrdata* d)
+{
+  lval* v = lval_alloc(LVAL_STR, __func__);
+  v->str = d->data;
+  v->len = d->len;
+  v->sbuf = d;
+
+  return v;
+}
+
+static void lval_strdata_unref(lstrdata* d)
+{
+  if (atomic_fetch_sub_explicit(&d->refs, 1, memory_order_acq_rel) == 1)
+    free(d);
+}
+
+/* Create string sharing characters of another one */
+lval* lval_str_slice(lval* s, size_t start, size_t len)
+{
+  lval* v = lval_alloc(LVAL_STR, __func__);
+
+  atomic_fetch_add_explicit(&s->sbuf->refs, 1, memory_order_relaxed);
+  v->str = s->str + start;
+  v->len = len;
+  v->sbuf = s->sbuf;
+
+  return v;
+}
+
+/* Characters of string as C string, slice is copied if needed */
+const char* lval_cstr(lval* v)
+{
+  /* Byte after slice is within buffer, it's NUL at its end */
+  if (v->str[v->len] != '\0')
+  {
+    lstrdata* d = lval_strdata(v->len);
+    memcpy(d->data, v->str, v->len);
+
+    lval_strdata_unref(v->sbuf);
+    v->str = d->data;
+    v->sbuf = d;
+  }
+
+  return v->str;
+}
+
+/* Create isolate handle, takes reference */
+lval* lval_isolate(lisolate* s)
+{
+  lval* v = lval_alloc(LVAL_ISOLATE, __func__);
+  v->isolate = s;
+  return v;
+}
+
+/* Create future handle, takes reference */
+lval* lval_future(lfuture* f)
+{
+  lval* v = lval_alloc(LVAL_FUTURE, __func__);
+  v->future = f;
+  return v;
+}
+
+/* Create sequence, takes reference */
+lval* lval_seq(lseq* s)
+{
+  lval* v = lval_alloc(LVAL_SEQ, __func__);
+  v->seq = s;
   return v;
 }
 
 /* Clear memory occupied by lval */
 void lval_del(lval* v)
 {
+  STAT_INC(frees[v->type]);
+
   switch (v->type)
   {
     case LVAL_NUMBER:
@@ -137,6 +331,7 @@ void lval_del(lval* v)
         lenv_del(v->env);
         lval_del(v->formals);
         lval_del(v->body);
+        jit_unref(v->jit);
       }
       break;
 
@@ -149,7 +344,7 @@ void lval_del(lval* v)
       break;
 
     case LVAL_STR:
-      free(v->str);
+      lval_strdata_unref(v->sbuf);
       break;
 
     case LVAL_SEXPR:
@@ -159,19 +354,33 @@ void lval_del(lval* v)
       free(v->cell);
       break;
 
+    case LVAL_ISOLATE:
+      isolate_unref(v->isolate);
+      break;
+
+    case LVAL_FUTURE:
+      future_unref(v->future);
+      break;
+
+    case LVAL_SEQ:
+      seq_unref(v->seq);
+      break;
+
     default:
       fprintf(stderr, "Unknown lval type %d\n", v->type);
       break;
   }
 
+  HEAP_FREE(v);
   free(v);
 }
 
 /* Create a copy of lval */
 lval* lval_copy(lval* v)
 {
-  lval* x = (lval*)malloc(sizeof(lval));
-  x->type = v->type;
+  lval* x = lval_alloc(v->type, __func__);
+  STAT_INC(copies);
+  STAT_ADD(copy_bytes, sizeof(lval));
 
   switch (v->type)
   {
@@ -180,11 +389,23 @@ lval* lval_copy(lval* v)
       if (v->is_builtin) 
       {
         x->builtin = v->builtin;
+        x->special = v->special;
+        x->native = v->native;
+        x->data = v->data;
         x->name = v->name;
+        x->line = 0;
       } else {
+        x->builtin = NULL;
+        x->special = NULL;
+        x->native = NULL;
+        x->data = NULL;
+        x->name = v->name;
+        x->line = v->line;
         x->env = lenv_copy(v->env);
         x->formals = lval_copy(v->formals);
         x->body = lval_copy(v->body);
+        x->jit = jit_ref(v->jit);
+        x->code = v->code;
       }
       break;
 
@@ -199,27 +420,46 @@ lval* lval_copy(lval* v)
     case LVAL_ERROR:
       x->err = (char*)malloc(strlen(v->err)+1);
       strcpy(x->err, v->err);
+      STAT_ADD(copy_bytes, strlen(v->err) + 1);
       break;
 
     case LVAL_SYM:
       x->sym = (char*)malloc(strlen(v->sym)+1);
       strcpy(x->sym, v->sym);
+      STAT_ADD(copy_bytes, strlen(v->sym) + 1);
       break;
 
     case LVAL_STR:
-      x->str = (char*)malloc(strlen(v->str)+1);
-      strcpy(x->str, v->str);
+      atomic_fetch_add_explicit(&v->sbuf->refs, 1, memory_order_relaxed);
+      x->str = v->str;
+      x->len = v->len;
+      x->sbuf = v->sbuf;
       break;
 
     case LVAL_SEXPR:
     case LVAL_QEXPR:
       x->count = v->count;
+      x->line = v->line;
       x->cell = (lval**)malloc(sizeof(lval*)*v->count);
+      STAT_ADD(copy_bytes, sizeof(lval*) * v->count);
       for (int i = 0; i < v->count; i++)
         x->cell[i] = lval_copy(v->cell[i]);
       break;
 
+    case LVAL_ISOLATE:
+      x->isolate = isolate_ref(v->isolate);
+      break;
+
+    case LVAL_FUTURE:
+      x->future = future_ref(v->future);
+      break;
+
+    case LVAL_SEQ:
+      x->seq = seq_ref(v->seq);
+      break;
+
     default:
+      HEAP_FREE(x);
       free(x);
       x = lval_err("Cannot copy unknown type!");
       break;
@@ -228,33 +468,6 @@ lval* lval_copy(lval* v)
  return x;
 }
 
-lval* lval_read_num(tree* t)
-{
-  errno = 0;
-  long x = strtol((char*)t->value, NULL, 10);
-  return errno != ERANGE ? lval_num(x) : lval_err("Invalid number");
-}
-
-lval* lval_read_fnum(tree* t)
-{
-  errno = 0;
-  double x = strtod((char*)t->value, NULL);
-  return errno != ERANGE ? lval_fnum(x) : lval_err("Invalid floating number");
-}
-
-lval* lval_read_str(tree* t) 
-{
-  char* contents = (char*)t->value;
-  contents[strlen(contents)-1] = '\0';
-  char* unescaped = (char*)malloc(strlen(contents+1)+1);
-  strcpy(unescaped, contents+1);
-  //TODO: unescape
-  //unescaped = mpcf_unescape(unescaped);
-  lval* str = lval_str(unescaped);
-  free(unescaped);
-  return str;
-}
-
 lval* lval_add(lval* v, lval* x)
 {
   v->count++;
@@ -263,37 +476,6 @@ lval* lval_add(lval* v, lval* x)
   return v;
 }
 
-lval* lval_read(tree* t)
-{
-  if (t->type == NODE_CINT) 
-    return lval_read_num(t);
-
-  if (t->type == NODE_CFLOAT) 
-    return lval_read_fnum(t);
-
-  if (t->type == NODE_CSTRING) 
-    return lval_read_str(t);
-
-  if (t->type == NODE_IDENTIFIER) 
-    return lval_sym((char*)t->value);
-
-  lval* x = NULL;
-  if (t->type == NODE_VAR_DECL) 
-    x = lval_sexpr();
-  else if (t->type == NODE_CONST_DECL)
-    x = lval_qexpr();
-  else
-    return lval_err("Error parsing expression!");
-
-  tree* list = t->value;
-  while (list != NULL)
-  {
-    x = lval_add(x, lval_read(list->value));
-    list = list->next;
-  }
-  return x;
-}
-
 const char* ltype_name(lval_type_t t)
 {
   switch (t)
@@ -321,94 +503,135 @@ const char* ltype_name(lval_type_t t)
 
     case LVAL_QEXPR:
       return "Q-Expression";
+
+    case LVAL_ISOLATE:
+      return "Isolate";
+
+    case LVAL_FUTURE:
+      return "Future";
+
+    case LVAL_SEQ:
+      return "Sequence";
   }
 
   return "Unknown";
 }
 
-void lval_expr_print(lval* v, char open, char close)
+void lval_expr_write(lstrbuf* b, lval* v, char open, char close)
 {
-  fputc(open, stdout);
+  strbuf_putc(b, open);
 
   for (int i = 0; i < v->count; i++)
   {
-    lval_print(v->cell[i]);
+    lval_write(b, v->cell[i]);
     
     if (i < v->count-1)
-      fputc(' ', stdout);
+      strbuf_putc(b, ' ');
   }
 
-  fputc(close, stdout);
+  strbuf_putc(b, close);
 }
 
-/* Print string */
-void lval_print_str(lval* v) 
+void lval_write_str(lstrbuf* b, lval* v) 
 {
-  char* escaped = malloc(strlen(v->str)+1);
-  strcpy(escaped, v->str);
   // TODO: escape!
-  //escaped = mpcf_escape(escaped);
-  fprintf(stdout, "\"%s\"", escaped);
-  free(escaped);
+  strbuf_putc(b, '"');
+  strbuf_put(b, v->str, v->len);
+  strbuf_putc(b, '"');
 }
 
-/* Print lval */
-void lval_print(lval* v)
+void lval_write(lstrbuf* b, lval* v)
 {
   switch (v->type)
   {
     case LVAL_NUMBER:
-      fprintf(stdout, "%li", v->num);
+      strbuf_num(b, v->num);
       break;
 
     case LVAL_FNUMBER:
-      fprintf(stdout, "%lf", v->fnum);
+      strbuf_printf(b, "%lf", v->fnum);
       break;
 
     case LVAL_ERROR:
-      fprintf(stdout, "Error: %s\n", v->err);
+      strbuf_puts(b, "Error: ");
+      strbuf_puts(b, v->err);
+      strbuf_putc(b, '\n');
       break;
 
     case LVAL_SYM:
-      fprintf(stdout, "%s", v->sym);
+      strbuf_puts(b, v->sym);
       break;
 
     case LVAL_STR:
-      lval_print_str(v);
+      lval_write_str(b, v);
       break;
 
     case LVAL_SEXPR:
-      lval_expr_print(v, '(', ')');
+      lval_expr_write(b, v, '(', ')');
       break;
 
     case LVAL_QEXPR:
-      lval_expr_print(v, '{', '}');
+      lval_expr_write(b, v, '{', '}');
+      break;
+
+    case LVAL_ISOLATE:
+      strbuf_printf(b, "<isolate %d>", v->isolate->id);
+      break;
+
+    case LVAL_FUTURE:
+      strbuf_printf(b, "<future %s>", future_ready(v->future) ? "ready" : "pending");
+      break;
+
+    case LVAL_SEQ:
+      strbuf_puts(b, "<seq>");
       break;
 
     case LVAL_FUN:
-      if (v->builtin) 
+      if (v->builtin || v->native) 
       {
-        fprintf(stdout, "<builtin function '%s'>", v->name);
+        strbuf_printf(b, "<builtin function '%s'>", v->name);
       } else {
-        fprintf(stdout, "<function> (\\ "); 
-        lval_print(v->formals);
-        fputc(' ', stdout); 
-        lval_print(v->body); 
-        fputc(')', stdout);
+        strbuf_puts(b, "<function> (\\ "); 
+        lval_write(b, v->formals);
+        strbuf_putc(b, ' '); 
+        lval_write(b, v->body); 
+        strbuf_putc(b, ')');
       }
       break;
 
     default:
-      fprintf(stdout, "Unknown lval %d\n", v->type);
+      strbuf_printf(b, "Unknown lval %d\n", v->type);
       break;
   }
 }
 
-/* Print lval and newline */
+/* Render value and write it out at once */
+static void lval_output(FILE* out, lval* v, int newline)
+{
+  lstrbuf b;
+  strbuf_init(&b);
+
+  lval_write(&b, v);
+  if (newline)
+    strbuf_putc(&b, '\n');
+
+  fwrite(b.data, 1, b.len, out);
+  strbuf_free(&b);
+}
+
+void lval_fprint(FILE* out, lval* v)
+{
+  lval_output(out, v, 0);
+}
+
+void lval_print(lval* v)
+{
+  lval_output(stdout, v, 0);
+}
+
 void lval_println(lval* v)
 {
-  lval_print(v);
-  fputc('\n', stdout);
+  lval_output(stdout, v, 1);
 }
 
 lval* lval_pop(lval* v, int i)
@@ -457,11 +680,12 @@ int lval_eq(lval* x, lval* y)
     case LVAL_SYM: 
       return !strcmp(x->sym, y->sym);
     case LVAL_STR: 
-      return !strcmp(x->str, y->str);
+      return x->len == y->len && !memcmp(x->str, y->str, x->len);
 
     case LVAL_FUN:
       if (x->is_builtin || y->is_builtin)
-        return x->builtin == y->builtin;
+        return x->builtin == y->builtin
+          && x->native == y->native && x->data == y->data;
       else
         return lval_eq(x->formals, y->formals)
           && lval_eq(x->body, y->body);
@@ -474,6 +698,15 @@ int lval_eq(lval* x, lval* y)
         if (!lval_eq(x->cell[i], y->cell[i]))
           return 0;
       return 1;
+
+    case LVAL_ISOLATE:
+      return x->isolate == y->isolate;
+
+    case LVAL_FUTURE:
+      return x->future == y->future;
+
+    case LVAL_SEQ:
+      return x->seq == y->seq;
   }
 
   return 0;
@@ -511,15 +744,31 @@ lval* lval_eval_sexpr(lenv* e, lval* v)
 {
   assert(v->type == LVAL_SEXPR);
 
-#if 0
-  fprintf(stdout, "Evaluating expression ");
-  lval_println(v);
-#endif
+  /* Evaluate head first, special forms take the rest unevaluated */
+  if (v->count > 1)
+  {
+    v->cell[0] = lval_eval(e, v->cell[0]);
+
+    lval* h = v->cell[0];
+    if (h->type == LVAL_FUN && h->is_builtin && h->special)
+    {
+      lval* f = lval_pop(v, 0);
+      lval* result = f->special(e, v);
+      lval_del(f);
+      return result;
+    }
+  }
 
   /* Evaluate children */
-  for (int i = 0; i < v->count; i++)
+  for (int i = (v->count > 1); i < v->count; i++)
     v->cell[i] = lval_eval(e, v->cell[i]);
 
+  return lval_eval_call(e, v);
+}
+
+/* Call head of S-expression with evaluated elements */
+lval* lval_eval_call(lenv* e, lval* v)
+{
   /* Check for errors */
   for (int i = 0; i < v->count; i++)
     if (v->cell[i]->type == LVAL_ERROR)
@@ -548,10 +797,16 @@ lval* lval_eval_sexpr(lenv* e, lval* v)
   return result;
 }
 
-lval* lval_call(lenv* e, lval* f, lval* a) 
+/* Call function without profiling and tracing */
+static lval* lval_apply(lenv* e, lval* f, lval* a)
 {
   if (f->is_builtin) 
-    return f->builtin(e, a);
+  {
+    STAT_INC(builtin_calls);
+    return f->native ? f->native(e, a, f->data) : f->builtin(e, a);
+  }
+
+  STAT_INC(lambda_calls);
 
   int given = a->count;
   int total = f->formals->count;
@@ -618,6 +873,15 @@ lval* lval_call(lenv* e, lval* f, lval* a)
   if (f->formals->count == 0) 
   {
     f->env->parent = e;
+
+    lval* x = f->code ? f->code(f->env) : NULL;
+    if (x)
+      return x;
+
+    x = f->jit ? jit_run(f) : NULL;
+    if (x)
+      return x;
+
     return builtin_eval(
       f->env, 
       lval_add(lval_sexpr(), lval_copy(f->body))
@@ -627,12 +891,34 @@ lval* lval_call(lenv* e, lval* f, lval* a)
   }
 }
 
-lval* lval_eval(lenv* e, lval* v)
+lval* lval_call(lenv* e, lval* f, lval* a)
 {
-#if 0
-  fprintf(stdout, "Evaluating %d\n", v->type);
-#endif
+  int profiled = profile_on();
+  int traced = trace_on();
+  if (!profiled && !traced)
+    return lval_apply(e, f, a);
+
+  /* Application takes formals away, keep what exit event needs */
+  const char* name = f->name;
+  int line = f->line;
+  int builtin = f->is_builtin;
+
+  if (profiled)
+    profile_push(name, line);
+  if (traced)
+    trace_event(TRACE_ENTER, name, line, a->count, builtin);
+
+  lval* x = lval_apply(e, f, a);
+
+  if (traced)
+    trace_event(x->type == LVAL_ERROR ? TRACE_ERROR : TRACE_EXIT, name, line, 0, builtin);
+  if (profiled)
+    profile_pop();
+  return x;
+}
 
+lval* lval_eval(lenv* e, lval* v)
+{
   if (v->type == LVAL_SYM)
   {
     lval* x = lenv_get(e, v);
@@ -641,9 +927,84 @@ lval* lval_eval(lenv* e, lval* v)
   }
 
   if (v->type == LVAL_SEXPR)
-    return lval_eval_sexpr(e, v);
+  {
+    STAT_ENTER();
+    lval* x = lval_eval_sexpr(e, v);
+    STAT_LEAVE();
+    return x;
+  }
 
   /* All other types remain the same */
   return v;
 }
 
+/* Evaluate branch of special form, Q-expression is treated as body */
+lval* lval_eval_body(lenv* e, lval* v)
+{
+  if (v->type == LVAL_QEXPR)
+    v->type = LVAL_SEXPR;
+
+  return lval_eval(e, v);
+}
+
+/* Same as lval_eval_sexpr, but only results are allocated */
+static lval* lval_eval_list_ref(lenv* e, lval* v)
+{
+  lval* x = lval_sexpr();
+  if (v->count == 0)
+    return x;
+
+  x->count = v->count;
+  x->cell = (lval**)malloc(sizeof(lval*) * x->count);
+
+  /* Evaluate head first, special forms take copy of the rest */
+  int i = 0;
+  if (v->count > 1)
+  {
+    lval* h = lval_eval_ref(e, v->cell[0]);
+    if (h->type == LVAL_FUN && h->is_builtin && h->special)
+    {
+      x->count = 0;
+      for (i = 1; i < v->count; i++)
+        x->cell[x->count++] = lval_copy(v->cell[i]);
+
+      lval* result = h->special(e, x);
+      lval_del(h);
+      return result;
+    }
+
+    x->cell[i++] = h;
+  }
+
+  for (; i < v->count; i++)
+    x->cell[i] = lval_eval_ref(e, v->cell[i]);
+
+  return lval_eval_call(e, x);
+}
+
+lval* lval_eval_ref(lenv* e, lval* v)
+{
+  if (v->type == LVAL_SYM)
+    return lenv_get(e, v);
+
+  if (v->type == LVAL_SEXPR)
+  {
+    STAT_ENTER();
+    lval* x = lval_eval_list_ref(e, v);
+    STAT_LEAVE();
+    return x;
+  }
+
+  return lval_copy(v);
+}
+
+lval* lval_eval_body_ref(lenv* e, lval* v)
+{
+  if (v->type != LVAL_QEXPR)
+    return lval_eval_ref(e, v);
+
+  STAT_ENTER();
+  lval* x = lval_eval_list_ref(e, v);
+  STAT_LEAVE();
+  return x;
+}
@@ -7,7 +7,9 @@
 #include "common.h"
 #include "builtins.h"
 
-#include "tree.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
 
 /* Possible lval types */
 typedef enum 
@@ -19,26 +21,52 @@ typedef enum
   LVAL_ERROR, // Error
   LVAL_SYM, // Symbol (variable)
   LVAL_SEXPR, // S-expression
-  LVAL_QEXPR // Q-expression
+  LVAL_QEXPR, // Q-expression
+  LVAL_ISOLATE, // Handle of isolate
+  LVAL_FUTURE, // Result of asynchronous evaluation
+  LVAL_SEQ // Lazy sequence
 } lval_type_t;
 
+#define LVAL_TYPE_COUNT (LVAL_SEQ + 1)
+
+/* Refcounted string buffer, strings are slices of it */
+typedef struct _lstrdata
+{
+  atomic_int refs;
+  size_t len;
+  char data[]; // NUL-terminated
+} lstrdata;
+
 /* Structure that holds value of operation */
 typedef struct _lval
 {
   lval_type_t type;
+  int line; // Source line of list or lambda body, 0 if unknown
   union {
     long num;
     char* err;
     char* sym;
-    char* str;
     double fnum;
+    struct {
+      char* str; // Start of slice, may be not NUL-terminated
+      size_t len;
+      lstrdata* sbuf;
+    };
+    struct _lisolate* isolate;
+    struct _lfuture* future;
+    struct _lseq* seq;
     struct {
       lbuiltin builtin;
-      const char* name;
+      lbuiltin special; // Special form, receives arguments unevaluated
+      lnative native; // Built-in of embedding program
+      void* data; // Its data
+      const char* name; // Lambdas get it from 'def', interned
       int is_builtin;
       lenv* env;
       lval* formals;
       lval* body;
+      struct _ljit* jit; // Shared by copies of lambda, NULL if JIT is off
+      lcompiled code; // Body compiled ahead of time, NULL if none
     };
     struct {
       int count;
@@ -59,6 +87,9 @@ lval* lval_err(const char* fmt, ...);
 /* Create symbol */
 lval* lval_sym(const char* x);
 
+/* Create symbol from first n characters */
+lval* lval_sym_n(const char* x, size_t n);
+
 /* Create S-expression */
 lval* lval_sexpr(void);
 
@@ -70,34 +101,66 @@ lval* lval_fun_ex(lbuiltin f, const char* name, int builtin);
 
 lval* lval_fun(lbuiltin f);
 
+/* Create special form */
+lval* lval_special(lbuiltin f, lbuiltin s, const char* name);
+
+/* Create built-in of embedding program, name isn't copied */
+lval* lval_native(lnative f, void* data, const char* name);
+
 /* Create lambda */
 lval* lval_lambda(lval* formals, lval* body);
 
+/* Interned copy of function name, lives as long as process */
+const char* lval_name(const char* s);
+
 /* Create string */
 lval* lval_str(const char* s);
 
+/* Create string from first n characters */
+lval* lval_str_n(const char* s, size_t n);
+
+/* Allocate string buffer for n characters, contents are up to caller */
+lstrdata* lval_strdata(size_t n);
+
+/* Create string over whole buffer, takes reference */
+lval* lval_str_data(lstrdata* d);
+
+/* Create string sharing characters of another one */
+lval* lval_str_slice(lval* s, size_t start, size_t len);
+
+/* Characters of string as C string, slice is copied if needed */
+const char* lval_cstr(lval* v);
+
+/* Create isolate handle, takes reference */
+lval* lval_isolate(struct _lisolate* s);
+
+/* Create future handle, takes reference */
+lval* lval_future(struct _lfuture* f);
+
+/* Create sequence, takes reference */
+lval* lval_seq(struct _lseq* s);
+
 /* Clear memory occupied by lval */
 void lval_del(lval* v);
 
 /* Create a copy of lval */
 lval* lval_copy(lval* v);
 
-lval* lval_read_num(tree* t);
-
-lval* lval_read_fnum(tree* t);
-
-lval* lval_read_str(tree* t);
-
 lval* lval_add(lval* v, lval* x);
 
-lval* lval_read(tree* t);
-
 const char* ltype_name(lval_type_t t);
 
-void lval_expr_print(lval* v, char open, char close);
+/* Render list between brackets */
+void lval_expr_write(struct _lstrbuf* b, lval* v, char open, char close);
 
-/* Print string */
-void lval_print_str(lval* v);
+/* Render string */
+void lval_write_str(struct _lstrbuf* b, lval* v);
+
+/* Render lval into string builder */
+void lval_write(struct _lstrbuf* b, lval* v);
+
+/* Print lval to stream */
+void lval_fprint(FILE* out, lval* v);
 
 /* Print lval */
 void lval_print(lval* v);
@@ -118,8 +181,20 @@ int lval_less(lval* a, lval* b);
 
 lval* lval_eval_sexpr(lenv* e, lval* v);
 
+/* Call head of S-expression with evaluated elements */
+lval* lval_eval_call(lenv* e, lval* v);
+
 lval* lval_call(lenv* e, lval* f, lval* a);
 
 lval* lval_eval(lenv* e, lval* v);
 
+/* Evaluate branch of special form, Q-expression is treated as body */
+lval* lval_eval_body(lenv* e, lval* v);
+
+/* Evaluate value without taking it, for code run many times */
+lval* lval_eval_ref(lenv* e, lval* v);
+
+/* Evaluate branch of special form without taking it */
+lval* lval_eval_body_ref(lenv* e, lval* v);
+
 #endif // __LVAL_H__
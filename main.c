@@ -1,13 +1,21 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <errno.h>
+#include <signal.h>
 
-#include "tree.h"
 #include "lval.h"
-#include "lenv.h"
-#include "builtins.h"
-#include "parser.h"
+#include "aot.h"
+#include "heap.h"
+#include "interp.h"
+#include "jit.h"
+#include "profile.h"
+#include "stats.h"
+#include "server.h"
+#include "trace.h"
 
 #ifdef _WIN32
 
@@ -47,6 +55,8 @@ void add_history(const char* line)
 
 #else
 
+#include <unistd.h>
+
 #include <readline/readline.h>
 #include <readline/history.h>
 
@@ -59,36 +69,238 @@ const char* copyright =
   "under certain conditions; type \"show c\" for details.\n"
   ;
 
+const char* usage =
+  "Usage: lisp [--image FILE] [--profile FILE] [--metrics FILE] [--heap FILE]"
+  " [--trace FILE] [--jit | --no-jit]"
+  " [--serve SOCKET [--workers N] [--max-requests N]] [FILE...]\n"
+  "       lisp --compile FILE... -o OUT\n";
+
+/* Seconds between dumps of metrics */
+#define METRICS_INTERVAL 10
+
+/* Report objects interpreter didn't free, "-" stands for stderr */
+static void heap_finish(const char* name)
+{
+  FILE* out = strcmp(name, "-") ? fopen(name, "w") : stderr;
+  if (out == NULL)
+  {
+    fprintf(stderr, "Can't write heap report to '%s': %s\n", name, strerror(errno));
+    return;
+  }
+
+  heap_report(out);
+
+  if (out != stderr)
+    fclose(out);
+}
+
+/* Trace was dumped because of error, keep it */
+static int trace_kept;
+
+/* Write call trace, on error it replaces trace of earlier one */
+static void trace_finish(const char* name, lval* x)
+{
+  if (x && x->type != LVAL_ERROR)
+    return;
+  if (x == NULL && trace_kept)
+    return;
+
+  if (trace_dump(name) < 0)
+    fprintf(stderr, "Can't write trace to '%s': %s\n", name, strerror(errno));
+
+  if (x)
+    trace_kept = 1;
+}
+
+/* Samples per second of CPU time */
+#define PROFILE_HZ 997
+
+/* Stop profiler and write what it collected */
+static void profile_finish(const char* name)
+{
+  profile_stop();
+
+  FILE* out = fopen(name, "w");
+  if (out == NULL || profile_write(out) < 0)
+    fprintf(stderr, "Can't write profile to '%s': %s\n", name, strerror(errno));
+
+  if (out)
+    fclose(out);
+}
+
+/* Translate files into executable, shared object or C source */
+static int compile_main(int argc, char* argv[])
+{
+  const char* out = NULL;
+  const char** files = (const char**)malloc(sizeof(char*) * (argc + 1));
+  int count = 0;
+
+  for (int i = 0; i < argc; i++)
+    if (!strcmp(argv[i], "-o") && i + 1 < argc)
+      out = argv[++i];
+    else
+      files[count++] = argv[i];
+
+  if (out == NULL || count == 0)
+  {
+    free(files);
+    fputs(usage, stderr);
+    return 1;
+  }
+
+  lval* x = aot_compile(files, count, out);
+  int status = x->type == LVAL_ERROR;
+  if (status)
+    lval_println(x);
+
+  lval_del(x);
+  free(files);
+  return status;
+}
+
 int main(int argc, char* argv[])
 {
+  const char* image = NULL;
+  const char* serve = NULL;
+  const char* profile = NULL;
+  const char* metrics = NULL;
+  const char* heap = NULL;
+  const char* trace = NULL;
+  int workers = 0;
+  int max_requests = 0;
+
+  /* Writes to closed pipes and peers should fail, not kill interpreter */
+  signal(SIGPIPE, SIG_IGN);
+
+  /* Options come before files, all but switches take value */
+  int first = 1;
+  while (first < argc && !strncmp(argv[first], "--", 2))
+  {
+    if (!strcmp(argv[first], "--compile"))
+      return compile_main(argc - first - 1, argv + first + 1);
+
+    if (!strcmp(argv[first], "--jit") || !strcmp(argv[first], "--no-jit"))
+    {
+      if (jit_enable(argv[first][2] == 'j') < 0)
+        fputs("JIT isn't supported on this platform\n", stderr);
+      first++;
+      continue;
+    }
+
+    if (first + 1 >= argc)
+    {
+      fputs(usage, stderr);
+      return 1;
+    }
+
+    const char* opt = argv[first];
+    const char* val = argv[first + 1];
+
+    if (!strcmp(opt, "--image"))
+      image = val;
+    else if (!strcmp(opt, "--profile"))
+      profile = val;
+    else if (!strcmp(opt, "--heap"))
+      heap = val;
+    else if (!strcmp(opt, "--trace"))
+      trace = val;
+    else if (!strcmp(opt, "--metrics"))
+      metrics = val;
+    else if (!strcmp(opt, "--serve"))
+      serve = val;
+    else if (!strcmp(opt, "--workers"))
+      workers = atoi(val);
+    else if (!strcmp(opt, "--max-requests"))
+      max_requests = atoi(val);
+    else
+    {
+      fputs(usage, stderr);
+      return 1;
+    }
+
+    first += 2;
+  }
+
+#ifndef _WIN32
+  /* Output isn't interactive, write it in large blocks */
+  if (!isatty(STDOUT_FILENO))
+    setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+#endif
+
   fputs (copyright, stdout);
   fputs ("Press Ctrl+C to exit prompt\n\n", stdout);
 
-#ifdef DEBUG
-  yydebug = 1;
-#endif
+  /* Track from the start, so everything interpreter makes is seen */
+  if (heap && heap_start() < 0)
+  {
+    fputs("Heap tracking is compiled out\n", stderr);
+    heap = NULL;
+  }
+
+  linterp* interp = interp_new();
+
+  if (metrics && stats_dump_start(metrics, METRICS_INTERVAL) < 0)
+    fprintf(stderr, "Can't write metrics to '%s': %s\n", metrics, strerror(errno));
 
-  lenv* e = lenv_new();
-  lenv_add_builtins(e);
+  if (profile && profile_start(PROFILE_HZ) < 0)
+  {
+    perror("Can't start profiler");
+    profile = NULL;
+  }
+
+  /* SIGUSR2 dumps trace at any moment */
+  if (trace && trace_start(trace) < 0)
+  {
+    perror("Can't start trace");
+    trace = NULL;
+  }
+
+  /* Start from saved image */
+  if (image)
+  {
+    lval* x = interp_load_image(interp, image);
+
+    if (x->type == LVAL_ERROR)
+      lval_println(x);
+
+    lval_del(x);
+  }
 
   /* Supplied with list of files */
-  if (argc >= 2) {
-    /* loop over each supplied filename (starting from 1) */
-    for (int i = 1; i < argc; i++) 
+  if (argc > first) {
+    /* loop over each supplied filename */
+    for (int i = first; i < argc; i++) 
     {
-      /* Argument list with a single argument, the filename */
-      lval* args = lval_add(lval_sexpr(), lval_str(argv[i]));
-  
-      /* Pass to builtin load and get the result */
-      lval* x = builtin_load(e, args);
+      /* Load file and get the result */
+      lval* x = interp_load(interp, argv[i]);
   
       /* If the result is an error be sure to print it */
       if (x->type == LVAL_ERROR) 
         lval_println(x);
 
+      if (trace)
+        trace_finish(trace, x);
+
       lval_del(x);
     }
-  } else {
+  }
+
+  if (serve)
+  {
+    /* Files loaded above are prelude shared by workers */
+    int status = server_run(interp, serve, workers, max_requests);
+    if (trace)
+      trace_finish(trace, NULL);
+    interp_del(interp);
+    if (profile)
+      profile_finish(profile);
+    stats_dump_stop();
+    if (heap)
+      heap_finish(heap);
+    return status;
+  }
+  else if (argc <= first)
+  {
     /* Never-ending prompt */
     while (1)
     {
@@ -105,24 +317,29 @@ int main(int argc, char* argv[])
       /* Add line to history */
       add_history(input);
   
-      /* Parse string */
-      tree* root = parse_and_free(input);
-  
-      /* Convert input into S-expr */
-      lval* x = lval_read(root);
-      //lval_println(x);
-      x = lval_eval(e, x);
-  
-      /* Free string pool used by parser */
-      parser_free_pool();
+      /* Parse string into S-expr and evaluate */
+      lval* x = interp_eval(interp, input, strlen(input));
+      free(input);
   
       /* Perform calculation */
       lval_println(x);
+
+      if (trace)
+        trace_finish(trace, x);
       lval_del(x);
     }
   }
 
-  lenv_del(e);
+  if (trace)
+    trace_finish(trace, NULL);
+
+  interp_del(interp);
+
+  if (profile)
+    profile_finish(profile);
+  stats_dump_stop();
+  if (heap)
+    heap_finish(heap);
 
   return 0;
 }
@@ -1,27 +1,399 @@
 /*
  * Parser stuff
+ *
+ * Single-pass recursive descent reader, builds
+ * Lisp values directly from the input buffer.
  */
 
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <errno.h>
+
+#include "lval.h"
 #include "parser.h"
 
-extern tree* root;
+/* Longest floating-point literal we bother to read */
+#define FNUM_MAX_LEN 512
+
+/* Initial size of scratch stack */
+#define STACK_MIN_SIZE 64
+
+/* Limit on nesting to keep malformed input from exhausting stack */
+#define PARSER_MAX_DEPTH 10000
+
+static lval* parser_expr(lparser* p);
 
-typedef struct yy_buffer_state* YY_BUFFER_STATE;
-extern int yyparse();
-extern YY_BUFFER_STATE yy_scan_string(const char* str);
-extern void yy_delete_buffer(YY_BUFFER_STATE buffer);
+/* Start parsing of buffer */
+void parser_init(lparser* p, const char* input, size_t len)
+{
+  p->pos = input;
+  p->end = input + len;
+  p->line_start = input;
+  p->line = 1;
+  p->depth = 0;
+  p->stack = NULL;
+  p->stack_count = 0;
+  p->stack_size = 0;
+}
+
+/* Release memory held by parser */
+void parser_free(lparser* p)
+{
+  for (int i = 0; i < p->stack_count; i++)
+    lval_del(p->stack[i]);
+
+  free(p->stack);
+
+  p->stack = NULL;
+  p->stack_count = 0;
+  p->stack_size = 0;
+}
+
+/* Push list element to scratch stack, growing it geometrically */
+static void parser_push(lparser* p, lval* x)
+{
+  if (p->stack_count == p->stack_size)
+  {
+    p->stack_size = p->stack_size ? p->stack_size * 2 : STACK_MIN_SIZE;
+    p->stack = realloc(p->stack, sizeof(lval*) * p->stack_size);
+  }
+
+  p->stack[p->stack_count++] = x;
+}
 
-tree* parse_and_free(char* input)
+/* Move elements above base from scratch stack into list */
+static lval* parser_pop(lparser* p, lval* x, int base)
 {
-  /* Parse */
-  YY_BUFFER_STATE buffer = yy_scan_string(input);
-  yyparse();
-  yy_delete_buffer(buffer);
+  x->count = p->stack_count - base;
+  x->cell = (lval**)malloc(sizeof(lval*) * x->count);
+  memcpy(x->cell, &p->stack[base], sizeof(lval*) * x->count);
+
+  p->stack_count = base;
+
+  return x;
+}
+
+/* Drop elements above base */
+static void parser_drop(lparser* p, int base)
+{
+  while (p->stack_count > base)
+    lval_del(p->stack[--p->stack_count]);
+}
+
+/* Report error at given position of current line and stop parsing */
+static lval* parser_error(lparser* p, const char* at, const char* fmt, ...)
+{
+  char msg[256];
+
+  va_list va;
+  va_start(va, fmt);
+  vsnprintf(msg, sizeof(msg), fmt, va);
+  va_end(va);
+
+  lval* err = lval_err("Parse error at %d:%d: %s",
+    p->line, (int)(at - p->line_start) + 1, msg);
+
+  p->pos = p->end;
+
+  return err;
+}
+
+static int parser_is_digit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+static int parser_is_symbol(char c)
+{
+  if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || parser_is_digit(c))
+    return 1;
+
+  switch (c)
+  {
+    case '_': case '+': case '-': case '*': case '/': case '\\':
+    case '=': case '<': case '>': case '!': case '&': case '|':
+    case '^': case '%': case '?': case '.':
+      return 1;
+  }
+
+  return 0;
+}
+
+/* Skip whitespaces and comments */
+static void parser_skip(lparser* p)
+{
+  while (p->pos < p->end)
+  {
+    switch (*p->pos)
+    {
+      case '\n':
+        p->line++;
+        p->line_start = ++p->pos;
+        break;
+
+      case ' ':
+      case '\t':
+      case '\r':
+        p->pos++;
+        break;
+
+      case ';':
+        while (p->pos < p->end && *p->pos != '\n')
+          p->pos++;
+        break;
+
+      default:
+        return;
+    }
+  }
+}
+
+/* Check for integer literal: [+-]?digits */
+static int parser_is_num(const char* s, const char* e)
+{
+  if (s < e && (*s == '+' || *s == '-'))
+    s++;
+
+  if (s == e)
+    return 0;
+
+  while (s < e && parser_is_digit(*s))
+    s++;
+
+  return s == e;
+}
+
+/* Check for real literal: [+-]?(d+.d*|d*.d+)(e[+-]?d+)? */
+static int parser_is_fnum(const char* s, const char* e)
+{
+  int digits = 0;
+
+  if (s < e && (*s == '+' || *s == '-'))
+    s++;
+
+  while (s < e && parser_is_digit(*s))
+    s++, digits++;
+
+  if (s == e || *s != '.')
+    return 0;
+  s++;
+
+  while (s < e && parser_is_digit(*s))
+    s++, digits++;
+
+  if (!digits)
+    return 0;
+
+  if (s < e && (*s == 'e' || *s == 'E'))
+  {
+    s++;
+    if (s < e && (*s == '+' || *s == '-'))
+      s++;
+    if (s == e)
+      return 0;
+    while (s < e && parser_is_digit(*s))
+      s++;
+  }
+
+  return s == e;
+}
+
+static lval* parser_num(lparser* p, const char* s, const char* e)
+{
+  int neg = (*s == '-');
+  long x = 0;
+
+  for (const char* c = s + (*s == '+' || *s == '-'); c < e; c++)
+  {
+    int d = *c - '0';
+
+    if (neg ? x < (LONG_MIN + d) / 10 : x > (LONG_MAX - d) / 10)
+      return parser_error(p, s, "Invalid number");
+
+    x = x * 10 + (neg ? -d : d);
+  }
+
+  return lval_num(x);
+}
+
+static lval* parser_fnum(lparser* p, const char* s, const char* e)
+{
+  char buffer[FNUM_MAX_LEN];
+  size_t len = e - s;
+
+  if (len >= sizeof(buffer))
+    return parser_error(p, s, "Floating number is too long");
+
+  memcpy(buffer, s, len);
+  buffer[len] = 0;
+
+  errno = 0;
+  double x = strtod(buffer, NULL);
+  if (errno == ERANGE)
+    return parser_error(p, s, "Invalid floating number");
+
+  return lval_fnum(x);
+}
+
+/* Number or symbol */
+static lval* parser_atom(lparser* p)
+{
+  const char* s = p->pos;
+
+  while (p->pos < p->end && parser_is_symbol(*p->pos))
+    p->pos++;
+
+  if (parser_is_num(s, p->pos))
+    return parser_num(p, s, p->pos);
+
+  if (parser_is_fnum(s, p->pos))
+    return parser_fnum(p, s, p->pos);
+
+  return lval_sym_n(s, p->pos - s);
+}
+
+/* String in single or double quotes, doubled quote is a part of it */
+static lval* parser_str(lparser* p)
+{
+  const char* s = p->pos;
+  char quote = *p->pos++;
+
+  while (p->pos < p->end && *p->pos != '\n')
+  {
+    if (*p->pos == '\\' && p->pos + 1 < p->end && p->pos[1] != '\n')
+    {
+      p->pos += 2;
+    } else if (*p->pos == quote) {
+      if (p->pos + 1 < p->end && p->pos[1] == quote)
+        p->pos += 2;
+      else
+        break;
+    } else {
+      p->pos++;
+    }
+  }
+
+  if (p->pos == p->end || *p->pos != quote)
+    return parser_error(p, s, "Unterminated string");
+
+  //TODO: unescape
+  return lval_str_n(s + 1, p->pos++ - s - 1);
+}
+
+/* S-expression or Q-expression */
+static lval* parser_list(lparser* p, lval* x, char close)
+{
+  int line = p->line;
+  int col = (int)(p->pos - p->line_start) + 1;
+  int base = p->stack_count;
+
+  x->line = line;
+  p->pos++;
+
+  while (1)
+  {
+    parser_skip(p);
+
+    if (p->pos == p->end)
+    {
+      parser_drop(p, base);
+      lval_del(x);
+      return parser_error(p, p->pos,
+        "Missing '%c' for list opened at %d:%d", close, line, col);
+    }
+
+    if (*p->pos == close)
+    {
+      p->pos++;
+      return parser_pop(p, x, base);
+    }
+
+    lval* y = parser_expr(p);
+    if (y->type == LVAL_ERROR)
+    {
+      parser_drop(p, base);
+      lval_del(x);
+      return y;
+    }
+
+    parser_push(p, y);
+  }
+}
+
+static lval* parser_expr(lparser* p)
+{
+  char c = *p->pos;
+  lval* x;
+
+  switch (c)
+  {
+    case '(':
+    case '{':
+      if (p->depth == PARSER_MAX_DEPTH)
+        return parser_error(p, p->pos, "Lists nested deeper than %d", PARSER_MAX_DEPTH);
+
+      p->depth++;
+      if (c == '(')
+        x = parser_list(p, lval_sexpr(), ')');
+      else
+        x = parser_list(p, lval_qexpr(), '}');
+      p->depth--;
+      return x;
+
+    case '"':
+    case '\'':
+      return parser_str(p);
+
+    case ')':
+    case '}':
+      return parser_error(p, p->pos, "Unexpected '%c'", c);
+  }
+
+  if (parser_is_symbol(c))
+    return parser_atom(p);
+
+  if (c >= ' ' && c <= '~')
+    return parser_error(p, p->pos, "Illegal input '%c'", c);
+  else
+    return parser_error(p, p->pos, "Illegal input 0x%02x", (unsigned char)c);
+}
+
+/* Read next top-level expression, NULL at the end of input */
+lval* parser_next(lparser* p)
+{
+  parser_skip(p);
+
+  if (p->pos == p->end)
+    return NULL;
+
+  return parser_expr(p);
+}
+
+/* Read whole input into S-expression */
+lval* parse(const char* input, size_t len)
+{
+  lparser p;
+  parser_init(&p, input, len);
+
+  lval* y;
+
+  while ((y = parser_next(&p)))
+  {
+    if (y->type == LVAL_ERROR)
+    {
+      parser_free(&p);
+      return y;
+    }
+
+    parser_push(&p, y);
+  }
 
-  /* Free buffer */
-  free(input);
+  lval* x = parser_pop(&p, lval_sexpr(), 0);
+  parser_free(&p);
 
-  return root;
+  return x;
 }
@@ -4,14 +4,40 @@
  * Parser stuff
  */
 
-#include "tree.h"
+#include <stddef.h>
 
-#ifdef DEBUG
-extern int yydebug;
-#endif
+#include "common.h"
 
-extern void parser_free_pool(void);
+/*
+ * Parser state
+ *
+ * Reads expressions straight from the byte buffer,
+ * input doesn't have to be NUL-terminated.
+ * Elements of lists being read are collected on the
+ * scratch stack, so every list is allocated only once.
+ */
+typedef struct _lparser
+{
+  const char* pos; // Current position
+  const char* end; // End of input
+  const char* line_start; // Beginning of current line
+  int line;
+  int depth; // Lists being read
+  lval** stack; // Scratch stack for list elements
+  int stack_count;
+  int stack_size;
+} lparser;
+
+/* Start parsing of buffer */
+void parser_init(lparser* p, const char* input, size_t len);
+
+/* Release memory held by parser */
+void parser_free(lparser* p);
+
+/* Read next top-level expression, NULL at the end of input */
+lval* parser_next(lparser* p);
 
-tree* parse_and_free(char* input);
+/* Read whole input into S-expression */
+lval* parse(const char* input, size_t len);
 
 #endif // __PARSER_H__
@@ -0,0 +1,247 @@
+/*
+ * Work-stealing thread pool
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "pool.h"
+
+/* Initial capacity of task deque */
+#define DEQUE_MIN_SIZE 64
+
+typedef struct
+{
+  ltask_fn fn;
+  void* arg;
+} ltask;
+
+/* Ring buffer of tasks, owner works at bottom, thieves at top */
+typedef struct
+{
+  pthread_mutex_t lock;
+  ltask* tasks;
+  int size;
+  int top;
+  int count;
+} ldeque;
+
+typedef struct
+{
+  int size;
+  ldeque* deques;
+  atomic_int queued; // Total count of queued tasks
+  atomic_uint next; // Round-robin for outside submissions
+  pthread_mutex_t lock; // Guards sleeping
+  pthread_cond_t work; // Signalled on new task
+  pthread_cond_t done; // Signalled on finished task
+} lpool;
+
+static lpool pool;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+/* Deque of current thread, -1 outside of pool */
+static _Thread_local int pool_self = -1;
+
+static void deque_push(ldeque* d, ltask t)
+{
+  pthread_mutex_lock(&d->lock);
+
+  if (d->count == d->size)
+  {
+    int size = d->size ? d->size * 2 : DEQUE_MIN_SIZE;
+    ltask* tasks = (ltask*)malloc(sizeof(ltask) * size);
+
+    for (int i = 0; i < d->count; i++)
+      tasks[i] = d->tasks[(d->top + i) % d->size];
+
+    free(d->tasks);
+    d->tasks = tasks;
+    d->size = size;
+    d->top = 0;
+  }
+
+  d->tasks[(d->top + d->count++) % d->size] = t;
+
+  pthread_mutex_unlock(&d->lock);
+}
+
+/* Take newest (own) or oldest (stolen) task */
+static int deque_take(ldeque* d, ltask* t, int steal)
+{
+  int found = 0;
+
+  pthread_mutex_lock(&d->lock);
+
+  if (d->count > 0)
+  {
+    if (steal)
+    {
+      *t = d->tasks[d->top];
+      d->top = (d->top + 1) % d->size;
+    } else {
+      *t = d->tasks[(d->top + d->count - 1) % d->size];
+    }
+
+    d->count--;
+    found = 1;
+  }
+
+  pthread_mutex_unlock(&d->lock);
+
+  return found;
+}
+
+/* Find task in own deque first, then steal */
+static int pool_take(ltask* t)
+{
+  if (atomic_load(&pool.queued) == 0)
+    return 0;
+
+  int self = pool_self >= 0 ? pool_self : 0;
+
+  if (pool_self >= 0 && deque_take(&pool.deques[self], t, 0))
+    return 1;
+
+  for (int i = 0; i < pool.size; i++)
+    if (deque_take(&pool.deques[(self + i) % pool.size], t, 1))
+      return 1;
+
+  return 0;
+}
+
+static void pool_run(ltask* t)
+{
+  atomic_fetch_sub(&pool.queued, 1);
+  t->fn(t->arg);
+}
+
+static void* pool_worker(void* arg)
+{
+  pool_self = (int)(long)arg;
+
+  while (1)
+  {
+    ltask t;
+
+    if (pool_take(&t))
+    {
+      pool_run(&t);
+      continue;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    while (atomic_load(&pool.queued) == 0)
+      pthread_cond_wait(&pool.work, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+  }
+
+  return NULL;
+}
+
+static void pool_init(void)
+{
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+  pool.size = cores > 0 ? cores : 1;
+  pool.deques = (ldeque*)calloc(pool.size, sizeof(ldeque));
+  atomic_init(&pool.queued, 0);
+  atomic_init(&pool.next, 0);
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.work, NULL);
+  pthread_cond_init(&pool.done, NULL);
+
+  for (int i = 0; i < pool.size; i++)
+    pthread_mutex_init(&pool.deques[i].lock, NULL);
+
+  for (int i = 0; i < pool.size; i++)
+  {
+    pthread_t thread;
+    pthread_create(&thread, NULL, pool_worker, (void*)(long)i);
+    pthread_detach(thread);
+  }
+}
+
+/* Number of worker threads, starts pool on first use */
+int pool_size(void)
+{
+  pthread_once(&pool_once, pool_init);
+  return pool.size;
+}
+
+/* Queue task for execution */
+void pool_submit(ltask_fn fn, void* arg)
+{
+  pthread_once(&pool_once, pool_init);
+
+  ltask t = { fn, arg };
+  int i = pool_self >= 0 ? pool_self
+    : (int)(atomic_fetch_add(&pool.next, 1) % pool.size);
+
+  deque_push(&pool.deques[i], t);
+  atomic_fetch_add(&pool.queued, 1);
+
+  pthread_mutex_lock(&pool.lock);
+  pthread_cond_broadcast(&pool.work);
+  pthread_cond_broadcast(&pool.done);
+  pthread_mutex_unlock(&pool.lock);
+}
+
+/* Run one queued task on current thread, 0 if there was none */
+int pool_run_one(void)
+{
+  pthread_once(&pool_once, pool_init);
+
+  ltask t;
+  if (!pool_take(&t))
+    return 0;
+
+  pool_run(&t);
+  return 1;
+}
+
+/* Run tasks on current thread until counter drops to zero */
+void pool_wait(atomic_int* pending)
+{
+  while (atomic_load(pending) > 0)
+  {
+    if (pool_run_one())
+      continue;
+
+    pthread_mutex_lock(&pool.lock);
+    while (atomic_load(pending) > 0 && atomic_load(&pool.queued) == 0)
+      pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+  }
+}
+
+/* Wake threads sleeping in pool_wait, call when counter changes */
+void pool_notify(void)
+{
+  pthread_mutex_lock(&pool.lock);
+  pthread_cond_broadcast(&pool.done);
+  pthread_mutex_unlock(&pool.lock);
+}
+
+/* Forget pool in forked child, its threads weren't inherited,
+   next use starts new ones */
+void pool_reset(void)
+{
+  static const pthread_once_t once = PTHREAD_ONCE_INIT;
+
+  if (pool.deques)
+  {
+    for (int i = 0; i < pool.size; i++)
+      free(pool.deques[i].tasks);
+    free(pool.deques);
+  }
+
+  memset(&pool, 0, sizeof(pool));
+  pool_once = once;
+  pool_self = -1;
+}
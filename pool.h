@@ -0,0 +1,35 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+/*
+ * Work-stealing thread pool
+ *
+ * One worker per core, each with its own deque. Owner takes
+ * newest tasks from its deque, idle workers steal oldest ones
+ * from others. Threads waiting for results run tasks too, so
+ * nested parallel calls don't deadlock.
+ */
+
+#include <stdatomic.h>
+
+typedef void (*ltask_fn)(void* arg);
+
+/* Number of worker threads, starts pool on first use */
+int pool_size(void);
+
+/* Queue task for execution */
+void pool_submit(ltask_fn fn, void* arg);
+
+/* Run one queued task on current thread, 0 if there was none */
+int pool_run_one(void);
+
+/* Run tasks on current thread until counter drops to zero */
+void pool_wait(atomic_int* pending);
+
+/* Wake threads sleeping in pool_wait, call when counter changes */
+void pool_notify(void);
+
+/* Forget pool in forked child, its threads weren't inherited,
+   next use starts new ones */
+void pool_reset(void);
+
+#endif // __POOL_H__
@@ -0,0 +1,217 @@
+/*
+ * Sampling profiler
+ *
+ * Signal handler can't allocate, so distinct stacks are
+ * counted in hash table allocated when profiling starts.
+ * Samples that don't fit or arrive while another thread
+ * is recording are dropped and counted.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "profile.h"
+#include "strbuf.h"
+
+#define PROFILE_SLOTS 16384 // Distinct stacks, power of two
+#define PROFILE_FRAMES (PROFILE_SLOTS * 16) // Frames of all stacks
+
+typedef struct
+{
+  unsigned hash;
+  int depth; // 0 for free slot, stack of top level has 1 empty frame
+  int truncated;
+  int first; // Index of outermost frame in pool
+  long count;
+} lstack;
+
+atomic_int profile_active;
+_Thread_local lshadow profile_stack LTHREAD_FAST;
+
+static lstack* stacks;
+static lframe* pool;
+static int pool_used;
+static atomic_flag busy = ATOMIC_FLAG_INIT;
+static volatile long samples;
+static volatile long dropped;
+
+static unsigned profile_hash(const lframe* f, int n, int truncated)
+{
+  unsigned h = 2166136261u ^ truncated;
+  for (int i = 0; i < n; i++)
+  {
+    h = (h ^ (unsigned)(size_t)f[i].name) * 16777619u;
+    h = (h ^ (unsigned)f[i].line) * 16777619u;
+  }
+  return h;
+}
+
+static int profile_same(const lstack* s, const lframe* f, int n, int truncated)
+{
+  if (s->depth != n || s->truncated != truncated)
+    return 0;
+
+  for (int i = 0; i < n; i++)
+    if (pool[s->first + i].name != f[i].name || pool[s->first + i].line != f[i].line)
+      return 0;
+
+  return 1;
+}
+
+static void profile_record(const lframe* f, int n, int truncated)
+{
+  unsigned h = profile_hash(f, n, truncated);
+
+  for (int k = 0; k < PROFILE_SLOTS; k++)
+  {
+    lstack* s = &stacks[(h + k) & (PROFILE_SLOTS - 1)];
+
+    if (s->depth == 0)
+    {
+      if (pool_used + n > PROFILE_FRAMES)
+        break;
+
+      memcpy(&pool[pool_used], f, sizeof(lframe) * n);
+      s->hash = h;
+      s->truncated = truncated;
+      s->first = pool_used;
+      s->count = 1;
+      s->depth = n;
+      pool_used += n;
+      return;
+    }
+
+    if (s->hash == h && profile_same(s, f, n, truncated))
+    {
+      s->count++;
+      return;
+    }
+  }
+
+  dropped++;
+}
+
+static void profile_handler(int sig)
+{
+  (void)sig;
+  int saved = errno;
+
+  if (atomic_flag_test_and_set_explicit(&busy, memory_order_acquire))
+  {
+    dropped++;
+    errno = saved;
+    return;
+  }
+
+  lshadow* s = &profile_stack;
+  int depth = s->depth;
+  atomic_signal_fence(memory_order_acquire);
+
+  /* Copy innermost frames, outermost first */
+  lframe f[PROFILE_DEPTH];
+  int n = depth < PROFILE_DEPTH ? depth : PROFILE_DEPTH;
+  for (int i = 0; i < n; i++)
+    f[i] = s->frames[(depth - n + i) & (PROFILE_STACK - 1)];
+
+  /* Time spent outside of any function */
+  if (n == 0)
+  {
+    f[0].name = NULL;
+    f[0].line = -1;
+    n = 1;
+  }
+
+  profile_record(f, n, depth > n);
+  samples++;
+
+  atomic_flag_clear_explicit(&busy, memory_order_release);
+  errno = saved;
+}
+
+/* Start sampling at given frequency, 0 on success */
+int profile_start(int hz)
+{
+  if (stacks == NULL)
+  {
+    stacks = (lstack*)calloc(PROFILE_SLOTS, sizeof(lstack));
+    pool = (lframe*)malloc(sizeof(lframe) * PROFILE_FRAMES);
+    if (stacks == NULL || pool == NULL)
+      return -1;
+  }
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = profile_handler;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGPROF, &sa, NULL) < 0)
+    return -1;
+
+  atomic_store(&profile_active, 1);
+
+  struct itimerval t;
+  t.it_interval.tv_sec = 0;
+  t.it_interval.tv_usec = 1000000 / hz;
+  t.it_value = t.it_interval;
+  return setitimer(ITIMER_PROF, &t, NULL);
+}
+
+/* Stop sampling, collected samples are kept */
+void profile_stop(void)
+{
+  struct itimerval t;
+  memset(&t, 0, sizeof(t));
+  setitimer(ITIMER_PROF, &t, NULL);
+  signal(SIGPROF, SIG_IGN);
+
+  atomic_store(&profile_active, 0);
+}
+
+static void profile_frame(lstrbuf* b, const lframe* f)
+{
+  if (f->line < 0)
+    strbuf_puts(b, "[toplevel]");
+  else
+    strbuf_puts(b, f->name ? f->name : "lambda");
+
+  if (f->line > 0)
+    strbuf_printf(b, ":%d", f->line);
+}
+
+/* Write folded stacks, 0 on success */
+int profile_write(FILE* out)
+{
+  lstrbuf b;
+  strbuf_init(&b);
+
+  for (int k = 0; stacks && k < PROFILE_SLOTS; k++)
+  {
+    lstack* s = &stacks[k];
+    if (s->depth == 0)
+      continue;
+
+    if (s->truncated)
+      strbuf_puts(&b, "...;");
+
+    for (int i = 0; i < s->depth; i++)
+    {
+      if (i > 0)
+        strbuf_putc(&b, ';');
+      profile_frame(&b, &pool[s->first + i]);
+    }
+
+    strbuf_printf(&b, " %ld\n", s->count);
+  }
+
+  if (dropped)
+    fprintf(stderr, "Profiler dropped %ld of %ld samples\n", dropped, samples + dropped);
+
+  int ok = fwrite(b.data, 1, b.len, out) == b.len;
+  strbuf_free(&b);
+  return ok ? 0 : -1;
+}
@@ -0,0 +1,70 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+/*
+ * Sampling profiler
+ *
+ * While profiling is on, lval_call keeps shadow stack of
+ * Lisp call frames for its thread. SIGPROF timer samples
+ * stack of thread it interrupts and counts distinct stacks.
+ * Result is written in folded format understood by flame
+ * graph tools: frames from outermost one separated by
+ * semicolons, then count of samples, e.g. "fib:138;fib:138 42".
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "common.h"
+
+#define PROFILE_STACK 256 // Shadow stack ring, power of two
+#define PROFILE_DEPTH 64 // Innermost frames kept by sample
+
+typedef struct
+{
+  const char* name; // Static or interned, NULL for anonymous lambda
+  int line;
+} lframe;
+
+/* Frames deeper than ring size overwrite outer ones,
+   only innermost frames are sampled anyway */
+typedef struct
+{
+  lframe frames[PROFILE_STACK];
+  volatile int depth;
+} lshadow;
+
+extern atomic_int profile_active;
+extern _Thread_local lshadow profile_stack LTHREAD_FAST;
+
+static inline int profile_on(void)
+{
+  return atomic_load_explicit(&profile_active, memory_order_relaxed);
+}
+
+static inline void profile_push(const char* name, int line)
+{
+  lshadow* s = &profile_stack;
+  lframe* f = &s->frames[s->depth & (PROFILE_STACK - 1)];
+  f->name = name;
+  f->line = line;
+
+  /* Signal handler must see frame before depth */
+  atomic_signal_fence(memory_order_release);
+  s->depth++;
+}
+
+static inline void profile_pop(void)
+{
+  profile_stack.depth--;
+}
+
+/* Start sampling at given frequency, 0 on success */
+int profile_start(int hz);
+
+/* Stop sampling, collected samples are kept */
+void profile_stop(void);
+
+/* Write folded stacks, 0 on success */
+int profile_write(FILE* out);
+
+#endif // __PROFILE_H__
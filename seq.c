@@ -0,0 +1,233 @@
+/*
+ * Lazy sequences
+ */
+
+#include <stdlib.h>
+
+#include "lval.h"
+#include "seq.h"
+
+static lseq* seq_new(lseq_kind kind)
+{
+  lseq* s = (lseq*)calloc(1, sizeof(lseq));
+  atomic_init(&s->refs, 1);
+  s->kind = kind;
+  return s;
+}
+
+lseq* seq_range(long start, long end, long step)
+{
+  lseq* s = seq_new(SEQ_RANGE);
+  s->start = start;
+  s->end = end;
+  s->step = step;
+  return s;
+}
+
+/* Sequence over list or sequence value, takes it */
+lseq* seq_from(lval* v)
+{
+  if (v->type == LVAL_SEQ)
+  {
+    lseq* s = seq_ref(v->seq);
+    lval_del(v);
+    return s;
+  }
+
+  lseq* s = seq_new(SEQ_LIST);
+  s->x = v;
+  return s;
+}
+
+/* Sequence built from function and value or source, takes them */
+lseq* seq_iterate(lval* f, lval* x)
+{
+  lseq* s = seq_new(SEQ_ITERATE);
+  s->f = f;
+  s->x = x;
+  return s;
+}
+
+static lseq* seq_apply(lseq_kind kind, lval* f, lseq* src)
+{
+  lseq* s = seq_new(kind);
+  s->f = f;
+  s->src = src;
+  return s;
+}
+
+lseq* seq_map(lval* f, lseq* src)
+{
+  return seq_apply(SEQ_MAP, f, src);
+}
+
+lseq* seq_filter(lval* f, lseq* src)
+{
+  return seq_apply(SEQ_FILTER, f, src);
+}
+
+lseq* seq_take_while(lval* f, lseq* src)
+{
+  return seq_apply(SEQ_TAKE_WHILE, f, src);
+}
+
+lseq* seq_ref(lseq* s)
+{
+  atomic_fetch_add_explicit(&s->refs, 1, memory_order_relaxed);
+  return s;
+}
+
+void seq_unref(lseq* s)
+{
+  while (s && atomic_fetch_sub_explicit(&s->refs, 1, memory_order_acq_rel) == 1)
+  {
+    lseq* src = s->src;
+
+    if (s->f)
+      lval_del(s->f);
+    if (s->x)
+      lval_del(s->x);
+    free(s);
+
+    /* Release chain without recursion */
+    s = src;
+  }
+}
+
+lseq_iter* seq_iter(lseq* s)
+{
+  lseq_iter* it = (lseq_iter*)calloc(1, sizeof(lseq_iter));
+  it->seq = s;
+  it->i = s->start;
+  if (s->src)
+    it->src = seq_iter(s->src);
+  return it;
+}
+
+void seq_iter_free(lseq_iter* it)
+{
+  while (it)
+  {
+    lseq_iter* src = it->src;
+    if (it->cur)
+      lval_del(it->cur);
+    free(it);
+    it = src;
+  }
+}
+
+/* Call function with single argument */
+static lval* seq_call(lenv* e, lval* f, lval* x)
+{
+  lval* fn = lval_copy(f);
+  lval* r = lval_call(e, fn, lval_add(lval_sexpr(), x));
+  lval_del(fn);
+  return r;
+}
+
+/* Check predicate on element, returns error or NULL */
+static lval* seq_test(lenv* e, lval* f, lval* x, int* ok)
+{
+  lval* r = seq_call(e, f, lval_copy(x));
+
+  if (r->type == LVAL_ERROR)
+    return r;
+
+  if (r->type != LVAL_NUMBER)
+  {
+    lval* err = lval_err("Sequence predicate returned %s, Expected %s.",
+      ltype_name(r->type), ltype_name(LVAL_NUMBER));
+    lval_del(r);
+    return err;
+  }
+
+  *ok = r->num != 0;
+  lval_del(r);
+  return NULL;
+}
+
+/* Next element, NULL at the end, errors are returned as elements */
+lval* seq_next(lenv* e, lseq_iter* it)
+{
+  lseq* s = it->seq;
+
+  if (it->done)
+    return NULL;
+
+  switch (s->kind)
+  {
+    case SEQ_RANGE:
+      if (s->step > 0 ? it->i >= s->end : it->i <= s->end)
+      {
+        it->done = 1;
+        return NULL;
+      }
+      it->i += s->step;
+      return lval_num(it->i - s->step);
+
+    case SEQ_LIST:
+      if (it->i >= s->x->count)
+      {
+        it->done = 1;
+        return NULL;
+      }
+      return lval_copy(s->x->cell[it->i++]);
+
+    case SEQ_ITERATE:
+    {
+      lval* next = it->cur ? seq_call(e, s->f, it->cur) : lval_copy(s->x);
+      it->cur = NULL;
+
+      /* Error ends sequence */
+      if (next->type == LVAL_ERROR)
+        it->done = 1;
+      else
+        it->cur = lval_copy(next);
+
+      return next;
+    }
+
+    case SEQ_MAP:
+    {
+      lval* x = seq_next(e, it->src);
+      if (x == NULL || x->type == LVAL_ERROR)
+        return x;
+
+      return seq_call(e, s->f, x);
+    }
+
+    case SEQ_FILTER:
+    case SEQ_TAKE_WHILE:
+    {
+      lval* x;
+      while ((x = seq_next(e, it->src)))
+      {
+        if (x->type == LVAL_ERROR)
+          return x;
+
+        int ok = 0;
+        lval* err = seq_test(e, s->f, x, &ok);
+        if (err)
+        {
+          lval_del(x);
+          return err;
+        }
+
+        if (ok)
+          return x;
+
+        lval_del(x);
+
+        if (s->kind == SEQ_TAKE_WHILE)
+        {
+          it->done = 1;
+          return NULL;
+        }
+      }
+
+      return NULL;
+    }
+  }
+
+  return NULL;
+}
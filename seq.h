@@ -0,0 +1,68 @@
+#ifndef __SEQ_H__
+#define __SEQ_H__
+/*
+ * Lazy sequences
+ *
+ * Sequence is immutable description of how elements are
+ * produced, it's shared between copies. Elements are made
+ * on demand by iterator, so consumers walking it hold one
+ * element at a time.
+ */
+
+#include <stdatomic.h>
+
+#include "common.h"
+
+typedef enum
+{
+  SEQ_RANGE, // Numbers from start to end by step
+  SEQ_LIST, // Elements of Q-expression
+  SEQ_ITERATE, // x, f(x), f(f(x)), ...
+  SEQ_MAP, // f applied to elements of source
+  SEQ_FILTER, // Elements of source f holds for
+  SEQ_TAKE_WHILE // Elements of source until f fails
+} lseq_kind;
+
+typedef struct _lseq
+{
+  atomic_int refs;
+  lseq_kind kind;
+  long start, end, step; // Range bounds
+  lval* f; // Function to apply
+  lval* x; // Initial value or list
+  struct _lseq* src; // Source sequence
+} lseq;
+
+/* Iteration state, mirrors chain of sequences */
+typedef struct _lseq_iter
+{
+  lseq* seq;
+  struct _lseq_iter* src;
+  long i;
+  lval* cur; // Last value of iterate
+  int done;
+} lseq_iter;
+
+lseq* seq_range(long start, long end, long step);
+
+/* Sequence over list or sequence value, takes it */
+lseq* seq_from(lval* v);
+
+/* Sequence built from function and value or source, takes them */
+lseq* seq_iterate(lval* f, lval* x);
+lseq* seq_map(lval* f, lseq* src);
+lseq* seq_filter(lval* f, lseq* src);
+lseq* seq_take_while(lval* f, lseq* src);
+
+lseq* seq_ref(lseq* s);
+
+void seq_unref(lseq* s);
+
+lseq_iter* seq_iter(lseq* s);
+
+void seq_iter_free(lseq_iter* it);
+
+/* Next element, NULL at the end, errors are returned as elements */
+lval* seq_next(lenv* e, lseq_iter* it);
+
+#endif // __SEQ_H__
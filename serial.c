@@ -0,0 +1,471 @@
+/*
+ * Binary serialization of Lisp values
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "lenv.h"
+#include "lval.h"
+#include "serial.h"
+
+/* Initial size of output buffer */
+#define SERIAL_MIN_SIZE 256
+
+/* Limit on nesting to keep malformed input from exhausting stack */
+#define SERIAL_MAX_DEPTH 10000
+
+/* Longest varint */
+#define VARINT_MAX_LEN 10
+
+void serial_buf_init(serial_buf* b)
+{
+  b->data = NULL;
+  b->len = 0;
+  b->size = 0;
+}
+
+void serial_buf_free(serial_buf* b)
+{
+  free(b->data);
+  serial_buf_init(b);
+}
+
+/* Make room for n more bytes */
+static void serial_reserve(serial_buf* b, size_t n)
+{
+  if (b->len + n <= b->size)
+    return;
+
+  size_t size = b->size ? b->size : SERIAL_MIN_SIZE;
+  while (size < b->len + n)
+    size *= 2;
+
+  b->data = realloc(b->data, size);
+  b->size = size;
+}
+
+static void serial_put_byte(serial_buf* b, unsigned char x)
+{
+  serial_reserve(b, 1);
+  b->data[b->len++] = x;
+}
+
+static size_t serial_encode_varint(char* out, uint64_t x)
+{
+  size_t n = 0;
+
+  while (x >= 0x80)
+  {
+    out[n++] = (char)(x | 0x80);
+    x >>= 7;
+  }
+
+  out[n++] = (char)x;
+  return n;
+}
+
+void serial_put_varint(serial_buf* b, uint64_t x)
+{
+  serial_reserve(b, VARINT_MAX_LEN);
+  b->len += serial_encode_varint(b->data + b->len, x);
+}
+
+void serial_put_str(serial_buf* b, const char* s, size_t len)
+{
+  serial_put_varint(b, len);
+  serial_reserve(b, len);
+  memcpy(b->data + b->len, s, len);
+  b->len += len;
+}
+
+static void serial_put_env(serial_buf* b, lenv* e)
+{
+  serial_put_varint(b, e->count);
+
+  for (int i = 0; i < e->count; i++)
+  {
+    serial_put_str(b, e->syms[i], strlen(e->syms[i]));
+    serial_put(b, e->vals[i]);
+  }
+}
+
+/* Encode value */
+void serial_put(serial_buf* b, lval* v)
+{
+  switch (v->type)
+  {
+    case LVAL_NUMBER:
+      serial_put_byte(b, SERIAL_NUMBER);
+      /* Zigzag encoding keeps small negative numbers short */
+      serial_put_varint(b, ((uint64_t)v->num << 1) ^ (uint64_t)(v->num >> 63));
+      break;
+
+    case LVAL_FNUMBER:
+      serial_put_byte(b, SERIAL_FNUMBER);
+      serial_reserve(b, sizeof(double));
+      memcpy(b->data + b->len, &v->fnum, sizeof(double));
+      b->len += sizeof(double);
+      break;
+
+    case LVAL_ERROR:
+      serial_put_byte(b, SERIAL_ERROR);
+      serial_put_str(b, v->err, strlen(v->err));
+      break;
+
+    case LVAL_SYM:
+      serial_put_byte(b, SERIAL_SYM);
+      serial_put_str(b, v->sym, strlen(v->sym));
+      break;
+
+    case LVAL_STR:
+      serial_put_byte(b, SERIAL_STR);
+      serial_put_str(b, v->str, v->len);
+      break;
+
+    case LVAL_FUN:
+      if (v->is_builtin)
+      {
+        serial_put_byte(b, SERIAL_BUILTIN);
+        serial_put_str(b, v->name, strlen(v->name));
+      } else {
+        serial_put_byte(b, SERIAL_LAMBDA);
+        serial_put_env(b, v->env);
+        serial_put(b, v->formals);
+        serial_put(b, v->body);
+      }
+      break;
+
+    case LVAL_ISOLATE:
+    case LVAL_FUTURE:
+    case LVAL_SEQ:
+      /* Handles are meaningful only inside process */
+      serial_put_byte(b, SERIAL_ERROR);
+      serial_put_str(b, "Handle can't be serialized", 26);
+      break;
+
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+      serial_put_byte(b, v->type == LVAL_SEXPR ? SERIAL_SEXPR : SERIAL_QEXPR);
+      serial_put_varint(b, v->count);
+      for (int i = 0; i < v->count; i++)
+        serial_put(b, v->cell[i]);
+      break;
+  }
+}
+
+int serial_get_varint(serial_reader* r, uint64_t* x)
+{
+  *x = 0;
+
+  for (int shift = 0; shift < 64; shift += 7)
+  {
+    if (r->pos == r->end)
+      return 0;
+
+    unsigned char c = *r->pos++;
+    *x |= (uint64_t)(c & 0x7f) << shift;
+
+    if (!(c & 0x80))
+      return 1;
+  }
+
+  return 0;
+}
+
+/* Get string, it points into input and isn't NUL-terminated */
+int serial_get_str(serial_reader* r, const char** s, size_t* len)
+{
+  uint64_t n;
+  if (!serial_get_varint(r, &n) || n > (uint64_t)(r->end - r->pos))
+    return 0;
+
+  *s = r->pos;
+  *len = n;
+  r->pos += n;
+  return 1;
+}
+
+static lval* serial_get_ex(serial_reader* r, int depth);
+
+static lenv* serial_get_env(serial_reader* r, int depth)
+{
+  uint64_t count;
+  if (!serial_get_varint(r, &count))
+    return NULL;
+
+  lenv* e = lenv_new();
+
+  for (uint64_t i = 0; i < count; i++)
+  {
+    const char* s;
+    size_t len;
+    lval* v = NULL;
+
+    if (!serial_get_str(r, &s, &len) || !(v = serial_get_ex(r, depth)))
+    {
+      lenv_del(e);
+      return NULL;
+    }
+
+    lval* k = lval_sym_n(s, len);
+    lenv_put(e, k, v);
+    lval_del(k);
+    lval_del(v);
+  }
+
+  return e;
+}
+
+static lval* serial_get_builtin(serial_reader* r)
+{
+  const char* s;
+  size_t len;
+
+  if (r->env == NULL || !serial_get_str(r, &s, &len))
+    return NULL;
+
+  lval* k = lval_sym_n(s, len);
+  lval* v = lenv_get(r->env, k);
+  lval_del(k);
+
+  if (v->type != LVAL_FUN || !v->is_builtin)
+  {
+    lval_del(v);
+    return NULL;
+  }
+
+  return v;
+}
+
+static lval* serial_get_lambda(serial_reader* r, int depth)
+{
+  lenv* env = serial_get_env(r, depth);
+  if (env == NULL)
+    return NULL;
+
+  lval* formals = serial_get_ex(r, depth);
+  lval* body = formals ? serial_get_ex(r, depth) : NULL;
+
+  if (body == NULL)
+  {
+    if (formals)
+      lval_del(formals);
+    lenv_del(env);
+    return NULL;
+  }
+
+  lval* v = lval_lambda(formals, body);
+  lenv_del(v->env);
+  v->env = env;
+  return v;
+}
+
+static lval* serial_get_list(serial_reader* r, lval* x, int depth)
+{
+  uint64_t count;
+
+  /* Every element takes at least one byte */
+  if (!serial_get_varint(r, &count) || count > (uint64_t)(r->end - r->pos))
+  {
+    lval_del(x);
+    return NULL;
+  }
+
+  x->cell = (lval**)malloc(sizeof(lval*) * count);
+
+  for (uint64_t i = 0; i < count; i++)
+  {
+    lval* y = serial_get_ex(r, depth);
+    if (y == NULL)
+    {
+      lval_del(x);
+      return NULL;
+    }
+    x->cell[x->count++] = y;
+  }
+
+  return x;
+}
+
+static lval* serial_get_ex(serial_reader* r, int depth)
+{
+  const char* s;
+  size_t len;
+  uint64_t n;
+
+  if (r->pos == r->end || depth > SERIAL_MAX_DEPTH)
+    return NULL;
+
+  switch (*r->pos++)
+  {
+    case SERIAL_NUMBER:
+      if (!serial_get_varint(r, &n))
+        return NULL;
+      return lval_num((long)((n >> 1) ^ -(n & 1)));
+
+    case SERIAL_FNUMBER:
+    {
+      double x;
+      if ((size_t)(r->end - r->pos) < sizeof(x))
+        return NULL;
+      memcpy(&x, r->pos, sizeof(x));
+      r->pos += sizeof(x);
+      return lval_fnum(x);
+    }
+
+    case SERIAL_ERROR:
+      return serial_get_str(r, &s, &len) ? lval_err("%.*s", (int)len, s) : NULL;
+
+    case SERIAL_SYM:
+      return serial_get_str(r, &s, &len) ? lval_sym_n(s, len) : NULL;
+
+    case SERIAL_STR:
+      return serial_get_str(r, &s, &len) ? lval_str_n(s, len) : NULL;
+
+    case SERIAL_SEXPR:
+      return serial_get_list(r, lval_sexpr(), depth + 1);
+
+    case SERIAL_QEXPR:
+      return serial_get_list(r, lval_qexpr(), depth + 1);
+
+    case SERIAL_BUILTIN:
+      return serial_get_builtin(r);
+
+    case SERIAL_LAMBDA:
+      return serial_get_lambda(r, depth + 1);
+  }
+
+  return NULL;
+}
+
+/* Decode value, NULL if input is malformed */
+lval* serial_get(serial_reader* r)
+{
+  return serial_get_ex(r, 0);
+}
+
+/* Write whole buffer, retrying on short writes */
+static int serial_write_all(int fd, const char* data, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t n = write(fd, data, len);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+
+    data += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+/* Read exactly len bytes, returns 0 at the end of stream */
+static int serial_read_all(int fd, char* data, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t n = read(fd, data, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return 0;
+
+    data += n;
+    len -= n;
+  }
+
+  return 1;
+}
+
+/* Write value as frame prefixed with its length */
+int serial_write_fd(int fd, lval* v)
+{
+  serial_buf b;
+  serial_buf_init(&b);
+
+  /* Leave room for length, it's put right before payload */
+  serial_reserve(&b, VARINT_MAX_LEN);
+  b.len = VARINT_MAX_LEN;
+
+  serial_put(&b, v);
+
+  char head[VARINT_MAX_LEN];
+  size_t n = serial_encode_varint(head, b.len - VARINT_MAX_LEN);
+  char* frame = b.data + VARINT_MAX_LEN - n;
+  memcpy(frame, head, n);
+
+  int result = serial_write_all(fd, frame, b.len - VARINT_MAX_LEN + n);
+
+  serial_buf_free(&b);
+
+  return result;
+}
+
+/* Write raw frame prefixed with its length */
+int serial_write_frame(int fd, const char* data, size_t len)
+{
+  char head[VARINT_MAX_LEN];
+  size_t n = serial_encode_varint(head, len);
+
+  if (serial_write_all(fd, head, n) < 0)
+    return -1;
+
+  return serial_write_all(fd, data, len);
+}
+
+/* Read raw frame, NULL at the end of stream
+   or if frame is longer than max */
+char* serial_read_frame(int fd, size_t max, size_t* len)
+{
+  uint64_t n = 0;
+  unsigned char c;
+
+  /* Length prefix comes byte by byte */
+  for (int shift = 0; ; shift += 7)
+  {
+    if (shift >= 64 || !serial_read_all(fd, (char*)&c, 1))
+      return NULL;
+
+    n |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      break;
+  }
+
+  if (n > max)
+    return NULL;
+
+  char* data = malloc(n ? n : 1);
+  if (data == NULL || !serial_read_all(fd, data, n))
+  {
+    free(data);
+    return NULL;
+  }
+
+  *len = n;
+  return data;
+}
+
+lval* serial_read_fd(int fd, lenv* e)
+{
+  size_t len;
+  char* data = serial_read_frame(fd, SIZE_MAX, &len);
+  if (data == NULL)
+    return NULL;
+
+  serial_reader r = { data, data + len, e };
+  lval* v = serial_get(&r);
+
+  free(data);
+  return v;
+}
@@ -0,0 +1,80 @@
+#ifndef __SERIAL_H__
+#define __SERIAL_H__
+/*
+ * Binary serialization of Lisp values
+ *
+ * Every value starts with a tag byte. Integers are
+ * zigzag-encoded varints, doubles are stored as is,
+ * strings and lists are prefixed with varint length.
+ * Lambdas carry their environment, built-ins are
+ * referenced by name and resolved on decoding.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+
+/* Value tags */
+enum
+{
+  SERIAL_NUMBER  = 1,
+  SERIAL_FNUMBER = 2,
+  SERIAL_ERROR   = 3,
+  SERIAL_SYM     = 4,
+  SERIAL_STR     = 5,
+  SERIAL_SEXPR   = 6,
+  SERIAL_QEXPR   = 7,
+  SERIAL_BUILTIN = 8,
+  SERIAL_LAMBDA  = 9,
+};
+
+/* Growable output buffer */
+typedef struct _serial_buf
+{
+  char* data;
+  size_t len;
+  size_t size;
+} serial_buf;
+
+/* Input over memory range */
+typedef struct _serial_reader
+{
+  const char* pos;
+  const char* end;
+  lenv* env; // Environment to resolve built-ins in
+} serial_reader;
+
+void serial_buf_init(serial_buf* b);
+
+void serial_buf_free(serial_buf* b);
+
+void serial_put_varint(serial_buf* b, uint64_t x);
+
+void serial_put_str(serial_buf* b, const char* s, size_t len);
+
+/* Encode value */
+void serial_put(serial_buf* b, lval* v);
+
+int serial_get_varint(serial_reader* r, uint64_t* x);
+
+/* Get string, it points into input and isn't NUL-terminated */
+int serial_get_str(serial_reader* r, const char** s, size_t* len);
+
+/* Decode value, NULL if input is malformed */
+lval* serial_get(serial_reader* r);
+
+/* Write raw frame prefixed with its length */
+int serial_write_frame(int fd, const char* data, size_t len);
+
+/* Read raw frame, NULL at the end of stream
+   or if frame is longer than max */
+char* serial_read_frame(int fd, size_t max, size_t* len);
+
+/* Write value as frame prefixed with its length */
+int serial_write_fd(int fd, lval* v);
+
+/* Read frame from descriptor, NULL at the end of stream */
+lval* serial_read_fd(int fd, lenv* e);
+
+#endif // __SERIAL_H__
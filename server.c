@@ -0,0 +1,222 @@
+/*
+ * Pre-forking evaluation server
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "evloop.h"
+#include "interp.h"
+#include "lval.h"
+#include "pool.h"
+#include "serial.h"
+#include "server.h"
+#include "strbuf.h"
+
+/* Longest request, connection sending more is closed */
+#define SERVER_MAX_REQUEST (16 << 20)
+
+static volatile sig_atomic_t server_stopped = 0;
+
+static void server_signal(int sig)
+{
+  (void)sig;
+  server_stopped = 1;
+}
+
+/* Evaluate request and encode result as response */
+static char* server_eval(linterp* i, const char* req, size_t len, size_t* out_len)
+{
+  if (len == 0 || (req[0] != SERVE_PRINT && req[0] != SERVE_SERIAL))
+  {
+    static const char bad[] = "\1Malformed request";
+    *out_len = sizeof(bad) - 1;
+    return strdup(bad);
+  }
+
+  lval* x = interp_eval_all(i, req + 1, len - 1);
+  char status = x->type == LVAL_ERROR ? SERVE_ERROR : SERVE_OK;
+  char* out;
+
+  if (req[0] == SERVE_PRINT)
+  {
+    lstrbuf b;
+    strbuf_init(&b);
+    strbuf_putc(&b, status);
+    if (x->type == LVAL_ERROR)
+      strbuf_puts(&b, x->err);
+    else
+      lval_write(&b, x);
+
+    /* Buffer is handed over as is */
+    *out_len = b.len;
+    out = b.data;
+  }
+  else
+  {
+    serial_buf b;
+    serial_buf_init(&b);
+    serial_put(&b, x);
+
+    *out_len = b.len + 1;
+    out = (char*)malloc(*out_len);
+    out[0] = status;
+    memcpy(out + 1, b.data, b.len);
+    serial_buf_free(&b);
+  }
+
+  lval_del(x);
+  return out;
+}
+
+static void server_worker(linterp* i, int sock, int max_requests)
+{
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+
+  /* Threads and epoll set belong to parent */
+  pool_reset();
+  if (i->loop)
+  {
+    loop_del(i->loop);
+    i->loop = NULL;
+  }
+
+  int served = 0;
+
+  while (max_requests == 0 || served < max_requests)
+  {
+    int conn = accept(sock, NULL, NULL);
+    if (conn < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      break;
+    }
+
+    size_t len;
+    char* req;
+
+    while ((max_requests == 0 || served < max_requests)
+      && (req = serial_read_frame(conn, SERVER_MAX_REQUEST, &len)))
+    {
+      size_t out_len;
+      char* out = server_eval(i, req, len, &out_len);
+      int sent = serial_write_frame(conn, out, out_len);
+
+      free(req);
+      free(out);
+      served++;
+
+      if (sent < 0)
+        break;
+    }
+
+    close(conn);
+  }
+
+  /* Nothing to clean up, memory goes with process */
+  fflush(stdout);
+  _exit(0);
+}
+
+static pid_t server_fork(linterp* i, int sock, int max_requests)
+{
+  fflush(stdout);
+
+  pid_t pid = fork();
+  if (pid == 0)
+    server_worker(i, sock, max_requests);
+
+  return pid;
+}
+
+/* Serve until SIGINT or SIGTERM, worker count defaults to number
+   of cores, workers are replaced after serving given number of
+   requests, never if it's 0 */
+int server_run(linterp* i, const char* path, int workers, int max_requests)
+{
+  struct sockaddr_un addr;
+  if (strlen(path) >= sizeof(addr.sun_path))
+  {
+    fprintf(stderr, "Socket path %s is too long\n", path);
+    return 1;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  /* Socket may be left from previous run */
+  unlink(path);
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0 || bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0
+    || listen(sock, SOMAXCONN) < 0)
+  {
+    fprintf(stderr, "Could not listen on %s: %s\n", path, strerror(errno));
+    if (sock >= 0)
+      close(sock);
+    return 1;
+  }
+
+  if (workers <= 0)
+  {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = cores > 0 ? cores : 1;
+  }
+
+  /* No SA_RESTART, so signal interrupts waiting */
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = server_signal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  pid_t* pids = (pid_t*)calloc(workers, sizeof(pid_t));
+  for (int k = 0; k < workers; k++)
+    pids[k] = server_fork(i, sock, max_requests);
+
+  while (!server_stopped)
+  {
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    /* Replace recycled or crashed worker */
+    for (int k = 0; k < workers; k++)
+      if (pids[k] == pid)
+        pids[k] = server_stopped ? 0 : server_fork(i, sock, max_requests);
+  }
+
+  for (int k = 0; k < workers; k++)
+    if (pids[k] > 0)
+      kill(pids[k], SIGTERM);
+
+  for (int k = 0; k < workers; k++)
+    if (pids[k] > 0)
+      waitpid(pids[k], NULL, 0);
+
+  free(pids);
+  close(sock);
+  unlink(path);
+
+  return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+/*
+ * Pre-forking evaluation server
+ *
+ * Parent process listens on Unix domain socket and forks
+ * workers, which inherit its global environment copy-on-write,
+ * so prelude is loaded only once. Workers accept connections
+ * one at a time and evaluate requests in their own copy of the
+ * environment; definitions live until worker is recycled.
+ *
+ * Requests and responses are frames prefixed with varint
+ * length. Request is mode byte followed by source text,
+ * response is status byte followed by result, printed or
+ * serialized depending on mode.
+ */
+
+#include "common.h"
+
+/* Request modes */
+#define SERVE_PRINT 'p'
+#define SERVE_SERIAL 's'
+
+/* Response status */
+#define SERVE_OK 0
+#define SERVE_ERROR 1
+
+/* Serve until SIGINT or SIGTERM, worker count defaults to number
+   of cores, workers are replaced after serving given number of
+   requests, never if it's 0 */
+int server_run(linterp* i, const char* path, int workers, int max_requests);
+
+#endif // __SERVER_H__
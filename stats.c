@@ -0,0 +1,295 @@
+/*
+ * Runtime counters
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+#include "strbuf.h"
+
+#ifndef LISP_NO_STATS
+
+_Thread_local lstats stats_thread LTHREAD_FAST;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+static lstats* stats_threads; // Blocks of live threads
+static lstats stats_done; // Sum of finished threads
+
+static void stats_sum(lstats* to, lstats* from)
+{
+  for (int t = 0; t < LVAL_TYPE_COUNT; t++)
+  {
+    to->allocs[t] += from->allocs[t];
+    to->frees[t] += from->frees[t];
+  }
+
+  to->copies += from->copies;
+  to->copy_bytes += from->copy_bytes;
+  to->lookups += from->lookups;
+  to->frames += from->frames;
+  to->builtin_calls += from->builtin_calls;
+  to->lambda_calls += from->lambda_calls;
+
+  if (from->depth_max > to->depth_max)
+    to->depth_max = atomic_load(&from->depth_max);
+}
+
+/* Fold counters of finishing thread into totals */
+static void stats_unregister(void* p)
+{
+  lstats* s = (lstats*)p;
+
+  pthread_mutex_lock(&stats_lock);
+
+  stats_sum(&stats_done, s);
+
+  lstats** l = &stats_threads;
+  while (*l != s)
+    l = &(*l)->next;
+  *l = s->next;
+
+  pthread_mutex_unlock(&stats_lock);
+}
+
+static void stats_init(void)
+{
+  pthread_key_create(&stats_key, stats_unregister);
+}
+
+void stats_register(lstats* s)
+{
+  pthread_once(&stats_once, stats_init);
+
+  pthread_mutex_lock(&stats_lock);
+  s->registered = 1;
+  s->next = stats_threads;
+  stats_threads = s;
+  pthread_mutex_unlock(&stats_lock);
+
+  pthread_setspecific(stats_key, s);
+}
+
+/* Sum counters of all threads, 0 if they are compiled out */
+int stats_read(lstats* out)
+{
+  memset(out, 0, sizeof(*out));
+
+  pthread_mutex_lock(&stats_lock);
+
+  stats_sum(out, &stats_done);
+  for (lstats* s = stats_threads; s; s = s->next)
+    stats_sum(out, s);
+
+  pthread_mutex_unlock(&stats_lock);
+
+  return 1;
+}
+
+/* Values created by calling thread so far, -1 if counters are compiled out */
+long stats_thread_allocs(void)
+{
+  lstats* s = stats_local();
+
+  long n = 0;
+  for (int t = 0; t < LVAL_TYPE_COUNT; t++)
+    n += atomic_load_explicit(&s->allocs[t], memory_order_relaxed);
+  return n;
+}
+
+#else
+
+int stats_read(lstats* out)
+{
+  memset(out, 0, sizeof(*out));
+  return 0;
+}
+
+long stats_thread_allocs(void)
+{
+  return -1;
+}
+
+#endif // LISP_NO_STATS
+
+const char* stats_type_name(int t)
+{
+  return t == LVAL_SEXPR || t == LVAL_QEXPR ? "List" : ltype_name(t);
+}
+
+long stats_type_count(const atomic_long* c, int t)
+{
+  long n = atomic_load(&c[t]);
+  if (t == LVAL_SEXPR)
+    n += atomic_load(&c[LVAL_QEXPR]);
+  else if (t == LVAL_QEXPR)
+    n += atomic_load(&c[LVAL_SEXPR]);
+  return n;
+}
+
+static void stats_metric(lstrbuf* b, const char* name, const char* type,
+  const char* help)
+{
+  strbuf_printf(b, "# HELP lisp_%s %s\n# TYPE lisp_%s %s\n", name, help, name, type);
+}
+
+/* Type name usable as label value, "Symbol" becomes "symbol" */
+static void stats_type_label(lstrbuf* b, int t)
+{
+  for (const char* c = stats_type_name(t); *c; c++)
+    strbuf_putc(b, tolower((unsigned char)*c));
+}
+
+static void stats_by_type(lstrbuf* b, const char* name, const atomic_long* c)
+{
+  for (int t = 0; t < LVAL_TYPE_COUNT; t++)
+  {
+    if (t == LVAL_QEXPR)
+      continue;
+
+    strbuf_printf(b, "lisp_%s{type=\"", name);
+    stats_type_label(b, t);
+    strbuf_printf(b, "\"} %ld\n", stats_type_count(c, t));
+  }
+}
+
+/* Render counters in Prometheus text format */
+void stats_write_prometheus(lstrbuf* b, const lstats* s)
+{
+  stats_metric(b, "values_allocated_total", "counter", "Values created.");
+  stats_by_type(b, "values_allocated_total", s->allocs);
+
+  stats_metric(b, "values_freed_total", "counter",
+    "Values deleted, S- and Q-expressions count as lists.");
+  stats_by_type(b, "values_freed_total", s->frees);
+
+  stats_metric(b, "copies_total", "counter", "Calls of lval_copy.");
+  strbuf_printf(b, "lisp_copies_total %ld\n", atomic_load(&s->copies));
+
+  stats_metric(b, "copy_bytes_total", "counter", "Bytes allocated by copies.");
+  strbuf_printf(b, "lisp_copy_bytes_total %ld\n", atomic_load(&s->copy_bytes));
+
+  stats_metric(b, "lookups_total", "counter", "Symbol lookups.");
+  strbuf_printf(b, "lisp_lookups_total %ld\n", atomic_load(&s->lookups));
+
+  stats_metric(b, "lookup_frames_total", "counter",
+    "Environments walked by symbol lookups.");
+  strbuf_printf(b, "lisp_lookup_frames_total %ld\n", atomic_load(&s->frames));
+
+  stats_metric(b, "calls_total", "counter", "Function calls.");
+  strbuf_printf(b, "lisp_calls_total{kind=\"builtin\"} %ld\n",
+    atomic_load(&s->builtin_calls));
+  strbuf_printf(b, "lisp_calls_total{kind=\"lambda\"} %ld\n",
+    atomic_load(&s->lambda_calls));
+
+  stats_metric(b, "eval_depth_max", "gauge",
+    "Deepest nesting of expression evaluation.");
+  strbuf_printf(b, "lisp_eval_depth_max %ld\n", atomic_load(&s->depth_max));
+}
+
+/* Replace file with current counters, 0 on success */
+int stats_dump(const char* name)
+{
+  lstats s;
+  stats_read(&s);
+
+  lstrbuf b;
+  strbuf_init(&b);
+  stats_write_prometheus(&b, &s);
+
+  /* Readers never see half-written file */
+  lstrbuf tmp;
+  strbuf_init(&tmp);
+  strbuf_printf(&tmp, "%s.tmp", name);
+
+  int ok = 0;
+  FILE* f = fopen(tmp.data, "w");
+  if (f)
+  {
+    ok = fwrite(b.data, 1, b.len, f) == b.len;
+    ok = fclose(f) == 0 && ok;
+    ok = ok && rename(tmp.data, name) == 0;
+  }
+
+  strbuf_free(&tmp);
+  strbuf_free(&b);
+  return ok ? 0 : -1;
+}
+
+static struct
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t stop;
+  int stopping;
+  int running;
+  int interval;
+  char* name;
+} stats_dumper = { .lock = PTHREAD_MUTEX_INITIALIZER, .stop = PTHREAD_COND_INITIALIZER };
+
+static void* stats_dump_loop(void* arg)
+{
+  (void)arg;
+
+  pthread_mutex_lock(&stats_dumper.lock);
+  while (!stats_dumper.stopping)
+  {
+    struct timespec due;
+    clock_gettime(CLOCK_REALTIME, &due);
+    due.tv_sec += stats_dumper.interval;
+
+    while (!stats_dumper.stopping &&
+      pthread_cond_timedwait(&stats_dumper.stop, &stats_dumper.lock, &due) != ETIMEDOUT)
+      ;
+
+    if (!stats_dumper.stopping)
+      stats_dump(stats_dumper.name);
+  }
+  pthread_mutex_unlock(&stats_dumper.lock);
+
+  return NULL;
+}
+
+/* Dump counters to file every 'interval' seconds in background */
+int stats_dump_start(const char* name, int interval)
+{
+  stats_dumper.name = strdup(name);
+  stats_dumper.interval = interval > 0 ? interval : 1;
+  stats_dumper.stopping = 0;
+
+  if (pthread_create(&stats_dumper.thread, NULL, stats_dump_loop, NULL))
+  {
+    free(stats_dumper.name);
+    return -1;
+  }
+
+  stats_dumper.running = 1;
+  return stats_dump(name);
+}
+
+/* Stop dumping and write final counters */
+void stats_dump_stop(void)
+{
+  if (!stats_dumper.running)
+    return;
+
+  pthread_mutex_lock(&stats_dumper.lock);
+  stats_dumper.stopping = 1;
+  pthread_cond_signal(&stats_dumper.stop);
+  pthread_mutex_unlock(&stats_dumper.lock);
+
+  pthread_join(stats_dumper.thread, NULL);
+  stats_dumper.running = 0;
+
+  stats_dump(stats_dumper.name);
+  free(stats_dumper.name);
+}
@@ -0,0 +1,101 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+/*
+ * Runtime counters
+ *
+ * Every thread counts into its own block, so hot paths do
+ * plain increments without locked instructions. Blocks are
+ * summed when statistics are read, blocks of finished
+ * threads are folded into totals. Building with
+ * LISP_NO_STATS removes counters entirely.
+ */
+
+#include <stdatomic.h>
+
+#include "common.h"
+#include "lval.h"
+
+typedef struct _lstats
+{
+  atomic_long allocs[LVAL_TYPE_COUNT]; // Values created, by type
+  atomic_long frees[LVAL_TYPE_COUNT]; // Values deleted, by type they had then
+  atomic_long copies; // lval_copy calls
+  atomic_long copy_bytes; // Memory allocated by them
+  atomic_long lookups; // lenv_get calls
+  atomic_long frames; // Environments walked by lookups
+  atomic_long builtin_calls;
+  atomic_long lambda_calls;
+  atomic_long depth_max; // Deepest nesting of S-expression evaluation
+  long depth; // Current nesting, used by owner only
+  int registered;
+  struct _lstats* next;
+} lstats;
+
+#ifndef LISP_NO_STATS
+
+extern _Thread_local lstats stats_thread LTHREAD_FAST;
+
+void stats_register(lstats* s);
+
+static inline lstats* stats_local(void)
+{
+  lstats* s = &stats_thread;
+  if (!s->registered)
+    stats_register(s);
+  return s;
+}
+
+/* Only owner thread writes, so there is no need for atomic add */
+static inline void stats_add(atomic_long* c, long n)
+{
+  atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+    memory_order_relaxed);
+}
+
+#define STAT_ADD(field, n) stats_add(&stats_local()->field, (n))
+#define STAT_INC(field) STAT_ADD(field, 1)
+
+#define STAT_ENTER() \
+  do { \
+    lstats* s_ = stats_local(); \
+    if (++s_->depth > atomic_load_explicit(&s_->depth_max, memory_order_relaxed)) \
+      atomic_store_explicit(&s_->depth_max, s_->depth, memory_order_relaxed); \
+  } while (0)
+
+#define STAT_LEAVE() (stats_local()->depth--)
+
+#else
+
+#define STAT_ADD(field, n) ((void)0)
+#define STAT_INC(field) ((void)0)
+#define STAT_ENTER() ((void)0)
+#define STAT_LEAVE() ((void)0)
+
+#endif // LISP_NO_STATS
+
+/* Sum counters of all threads, 0 if they are compiled out */
+int stats_read(lstats* out);
+
+/* Values created by calling thread so far, -1 if counters are compiled out */
+long stats_thread_allocs(void);
+
+/* Name counters by type are reported under, S- and Q-expressions
+   turn into each other while evaluated, so both count as lists */
+const char* stats_type_name(int t);
+
+/* Counter of type, lists are summed */
+long stats_type_count(const atomic_long* c, int t);
+
+/* Render counters in Prometheus text format */
+void stats_write_prometheus(struct _lstrbuf* b, const lstats* s);
+
+/* Replace file with current counters, 0 on success */
+int stats_dump(const char* name);
+
+/* Dump counters to file every 'interval' seconds in background */
+int stats_dump_start(const char* name, int interval);
+
+/* Stop dumping and write final counters */
+void stats_dump_stop(void);
+
+#endif // __STATS_H__
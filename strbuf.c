@@ -0,0 +1,108 @@
+/*
+ * String builder
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "strbuf.h"
+
+/* Initial capacity */
+#define STRBUF_MIN_SIZE 256
+
+void strbuf_init(lstrbuf* b)
+{
+  b->size = STRBUF_MIN_SIZE;
+  b->len = 0;
+  b->data = (char*)malloc(b->size);
+  b->data[0] = '\0';
+}
+
+void strbuf_free(lstrbuf* b)
+{
+  free(b->data);
+  b->data = NULL;
+  b->len = b->size = 0;
+}
+
+/* Make room for n more characters */
+void strbuf_reserve(lstrbuf* b, size_t n)
+{
+  if (b->len + n < b->size)
+    return;
+
+  while (b->len + n >= b->size)
+    b->size *= 2;
+
+  b->data = (char*)realloc(b->data, b->size);
+}
+
+void strbuf_putc(lstrbuf* b, char c)
+{
+  strbuf_reserve(b, 1);
+  b->data[b->len++] = c;
+  b->data[b->len] = '\0';
+}
+
+void strbuf_put(lstrbuf* b, const char* s, size_t len)
+{
+  strbuf_reserve(b, len);
+  memcpy(b->data + b->len, s, len);
+  b->len += len;
+  b->data[b->len] = '\0';
+}
+
+void strbuf_puts(lstrbuf* b, const char* s)
+{
+  strbuf_put(b, s, strlen(s));
+}
+
+/* Append integer in decimal */
+void strbuf_num(lstrbuf* b, long x)
+{
+  char digits[24];
+  char* p = digits + sizeof(digits);
+
+  /* Negate digit by digit, so LONG_MIN works too */
+  unsigned long u = x < 0 ? 0UL - (unsigned long)x : (unsigned long)x;
+
+  do
+  {
+    *--p = '0' + u % 10;
+    u /= 10;
+  } while (u);
+
+  if (x < 0)
+    *--p = '-';
+
+  strbuf_put(b, p, digits + sizeof(digits) - p);
+}
+
+void strbuf_printf(lstrbuf* b, const char* fmt, ...)
+{
+  va_list va;
+
+  va_start(va, fmt);
+  strbuf_vprintf(b, fmt, va);
+  va_end(va);
+}
+
+void strbuf_vprintf(lstrbuf* b, const char* fmt, va_list va)
+{
+  va_list again;
+
+  va_copy(again, va);
+  int n = vsnprintf(b->data + b->len, b->size - b->len, fmt, va);
+
+  if (n >= 0 && (size_t)n >= b->size - b->len)
+  {
+    strbuf_reserve(b, n);
+    vsnprintf(b->data + b->len, b->size - b->len, fmt, again);
+  }
+  va_end(again);
+
+  if (n >= 0)
+    b->len += n;
+}
@@ -0,0 +1,40 @@
+#ifndef __STRBUF_H__
+#define __STRBUF_H__
+/*
+ * String builder
+ *
+ * Growable character buffer, values are rendered into it
+ * and written out in one go.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+
+typedef struct _lstrbuf
+{
+  char* data; // Always NUL-terminated
+  size_t len;
+  size_t size;
+} lstrbuf;
+
+void strbuf_init(lstrbuf* b);
+
+void strbuf_free(lstrbuf* b);
+
+/* Make room for n more characters */
+void strbuf_reserve(lstrbuf* b, size_t n);
+
+void strbuf_putc(lstrbuf* b, char c);
+
+void strbuf_put(lstrbuf* b, const char* s, size_t len);
+
+void strbuf_puts(lstrbuf* b, const char* s);
+
+/* Append integer in decimal */
+void strbuf_num(lstrbuf* b, long x);
+
+void strbuf_printf(lstrbuf* b, const char* fmt, ...);
+
+void strbuf_vprintf(lstrbuf* b, const char* fmt, va_list va);
+
+#endif // __STRBUF_H__
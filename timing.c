@@ -0,0 +1,118 @@
+/*
+ * Timing and hardware counters
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "timing.h"
+
+/* Nanoseconds of monotonic clock */
+long long timing_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#ifdef __linux__
+
+static int timing_event(unsigned long long config, int group)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = group < 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/* Open counters for calling thread, 0 if none is available */
+int timing_open(lcounters* c)
+{
+  static const unsigned long long configs[TIMING_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES
+  };
+
+  c->fd = -1;
+  c->count = 0;
+
+  /* Members that can't be opened are skipped, group may be partial */
+  for (int i = 0; i < TIMING_COUNTERS; i++)
+  {
+    c->ids[i] = -1;
+
+    int fd = timing_event(configs[i], c->fd);
+    if (fd < 0)
+      continue;
+
+    if (c->fd < 0)
+      c->fd = fd;
+    c->fds[c->count] = fd;
+    c->ids[i] = c->count++;
+  }
+
+  if (c->fd < 0)
+    return 0;
+
+  ioctl(c->fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(c->fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return c->count;
+}
+
+/* Read current values, unavailable counters are -1 */
+void timing_read(lcounters* c, long long values[TIMING_COUNTERS])
+{
+  unsigned long long buf[1 + TIMING_COUNTERS];
+  int ok = c->fd >= 0 && read(c->fd, buf, sizeof(buf)) > 0;
+
+  for (int i = 0; i < TIMING_COUNTERS; i++)
+    values[i] = ok && c->ids[i] >= 0 ? (long long)buf[1 + c->ids[i]] : -1;
+}
+
+void timing_close(lcounters* c)
+{
+  for (int i = 0; i < c->count; i++)
+    close(c->fds[i]);
+  c->fd = -1;
+  c->count = 0;
+}
+
+#else
+
+int timing_open(lcounters* c)
+{
+  c->fd = -1;
+  c->count = 0;
+  return 0;
+}
+
+void timing_read(lcounters* c, long long values[TIMING_COUNTERS])
+{
+  (void)c;
+  for (int i = 0; i < TIMING_COUNTERS; i++)
+    values[i] = -1;
+}
+
+void timing_close(lcounters* c)
+{
+  c->fd = -1;
+}
+
+#endif // __linux__
@@ -0,0 +1,39 @@
+#ifndef __TIMING_H__
+#define __TIMING_H__
+/*
+ * Timing and hardware counters
+ *
+ * Monotonic clock in nanoseconds and, where perf_event_open
+ * is allowed, user-space cycles, instructions and cache
+ * misses of calling thread.
+ */
+
+/* Hardware counters read together */
+typedef enum
+{
+  TIMING_CYCLES,
+  TIMING_INSTRUCTIONS,
+  TIMING_CACHE_MISSES,
+  TIMING_COUNTERS
+} ltiming_counter;
+
+typedef struct
+{
+  int fd; // Group leader, -1 if counters are unavailable
+  int count; // Counters opened
+  int ids[TIMING_COUNTERS]; // Position of counter in group, -1 if it's missing
+  int fds[TIMING_COUNTERS];
+} lcounters;
+
+/* Nanoseconds of monotonic clock */
+long long timing_now(void);
+
+/* Open counters for calling thread, 0 if none is available */
+int timing_open(lcounters* c);
+
+/* Read current values, unavailable counters are -1 */
+void timing_read(lcounters* c, long long values[TIMING_COUNTERS]);
+
+void timing_close(lcounters* c);
+
+#endif // __TIMING_H__
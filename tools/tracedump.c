@@ -0,0 +1,248 @@
+/*
+ * Trace decoder
+ *
+ * Turns dump written by interpreter trace into timeline, one
+ * line per event, nested by call depth. Times are microseconds
+ * since first event of dump, exits show time spent in call.
+ *
+ * Usage: tracedump FILE [THREAD]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../trace.h"
+
+#define MAX_DEPTH 4096 // Deeper calls aren't timed
+#define MAX_INDENT 32
+
+typedef struct
+{
+  uint64_t key;
+  char* text;
+} lname;
+
+typedef struct
+{
+  const unsigned char* data;
+  size_t len;
+  size_t pos;
+} lreader;
+
+static lname* names;
+static size_t name_count;
+
+static int take(lreader* r, void* p, size_t len)
+{
+  if (r->len - r->pos < len)
+    return 0;
+
+  memcpy(p, r->data + r->pos, len);
+  r->pos += len;
+  return 1;
+}
+
+static int name_cmp(const void* a, const void* b)
+{
+  uint64_t x = ((const lname*)a)->key;
+  uint64_t y = ((const lname*)b)->key;
+  return (x > y) - (x < y);
+}
+
+static const char* name_of(uint64_t key)
+{
+  if (key == 0)
+    return "lambda";
+
+  lname k = { key, NULL };
+  lname* n = (lname*)bsearch(&k, names, name_count, sizeof(lname), name_cmp);
+  return n ? n->text : "?";
+}
+
+static void event(const ltrace_rec* x, uint64_t start, int depth)
+{
+  int indent = depth < MAX_INDENT ? depth : MAX_INDENT;
+  printf("%14.3f  %*s", (x->ts - start) / 1e3, indent * 2, "");
+
+  switch (x->kind)
+  {
+    case TRACE_ENTER:
+      fputs("> ", stdout);
+      break;
+    case TRACE_EXIT:
+      fputs("< ", stdout);
+      break;
+    default:
+      fputs("! ", stdout);
+      break;
+  }
+
+  fputs(name_of(x->name), stdout);
+  if (x->line > 0)
+    printf(":%d", x->line);
+  if (x->builtin)
+    fputs(" [builtin]", stdout);
+}
+
+/* Print events of one thread, exits are matched with entries */
+static void timeline(uint32_t id, const unsigned char* recs, uint32_t count,
+  size_t size, uint64_t start)
+{
+  static uint64_t entered[MAX_DEPTH];
+  int depth = 0;
+
+  printf("thread %u, %u events\n", id, count);
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    ltrace_rec x;
+    memcpy(&x, recs + (size_t)i * size, sizeof(x));
+
+    if (x.kind == TRACE_ENTER)
+    {
+      event(&x, start, depth);
+      printf(" (%u args)\n", x.args);
+      if (depth < MAX_DEPTH)
+        entered[depth] = x.ts;
+      depth++;
+      continue;
+    }
+
+    /* Trace may start in the middle of call */
+    if (depth > 0)
+      depth--;
+    event(&x, start, depth);
+
+    if (depth < MAX_DEPTH && entered[depth])
+      printf(" %.3f us", (x.ts - entered[depth]) / 1e3);
+    if (x.kind == TRACE_ERROR)
+      fputs(" error", stdout);
+    fputc('\n', stdout);
+
+    if (depth < MAX_DEPTH)
+      entered[depth] = 0;
+  }
+
+  fputc('\n', stdout);
+}
+
+static unsigned char* slurp(const char* path, size_t* len)
+{
+  FILE* f = fopen(path, "rb");
+  if (f == NULL)
+    return NULL;
+
+  size_t size = 1 << 16;
+  unsigned char* data = (unsigned char*)malloc(size);
+  *len = 0;
+
+  size_t n;
+  while ((n = fread(data + *len, 1, size - *len, f)) > 0)
+  {
+    *len += n;
+    if (*len == size)
+    {
+      size *= 2;
+      data = (unsigned char*)realloc(data, size);
+    }
+  }
+
+  fclose(f);
+  return data;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2 || argc > 3)
+  {
+    fputs("Usage: tracedump FILE [THREAD]\n", stderr);
+    return 1;
+  }
+
+  uint32_t only = argc > 2 ? (uint32_t)atol(argv[2]) : 0;
+
+  size_t len;
+  unsigned char* data = slurp(argv[1], &len);
+  if (data == NULL)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+
+  lreader r = { data, len, 0 };
+  char magic[4];
+  uint32_t version, size;
+  if (!take(&r, magic, 4) || memcmp(magic, TRACE_MAGIC, 4)
+    || !take(&r, &version, 4) || !take(&r, &size, 4))
+  {
+    fprintf(stderr, "%s: not a trace dump\n", argv[1]);
+    return 1;
+  }
+
+  if (version != TRACE_VERSION || size < sizeof(ltrace_rec))
+  {
+    fprintf(stderr, "%s: unsupported trace version %u\n", argv[1], version);
+    return 1;
+  }
+
+  /* Skip over threads to names, remembering first timestamp */
+  size_t threads = r.pos;
+  uint64_t start = UINT64_MAX;
+  while (1)
+  {
+    uint32_t id, count;
+    if (!take(&r, &id, 4) || !take(&r, &count, 4) || r.len - r.pos < (size_t)count * size)
+    {
+      fprintf(stderr, "%s: truncated trace\n", argv[1]);
+      return 1;
+    }
+
+    if (id == 0)
+      break;
+
+    if (count > 0)
+    {
+      uint64_t ts;
+      memcpy(&ts, r.data + r.pos, sizeof(ts));
+      if (ts < start)
+        start = ts;
+    }
+    r.pos += (size_t)count * size;
+  }
+
+  uint64_t key;
+  uint32_t n;
+  while (take(&r, &key, 8) && take(&r, &n, 4) && r.len - r.pos >= n)
+  {
+    names = (lname*)realloc(names, sizeof(lname) * (name_count + 1));
+    names[name_count].key = key;
+    names[name_count].text = strndup((const char*)r.data + r.pos, n);
+    name_count++;
+    r.pos += n;
+  }
+
+  qsort(names, name_count, sizeof(lname), name_cmp);
+
+  r.pos = threads;
+  while (1)
+  {
+    uint32_t id, count;
+    take(&r, &id, 4);
+    take(&r, &count, 4);
+    if (id == 0)
+      break;
+
+    if (only == 0 || id == only)
+      timeline(id, r.data + r.pos, count, size, start);
+    r.pos += (size_t)count * size;
+  }
+
+  for (size_t i = 0; i < name_count; i++)
+    free(names[i].text);
+  free(names);
+  free(data);
+  return 0;
+}
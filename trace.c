@@ -0,0 +1,309 @@
+/*
+ * Evaluation trace
+ *
+ * Rings of finished threads are kept, so their last events
+ * still get into dumps, and handed over to new threads.
+ * Dumper copies ring and then checks how far owner has got
+ * meanwhile, events it may have overwritten are left out.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define TRACE_NAMES 16384 // Distinct names in dump, power of two
+#define TRACE_PATH 4096
+#define TRACE_BUFFER 8192
+
+atomic_int trace_active;
+_Thread_local ltring* trace_ring LTHREAD_FAST;
+
+static _Atomic(ltring*) trace_rings;
+static atomic_uint trace_ids;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+static char trace_path[TRACE_PATH];
+
+/* Dump works on static storage to be usable from signal handler */
+static atomic_flag busy = ATOMIC_FLAG_INIT;
+static ltrace_rec copy[TRACE_RING];
+static uint64_t names[TRACE_NAMES];
+
+typedef struct
+{
+  int fd;
+  int failed;
+  size_t len;
+  char data[TRACE_BUFFER];
+} ltrace_out;
+
+static ltrace_out out;
+
+/* Ring is left for next thread */
+static void trace_release(void* p)
+{
+  ltring* r = (ltring*)p;
+  atomic_store(&r->owned, 0);
+}
+
+static void trace_init(void)
+{
+  pthread_key_create(&trace_key, trace_release);
+}
+
+/* Ring of calling thread, NULL if it can't be allocated */
+ltring* trace_attach(void)
+{
+  pthread_once(&trace_once, trace_init);
+
+  ltring* r;
+  for (r = atomic_load(&trace_rings); r; r = r->next)
+  {
+    int unowned = 0;
+    if (atomic_compare_exchange_strong(&r->owned, &unowned, 1))
+      break;
+  }
+
+  if (r == NULL)
+  {
+    r = (ltring*)calloc(1, sizeof(ltring));
+    if (r == NULL)
+      return NULL;
+
+    atomic_init(&r->owned, 1);
+    r->next = atomic_load(&trace_rings);
+    while (!atomic_compare_exchange_weak(&trace_rings, &r->next, r))
+      ;
+  }
+
+  /* Events of previous owner are no longer dumped */
+  r->id = atomic_fetch_add(&trace_ids, 1) + 1;
+  r->base = atomic_load(&r->head);
+
+  pthread_setspecific(trace_key, r);
+  trace_ring = r;
+  return r;
+}
+
+/* Turn recording on or off, returns previous state */
+int trace_set(int on)
+{
+  return atomic_exchange(&trace_active, on);
+}
+
+static void trace_signal(int sig)
+{
+  (void)sig;
+  int saved = errno;
+  trace_dump(trace_path);
+  errno = saved;
+}
+
+/* Start recording, SIGUSR2 dumps trace into file if it's given */
+int trace_start(const char* path)
+{
+  if (path)
+  {
+    if (strlen(path) >= TRACE_PATH)
+    {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    strcpy(trace_path, path);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = trace_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGUSR2, &sa, NULL) < 0)
+      return -1;
+  }
+
+  trace_set(1);
+  return 0;
+}
+
+static void trace_flush(ltrace_out* o)
+{
+  size_t done = 0;
+  while (!o->failed && done < o->len)
+  {
+    ssize_t n = write(o->fd, o->data + done, o->len - done);
+    if (n < 0 && errno != EINTR)
+      o->failed = 1;
+    else if (n > 0)
+      done += n;
+  }
+  o->len = 0;
+}
+
+static void trace_write(ltrace_out* o, const void* p, size_t len)
+{
+  const char* s = (const char*)p;
+  while (len > 0)
+  {
+    if (o->len == TRACE_BUFFER)
+      trace_flush(o);
+
+    size_t n = TRACE_BUFFER - o->len;
+    if (n > len)
+      n = len;
+
+    memcpy(o->data + o->len, s, n);
+    o->len += n;
+    s += n;
+    len -= n;
+  }
+}
+
+static void trace_u32(ltrace_out* o, uint32_t x)
+{
+  trace_write(o, &x, sizeof(x));
+}
+
+/* Remember name key to write its text later */
+static void trace_name(uint64_t key)
+{
+  if (key == 0)
+    return;
+
+  unsigned h = (unsigned)(key ^ (key >> 17)) * 2654435761u;
+  for (int k = 0; k < TRACE_NAMES / 4 * 3; k++)
+  {
+    uint64_t* n = &names[(h + k) & (TRACE_NAMES - 1)];
+    if (*n == key)
+      return;
+    if (*n == 0)
+    {
+      *n = key;
+      return;
+    }
+  }
+}
+
+/* Copy events of ring still valid after copying, returns their count */
+static unsigned long trace_copy(ltring* r, unsigned long* first)
+{
+  unsigned long head = atomic_load_explicit(&r->head, memory_order_acquire);
+  unsigned long from = r->base;
+  if (head - from > TRACE_RING)
+    from = head - TRACE_RING;
+
+  for (unsigned long i = from; i < head; i++)
+    copy[i - from] = r->recs[i & (TRACE_RING - 1)];
+
+  /* Owner went on while we copied, oldest events may be torn
+     including one it is writing now */
+  unsigned long now = atomic_load_explicit(&r->head, memory_order_acquire);
+  unsigned long skip = 0;
+  if (now + 1 - from > TRACE_RING)
+    skip = now + 1 - from - TRACE_RING;
+  if (skip > head - from)
+    skip = head - from;
+
+  *first = skip;
+  return head - from - skip;
+}
+
+static int trace_lock(void)
+{
+  if (atomic_flag_test_and_set_explicit(&busy, memory_order_acquire))
+  {
+    errno = EBUSY;
+    return -1;
+  }
+  return 0;
+}
+
+static void trace_unlock(void)
+{
+  atomic_flag_clear_explicit(&busy, memory_order_release);
+}
+
+/* Write dump, caller holds lock */
+static int trace_emit(int fd)
+{
+  ltrace_out* o = &out;
+  o->fd = fd;
+  o->failed = 0;
+  o->len = 0;
+  memset(names, 0, sizeof(names));
+
+  trace_write(o, TRACE_MAGIC, 4);
+  trace_u32(o, TRACE_VERSION);
+  trace_u32(o, sizeof(ltrace_rec));
+
+  for (ltring* r = atomic_load(&trace_rings); r; r = r->next)
+  {
+    unsigned long first;
+    unsigned long count = trace_copy(r, &first);
+    if (count == 0)
+      continue;
+
+    trace_u32(o, r->id);
+    trace_u32(o, count);
+    trace_write(o, &copy[first], sizeof(ltrace_rec) * count);
+
+    for (unsigned long i = first; i < first + count; i++)
+      trace_name(copy[i].name);
+  }
+
+  trace_u32(o, 0);
+  trace_u32(o, 0);
+
+  for (int k = 0; k < TRACE_NAMES; k++)
+  {
+    if (names[k] == 0)
+      continue;
+
+    const char* s = (const char*)(uintptr_t)names[k];
+    uint32_t len = strlen(s);
+    trace_write(o, &names[k], sizeof(uint64_t));
+    trace_u32(o, len);
+    trace_write(o, s, len);
+  }
+
+  trace_flush(o);
+  return o->failed ? -1 : 0;
+}
+
+/* Write trace of all threads, 0 on success. Async-signal-safe,
+   returns -1 if another dump is in progress. */
+int trace_dump_fd(int fd)
+{
+  if (trace_lock() < 0)
+    return -1;
+
+  int r = trace_emit(fd);
+  trace_unlock();
+  return r;
+}
+
+/* Write trace into file, 0 on success */
+int trace_dump(const char* path)
+{
+  /* File of dump in progress must not be truncated */
+  if (trace_lock() < 0)
+    return -1;
+
+  int r = -1;
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd >= 0)
+  {
+    r = trace_emit(fd);
+    if (close(fd) < 0)
+      r = -1;
+  }
+
+  trace_unlock();
+  return r;
+}
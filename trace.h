@@ -0,0 +1,105 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+/*
+ * Evaluation trace
+ *
+ * While tracing is on, lval_call records entry and exit of
+ * every call into ring buffer of its thread. Rings are
+ * written only by their owners, so recording takes no locks.
+ * They keep last TRACE_RING events and can be dumped at any
+ * moment, also from signal handler.
+ *
+ * Dump layout, fields are in host byte order:
+ *   header   "LTRC", u32 version, u32 record size
+ *   thread   u32 id, u32 count, then count records, oldest first
+ *   ...      one block per thread that has traced anything
+ *   end      u32 0, u32 0
+ *   names    u64 key, u32 length, bytes, until end of file
+ *
+ * Record refers to function name by key, names block maps
+ * keys to text. Names are static or interned, so they are
+ * valid as long as the process is.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "timing.h"
+
+#define TRACE_MAGIC "LTRC"
+#define TRACE_VERSION 1
+#define TRACE_RING 65536 // Events kept by thread, power of two
+
+typedef enum
+{
+  TRACE_ENTER,
+  TRACE_EXIT,
+  TRACE_ERROR // Exit with error result
+} ltrace_kind;
+
+typedef struct
+{
+  uint64_t ts; // Monotonic nanoseconds
+  uint64_t name; // Name key, 0 for anonymous lambda
+  int32_t line; // Line of lambda, 0 for built-ins
+  uint16_t args; // Argument count of entry
+  uint8_t kind;
+  uint8_t builtin;
+} ltrace_rec;
+
+typedef struct _ltring
+{
+  struct _ltring* next; // All rings, they are never freed
+  atomic_int owned; // Ring belongs to live thread
+  uint32_t id;
+  atomic_ulong head; // Events recorded so far
+  unsigned long base; // Head when current owner took ring
+  ltrace_rec recs[TRACE_RING];
+} ltring;
+
+extern atomic_int trace_active;
+extern _Thread_local ltring* trace_ring LTHREAD_FAST;
+
+static inline int trace_on(void)
+{
+  return atomic_load_explicit(&trace_active, memory_order_relaxed);
+}
+
+/* Ring of calling thread, NULL if it can't be allocated */
+ltring* trace_attach(void);
+
+static inline void trace_event(ltrace_kind kind, const char* name, int line,
+  int args, int builtin)
+{
+  ltring* r = trace_ring;
+  if (r == NULL && (r = trace_attach()) == NULL)
+    return;
+
+  unsigned long h = atomic_load_explicit(&r->head, memory_order_relaxed);
+  ltrace_rec* x = &r->recs[h & (TRACE_RING - 1)];
+  x->ts = timing_now();
+  x->name = (uintptr_t)name;
+  x->line = line;
+  x->args = args > UINT16_MAX ? UINT16_MAX : args;
+  x->kind = kind;
+  x->builtin = builtin;
+
+  /* Dumper must see record before head */
+  atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+/* Turn recording on or off, returns previous state */
+int trace_set(int on);
+
+/* Start recording, SIGUSR2 dumps trace into file if it's given */
+int trace_start(const char* path);
+
+/* Write trace of all threads, 0 on success. Async-signal-safe,
+   returns -1 if another dump is in progress. */
+int trace_dump_fd(int fd);
+
+/* Write trace into file, 0 on success, same as above */
+int trace_dump(const char* path);
+
+#endif // __TRACE_H__
@@ -1,10 +0,0 @@
-#ifndef __YYSTYPE_H__
-#define __YYSTYPE_H__
-
-/*
- * The only purpose of this header is to define YYSTYPE
- */
-
-#define YYSTYPE unsigned long
-
-#endif // __YYSTYPE_H__